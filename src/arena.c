@@ -0,0 +1,99 @@
+/*
+ *  This file is part of cake compiler
+ *  https://github.com/thradams/cake 
+*/
+
+#pragma safety enable
+
+#include "ownership.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "arena.h"
+#include "thread.h"
+
+enum
+{
+    ARENA_FIRST_BLOCK_SIZE = 64 * 1024,
+    ARENA_MAX_BLOCK_SIZE = 4 * 1024 * 1024
+};
+
+struct arena_block
+{
+    struct arena_block* _Owner _Opt previous;
+    size_t used;
+    size_t capacity;
+    /*data follows*/
+};
+
+/*each thread compiles its own file (-j)*/
+static THREAD_LOCAL struct arena* _Opt s_current_arena = NULL;
+
+struct arena* _Opt arena_set_current(struct arena* _Opt arena)
+{
+    struct arena* _Opt previous = s_current_arena;
+    s_current_arena = arena;
+    return previous;
+}
+
+struct arena* _Opt arena_get_current(void)
+{
+    return s_current_arena;
+}
+
+void* _Opt arena_calloc(struct arena* arena, size_t size)
+{
+    /*keeps everything aligned as malloc does*/
+    const size_t alignment = sizeof(long double) > sizeof(void*) ? sizeof(long double) : sizeof(void*);
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    struct arena_block* _Opt p_block = arena->blocks;
+    if (p_block == NULL || p_block->used + size > p_block->capacity)
+    {
+        /*blocks grow geometrically*/
+        size_t capacity = p_block ? p_block->capacity * 2 : ARENA_FIRST_BLOCK_SIZE;
+        if (capacity > ARENA_MAX_BLOCK_SIZE)
+            capacity = ARENA_MAX_BLOCK_SIZE;
+        if (capacity < size)
+            capacity = size;
+
+        const size_t header_size = (sizeof(struct arena_block) + alignment - 1) & ~(alignment - 1);
+        struct arena_block* _Owner _Opt p_new_block = malloc(header_size + capacity);
+        if (p_new_block == NULL)
+            return NULL;
+
+        p_new_block->used = header_size;
+        p_new_block->capacity = header_size + capacity;
+        p_new_block->previous = arena->blocks;
+        arena->blocks = p_new_block;
+        p_block = p_new_block;
+    }
+
+    char* p = (char*)p_block + p_block->used;
+    p_block->used += size;
+    arena->size += size;
+    memset(p, 0, size);
+    return p;
+}
+
+char* _Opt arena_strndup(struct arena* arena, const char* s, size_t length)
+{
+    char* _Opt p = arena_calloc(arena, length + 1);
+    if (p == NULL)
+        return NULL;
+    memcpy(p, s, length);
+    return p;
+}
+
+void arena_destroy(_Dtor struct arena* arena)
+{
+    assert(s_current_arena != arena);
+
+    struct arena_block* _Owner _Opt p_block = arena->blocks;
+    while (p_block)
+    {
+        struct arena_block* _Owner _Opt previous = p_block->previous;
+        free(p_block);
+        p_block = previous;
+    }
+}
@@ -0,0 +1,37 @@
+/*
+ *  This file is part of cake compiler
+ *  https://github.com/thradams/cake 
+*/
+
+#pragma once
+#include "ownership.h"
+#include <stddef.h>
+
+/*
+  Bump allocator.
+  Objects allocated from the arena are not released individually;
+  all memory is released at once by arena_destroy.
+*/
+
+struct arena_block;
+
+struct arena
+{
+    struct arena_block* _Owner _Opt blocks;
+
+    /*total number of bytes allocated by the arena*/
+    size_t size;
+};
+
+void* _Opt arena_calloc(struct arena* arena, size_t size);
+char* _Opt arena_strndup(struct arena* arena, const char* s, size_t length);
+void arena_destroy(_Dtor struct arena* arena);
+
+/*
+  Arena used by the compilation of the current file to allocate tokens
+  and expressions. When it is NULL each object is allocated and released
+  individually.
+  Returns the previous arena.
+*/
+struct arena* _Opt arena_set_current(struct arena* _Opt arena);
+struct arena* _Opt arena_get_current(void);
@@ -16,6 +16,7 @@
 
 #define CAKE_LIB_SOURCE_FILES \
     " token.c "               \
+    " arena.c "               \
     " hashmap.c "             \
     " console.c "             \
     " tokenizer.c "           \
@@ -33,7 +34,10 @@
     " flow.c "                \
     " error.c "               \
     " target.c "              \
-    " type.c "
+    " type.c "                \
+    " thread.c "              \
+    " cache.c "               \
+    " time_report.c "
 
 #define CAKE_SOURCE_FILES \
     CAKE_LIB_SOURCE_FILES \
@@ -288,6 +292,7 @@ int main()
            " -Wno-unknown-pragmas "
            " -Wno-multichar "
            " -std=c17 "
+           " -pthread "
 
            " -o cake "
            CAKE_SOURCE_FILES);
@@ -320,6 +325,7 @@ int main()
 #ifdef TEST
            " -DTEST "
 #endif
+           " -pthread "
            " -o cake");
 
 
@@ -340,7 +346,7 @@ int main()
 
     echo_chdir("./x86_x64_gcc/");
 
-    execute_cmd("gcc  -o cake89 " CAKE_SOURCE_FILES);
+    execute_cmd("gcc -pthread -o cake89 " CAKE_SOURCE_FILES);
     //execute_cmd("cp "cake"")
     execute_cmd("cp cake89 ../cake89");
     echo_chdir("../");
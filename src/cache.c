@@ -0,0 +1,335 @@
+/*
+ *  This file is part of cake compiler
+ *  https://github.com/thradams/cake
+*/
+
+#pragma safety enable
+
+#include "ownership.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "cache.h"
+#include "token.h"
+#include "fs.h"
+#include "options.h"
+#include "version.h"
+
+#include "thread.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <process.h>
+#include <sys/utime.h>
+#define utime _utime
+#define utimbuf _utimbuf
+#define getpid _getpid
+#else
+#include <utime.h>
+#endif
+
+#define CACHE_FILE_EXTENSION ".cakecache"
+
+void cache_entry_destroy(_Dtor struct cache_entry* p)
+{
+    free(p->messages);
+    free(p->sarif);
+    free(p->output);
+}
+
+/*FNV-1a*/
+static unsigned long long hash_bytes(unsigned long long h, const void* data, size_t size)
+{
+    const unsigned char* p = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static unsigned long long hash_string(unsigned long long h, const char* s)
+{
+    /*includes '\0' to separate the strings*/
+    return hash_bytes(h, s, strlen(s) + 1);
+}
+
+static unsigned long long hash_int(unsigned long long h, int value)
+{
+    return hash_bytes(h, &value, sizeof value);
+}
+
+static unsigned long long hash_bitset(unsigned long long h, const struct bitset* p)
+{
+    return hash_bytes(h, p->bits, sizeof p->bits);
+}
+
+unsigned long long cache_key(const struct options* options, const char* file_name, const struct token* _Opt p_first_token)
+{
+    unsigned long long h = 14695981039346656037ULL;
+
+    h = hash_string(h, CAKE_VERSION);
+    h = hash_string(h, file_name);
+
+    /*
+      Only the options that change messages, sarif results or output.
+      -I, -D and -include-pch change the tokens; -j, -o, -cache-dir,
+      -MD and -ftime-report do not change the result.
+    */
+    h = hash_int(h, options->input);
+    h = hash_int(h, options->target);
+    h = hash_int(h, options->style);
+    h = hash_int(h, options->disable_assert);
+    h = hash_int(h, options->flow_analysis);
+    h = hash_int(h, options->null_checks_enabled);
+    h = hash_int(h, options->ownership_enabled);
+    h = hash_int(h, options->sarif_output);
+    h = hash_int(h, options->no_output);
+    h = hash_int(h, options->const_literal);
+    h = hash_int(h, options->visual_studio_ouput_format);
+    h = hash_int(h, options->color_disabled);
+    h = hash_int(h, options->comment_to_attribute);
+    h = hash_int(h, options->do_static_debug);
+    h = hash_int(h, options->static_debug_lines);
+    h = hash_int(h, options->asm_output);
+
+    const struct diagnostic* p_diagnostic = &options->diagnostic_stack.stack[options->diagnostic_stack.top_index];
+    h = hash_bitset(h, &p_diagnostic->errors);
+    h = hash_bitset(h, &p_diagnostic->warnings);
+    h = hash_bitset(h, &p_diagnostic->notes);
+
+    /*the position of the tokens is part of the messages*/
+    const struct token* _Opt p_origin = NULL;
+    for (const struct token* _Opt p = p_first_token; p; p = p->next)
+    {
+        if (p->token_origin != p_origin && p->token_origin != NULL)
+        {
+            p_origin = p->token_origin;
+            h = hash_string(h, p_origin->lexeme);
+        }
+        h = hash_int(h, p->type);
+        h = hash_int(h, p->line);
+        h = hash_int(h, p->col);
+        h = hash_int(h, p->level);
+        h = hash_int(h, p->flags);
+        h = hash_string(h, p->lexeme);
+    }
+    return h;
+}
+
+static void cache_file_name(const char* dir, unsigned long long key, char* out, int out_size)
+{
+    snprintf(out, out_size, "%s/%016llx" CACHE_FILE_EXTENSION, dir, key);
+}
+
+static char* _Owner _Opt read_blob(FILE* file, size_t size)
+{
+    char* _Owner _Opt p = malloc(size + 1);
+    if (p == NULL)
+        return NULL;
+
+    if (fread(p, 1, size, file) != size)
+    {
+        free(p);
+        return NULL;
+    }
+    p[size] = '\0';
+    return p;
+}
+
+int cache_load(const char* dir, unsigned long long key, _Ctor struct cache_entry* entry)
+{
+    memset(entry, 0, sizeof * entry);
+
+    char path[FS_MAX_PATH] = { 0 };
+    cache_file_name(dir, key, path, sizeof path);
+
+    FILE* _Owner _Opt file = fopen(path, "rb");
+    if (file == NULL)
+        return 1;
+
+    char version[50] = { 0 };
+    unsigned long long sizes[3] = { 0 };
+    const int n = fscanf(file, "cake %49s %d %d %d %llu %llu %llu",
+        version,
+        &entry->error_count,
+        &entry->warnings_count,
+        &entry->info_count,
+        &sizes[0],
+        &sizes[1],
+        &sizes[2]);
+
+    if (n != 7 || strcmp(version, CAKE_VERSION) != 0 || fgetc(file) != '\n')
+    {
+        fclose(file);
+        return 1;
+    }
+
+    entry->messages = read_blob(file, (size_t)sizes[0]);
+    entry->sarif = read_blob(file, (size_t)sizes[1]);
+    entry->output = read_blob(file, (size_t)sizes[2]);
+    fclose(file);
+
+    if (entry->messages == NULL || entry->sarif == NULL || entry->output == NULL)
+    {
+        cache_entry_destroy(entry);
+        memset(entry, 0, sizeof * entry);
+        return 1;
+    }
+
+    /*recently used files are the last ones to be removed*/
+    utime(path, NULL);
+
+    return 0;
+}
+
+struct cache_file
+{
+    long long mtime;
+    long long size;
+    char name[260];
+};
+
+static int cache_file_compare(const void* a, const void* b)
+{
+    const struct cache_file* pa = a;
+    const struct cache_file* pb = b;
+    return pa->mtime < pb->mtime ? -1 : pa->mtime > pb->mtime ? 1 : 0;
+}
+
+void cache_trim(const char* dir, long long max_size_bytes)
+{
+#ifndef MOCKFILES
+    if (max_size_bytes <= 0)
+        return;
+
+    DIR* _Owner _Opt p_dir = opendir(dir);
+    if (p_dir == NULL)
+        return;
+
+    struct cache_file* _Owner _Opt files = NULL;
+    int capacity = 0;
+    int count = 0;
+
+    const size_t extension_length = strlen(CACHE_FILE_EXTENSION);
+    long long total = 0;
+
+    struct dirent* _Opt dp = NULL;
+    while ((dp = readdir(p_dir)) != NULL)
+    {
+        const size_t length = strlen(dp->d_name);
+        if (length <= extension_length ||
+            strcmp(dp->d_name + length - extension_length, CACHE_FILE_EXTENSION) != 0)
+        {
+            continue;
+        }
+
+        char path[FS_MAX_PATH] = { 0 };
+        snprintf(path, sizeof path, "%s/%s", dir, dp->d_name);
+
+        struct stat st = { 0 };
+        if (stat(path, &st) != 0)
+            continue;
+
+        if (count == capacity)
+        {
+            const int new_capacity = capacity == 0 ? 256 : capacity * 2;
+            struct cache_file* _Owner _Opt p = realloc(files, new_capacity * sizeof(struct cache_file));
+            if (p == NULL)
+                break;
+            files = p;
+            capacity = new_capacity;
+        }
+
+        total += (long long)st.st_size;
+        files[count].mtime = (long long)st.st_mtime;
+        files[count].size = (long long)st.st_size;
+        snprintf(files[count].name, sizeof files[count].name, "%s", dp->d_name);
+        count++;
+    }
+    closedir(p_dir);
+
+    if (files != NULL && total > max_size_bytes)
+    {
+        /*oldest first*/
+        qsort(files, count, sizeof(struct cache_file), cache_file_compare);
+
+        /*removes the oldest until we have 3/4 of the limit*/
+        const long long target = max_size_bytes / 4 * 3;
+        for (int i = 0; i < count && total > target; i++)
+        {
+            char path[FS_MAX_PATH] = { 0 };
+            snprintf(path, sizeof path, "%s/%s", dir, files[i].name);
+            if (remove(path) == 0)
+                total -= files[i].size;
+        }
+    }
+
+    free(files);
+#endif
+}
+
+/*replaces new_path when it exists, atomically*/
+static int replace_file(const char* old_path, const char* new_path)
+{
+#ifdef _WIN32
+    return MoveFileExA(old_path, new_path, MOVEFILE_REPLACE_EXISTING) ? 0 : 1;
+#else
+    return rename(old_path, new_path);
+#endif
+}
+
+int cache_store(const char* dir, unsigned long long key, const struct cache_entry* entry)
+{
+    const char* messages = entry->messages ? entry->messages : "";
+    const char* sarif = entry->sarif ? entry->sarif : "";
+    const char* output = entry->output ? entry->output : "";
+
+    mkdir(dir, 0777);
+
+    char path[FS_MAX_PATH] = { 0 };
+    cache_file_name(dir, key, path, sizeof path);
+
+    /*
+      other cake processes and files being compiled in parallel (-j) can
+      store at the same time, so the file is written with a name unique
+      for the process and the store, and then renamed
+    */
+    static int s_temp_number = 0;
+    shared_lock_acquire(SHARED_LOCK_CACHE);
+    const int temp_number = s_temp_number++;
+    shared_lock_release(SHARED_LOCK_CACHE);
+
+    char temp_path[FS_MAX_PATH + 30] = { 0 };
+    snprintf(temp_path, sizeof temp_path, "%s.%d.%d.tmp", path, (int)getpid(), temp_number);
+
+    FILE* _Owner _Opt file = fopen(temp_path, "wb");
+    if (file == NULL)
+        return 1;
+
+    fprintf(file, "cake %s %d %d %d %llu %llu %llu\n",
+        CAKE_VERSION,
+        entry->error_count,
+        entry->warnings_count,
+        entry->info_count,
+        (unsigned long long)strlen(messages),
+        (unsigned long long)strlen(sarif),
+        (unsigned long long)strlen(output));
+
+    fputs(messages, file);
+    fputs(sarif, file);
+    fputs(output, file);
+
+    const bool error = ferror(file) != 0;
+    fclose(file);
+
+    if (error || replace_file(temp_path, path) != 0)
+    {
+        remove(temp_path);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ *  This file is part of cake compiler
+ *  https://github.com/thradams/cake
+*/
+
+#pragma once
+#include "ownership.h"
+
+/*
+  -cache-dir dir
+  Results of files already compiled. The key is a hash of the options,
+  of the file name and of the preprocessed tokens; when it is found, the
+  saved messages, sarif results and output are used instead of parsing
+  and analyzing the file again.
+*/
+
+struct token;
+struct options;
+
+struct cache_entry
+{
+    int error_count;
+    int warnings_count;
+    int info_count;
+
+    /*messages printed by the parser and flow analysis*/
+    char* _Owner _Opt messages;
+
+    /*sarif results (-sarif)*/
+    char* _Owner _Opt sarif;
+
+    /*generated file*/
+    char* _Owner _Opt output;
+};
+
+void cache_entry_destroy(_Dtor struct cache_entry* p);
+
+unsigned long long cache_key(const struct options* options, const char* file_name, const struct token* _Opt p_first_token);
+
+/*returns 0 when the entry was found*/
+int cache_load(const char* dir, unsigned long long key, _Ctor struct cache_entry* entry);
+
+/*returns 0 when the entry was saved*/
+int cache_store(const char* dir, unsigned long long key, const struct cache_entry* entry);
+
+/*
+  When the files of the cache are bigger than max_size_bytes (0 is
+  unlimited), the least recently used are removed. Called once per run.
+*/
+void cache_trim(const char* dir, long long max_size_bytes);
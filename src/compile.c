@@ -17,6 +17,10 @@
 #include <string.h>
 #include "console.h"
 #include "fs.h"
+#include "osstream.h"
+#include "thread.h"
+#include "cache.h"
+#include "time_report.h"
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -99,6 +103,22 @@ int fill_preprocessor_options(int argc, const char** argv, struct preprocessor_c
     return 0;
 }
 
+/*
+  -D, -U and -I in the order of the command line, saved by -emit-pch.
+  The precompiled header is used only with the same ones.
+*/
+static void preprocessor_options_string(int argc, const char** argv, struct osstream* ss)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' &&
+            (argv[i][1] == 'D' || argv[i][1] == 'U' || argv[i][1] == 'I'))
+        {
+            ss_fprintf(ss, "%s\n", argv[i]);
+        }
+    }
+}
+
 #ifdef _WIN32
 
 WINBASEAPI unsigned long WINAPI GetEnvironmentVariableA(const char* name,
@@ -118,7 +138,7 @@ int generate_config_file(const char* configpath)
         if (outfile == NULL)
         {
             error = errno;
-            printf("Cannot open the file '%s' for writing '%s'.\n", configpath, get_posix_error_message(error));
+            console_printf("Cannot open the file '%s' for writing '%s'.\n", configpath, get_posix_error_message(error));
             throw;
         }
 
@@ -238,7 +258,7 @@ int generate_config_file(const char* configpath)
 
         if (n <= 0)
         {
-            printf("INCLUDE not found.\nPlease, run cake -autoconfig inside visual studio command prompt.\n");
+            console_printf("INCLUDE not found.\nPlease, run cake -autoconfig inside visual studio command prompt.\n");
             error = 1;
             throw;
         }
@@ -291,8 +311,8 @@ int generate_config_file(const char* configpath)
 
     if (error == 0)
     {
-        printf("file '%s'\n", configpath);
-        printf("successfully generated\n");
+        console_printf("file '%s'\n", configpath);
+        console_printf("successfully generated\n");
     }
     return error;
 }
@@ -308,6 +328,178 @@ static int get_first_line_len(const char* s)
     return n;
 }
 
+/*
+  -MD
+  Writes "target: file.c files used..." at the file defined by -MF or,
+  by default, at the output file (or source file) with the extension .d
+*/
+static int write_dependency_file(const struct preprocessor_ctx* prectx,
+    const struct options* options,
+    const char* file_name,
+    const char* out_file_name)
+{
+    const char* const target_file_name = out_file_name[0] != '\0' ? out_file_name : file_name;
+
+    char dependency_file_name[FS_MAX_PATH] = { 0 };
+    if (options->dependency_file_name[0] != '\0')
+    {
+        snprintf(dependency_file_name, sizeof dependency_file_name, "%s", options->dependency_file_name);
+    }
+    else
+    {
+        snprintf(dependency_file_name, sizeof dependency_file_name, "%s", target_file_name);
+        char* _Opt p_dot = strrchr(dependency_file_name, '.');
+        if (p_dot && strpbrk(p_dot, "/\\") == NULL)
+            *p_dot = '\0';
+        strcat(dependency_file_name, ".d");
+    }
+
+    FILE* _Owner _Opt file = fopen(dependency_file_name, "w");
+    if (file == NULL)
+    {
+        console_printf("cannot open dependency file '%s' - %s\n", dependency_file_name, get_posix_error_message(errno));
+        return 1;
+    }
+
+    fprintf(file, "%s:%s\n",
+        options->dependency_target[0] != '\0' ? options->dependency_target : target_file_name,
+        prectx->dependencies.c_str ? prectx->dependencies.c_str : "");
+
+    fclose(file);
+    return 0;
+}
+
+/*
+  -cache-dir
+  The messages, sarif results and output of parse and flow analysis
+  are saved. Files with the same options and preprocessed tokens use
+  them instead of being parsed again.
+*/
+struct compile_cache
+{
+    bool enabled;
+    unsigned long long key;
+
+    /*messages are captured while the file is parsed*/
+    bool capturing;
+    struct osstream messages;
+    struct osstream* _Opt previous_capture;
+
+    /*report before parse*/
+    int error_count;
+    int warnings_count;
+    int info_count;
+
+    long sarif_begin;
+    long sarif_end;
+};
+
+/*
+  Uses the saved result if it exists. Returns true if the file does not
+  need to be parsed.
+*/
+static bool compile_cache_replay(struct compile_cache* cache,
+    const struct options* options,
+    const char* file_name,
+    const struct token_list* tokens,
+    const char* out_file_name,
+    FILE* _Opt sarif_file,
+    struct report* report)
+{
+    cache->key = cache_key(options, file_name, tokens->head);
+
+    struct cache_entry entry = { 0 };
+    if (cache_load(options->cache_dir, cache->key, &entry) != 0)
+        return false;
+
+    console_printf("%s", entry.messages ? entry.messages : "");
+    report->error_count += entry.error_count;
+    report->warnings_count += entry.warnings_count;
+    report->info_count += entry.info_count;
+
+    if (sarif_file && entry.sarif)
+        fprintf(sarif_file, "%s", entry.sarif);
+
+    if (!options->no_output)
+    {
+        FILE* _Owner _Opt outfile = fopen(out_file_name, "w");
+        if (outfile)
+        {
+            if (entry.output)
+                fprintf(outfile, "%s", entry.output);
+            fclose(outfile);
+        }
+        else
+        {
+            report->error_count++;
+            console_printf("cannot open output file '%s' - %s\n", out_file_name, get_posix_error_message(errno));
+        }
+    }
+
+    cache_entry_destroy(&entry);
+    return true;
+}
+
+static void compile_cache_begin(struct compile_cache* cache, FILE* _Opt sarif_file, const struct report* report)
+{
+    cache->error_count = report->error_count;
+    cache->warnings_count = report->warnings_count;
+    cache->info_count = report->info_count;
+    cache->sarif_begin = sarif_file ? ftell(sarif_file) : 0;
+    cache->previous_capture = console_set_capture(&cache->messages);
+    cache->capturing = true;
+}
+
+/*
+  Prints the captured messages. When parse was completed (sarif results
+  and output ready) the result is saved.
+*/
+static void compile_cache_end(struct compile_cache* cache,
+    const struct options* options,
+    bool completed,
+    const char* _Opt sarif_file_name,
+    const char* _Opt output,
+    const struct report* report)
+{
+    if (!cache->capturing)
+        return;
+
+    console_set_capture(cache->previous_capture);
+    cache->capturing = false;
+
+    if (cache->messages.c_str)
+        console_printf("%s", cache->messages.c_str);
+
+    if (completed)
+    {
+        struct cache_entry entry = { 0 };
+        entry.error_count = report->error_count - cache->error_count;
+        entry.warnings_count = report->warnings_count - cache->warnings_count;
+        entry.info_count = report->info_count - cache->info_count;
+        entry.messages = cache->messages.c_str; /*MOVED*/
+        cache->messages.c_str = NULL;
+        entry.output = output ? strdup(output) : NULL;
+
+        if (sarif_file_name)
+        {
+            char* _Owner _Opt content = read_file(sarif_file_name, false);
+            if (content &&
+                cache->sarif_end >= cache->sarif_begin &&
+                cache->sarif_end <= (long)strlen(content))
+            {
+                content[cache->sarif_end] = '\0';
+                entry.sarif = strdup(content + cache->sarif_begin);
+            }
+            free(content);
+        }
+
+        cache_store(options->cache_dir, cache->key, &entry);
+        cache_entry_destroy(&entry);
+    }
+
+    ss_close(&cache->messages);
+}
+
 int compile_one_file(const char* file_name,
     struct options* options,
     const char* out_file_name,
@@ -318,22 +510,38 @@ int compile_one_file(const char* file_name,
     bool color_enabled = !options->color_disabled;
 
     print_path(file_name, true);
-    printf("\n");
+    console_printf("\n");
+
+    struct ast ast = { 0 };
+
+    /*all tokens and expressions of this file are released at once*/
+    struct arena* _Opt p_previous_arena =
+        options->no_arena ? arena_get_current() : arena_set_current(&ast.arena);
+
+    struct time_report* _Opt p_time_report = report->p_time_report;
+    long long counters_begin[TIME_COUNTER_COUNT] = { 0 };
+    time_counters_get(counters_begin);
+    struct time_stamp start = time_report_start(p_time_report);
+    const double file_begin = p_time_report ? time_report_wall_now() : 0;
 
     struct preprocessor_ctx prectx = { 0 };
     prectx.options = *options;
     prectx.macros.capacity = 5000;
 
+    if (p_time_report && (p_time_report->profile || p_time_report->trace))
+        prectx.p_time_report = p_time_report;
+
     add_standard_macros(&prectx, options->target);
 
+    /*-MD the first prerequisite is the source file*/
+    preprocessor_add_dependency(&prectx, file_name);
+
     if (include_config_header(&prectx, file_name) != 0)
     {
         //cakeconfig.h is optional               
     }
     // print_all_macros(&prectx);
 
-    struct ast ast = { 0 };
-
     const char* _Owner _Opt p_output_string = NULL;
 
     _Opt struct parser_ctx ctx = { 0 };
@@ -344,7 +552,16 @@ int compile_one_file(const char* file_name,
     tctx.options = *options;
     ctx.options = *options;
     ctx.p_report = report;
-    char* _Owner _Opt content = NULL;
+    struct file_view content = { 0 };
+
+    struct compile_cache cache = { 0 };
+    cache.enabled = options->cache_dir[0] != '\0' && !options->test_mode && !options->test_mode_inout;
+    bool completed = false;
+
+    /*-emit-pch and -include-pch*/
+    struct osstream pch_options = { 0 };
+    struct precompiled_header_state pch_state = { 0 };
+    char sarif_file_name[260] = { 0 };
 
     try
     {
@@ -356,18 +573,29 @@ int compile_one_file(const char* file_name,
 
         prectx.options = *options;
 
+        if (options->include_pch[0] != '\0' || options->emit_pch[0] != '\0')
+            preprocessor_options_string(argc, argv, &pch_options);
 
-        content = read_file(file_name, true /*append new line*/);
-        if (content == NULL)
+        if (options->include_pch[0] != '\0' &&
+            precompiled_header_load(&prectx, pch_options.c_str ? pch_options.c_str : "", options->include_pch) != 0)
         {
             report->error_count++;
-            printf("file not found '%s'\n", file_name);
             throw;
         }
 
+        time_report_stop(p_time_report, TIME_PHASE_PREPROCESSOR, start);
+
+        start = time_report_start(p_time_report);
+        if (file_view_open(&content, file_name) != 0 || content.text == NULL)
+        {
+            report->error_count++;
+            console_printf("file not found '%s'\n", file_name);
+            throw;
+        }
+        time_report_stop(p_time_report, TIME_PHASE_READ, start);
+
         if (options->sarif_output)
         {
-            char sarif_file_name[260] = { 0 };
             if (options->sarifpath[0] != '\0')
             {
                 mkdir(options->sarifpath, 0777);
@@ -395,12 +623,14 @@ int compile_one_file(const char* file_name,
             else
             {
                 report->error_count++;
-                printf("cannot open Sarif output file '%s'\n", sarif_file_name);
+                console_printf("cannot open Sarif output file '%s'\n", sarif_file_name);
                 throw;
             }
         }
 
-        tokens = tokenizer(&tctx, content, file_name, 0, TK_FLAG_NONE);
+        start = time_report_start(p_time_report);
+        tokens = tokenizer(&tctx, content.text, file_name, 0, TK_FLAG_NONE);
+        time_report_stop(p_time_report, TIME_PHASE_TOKENIZER, start);
 
         if (tctx.n_errors > 0)
             throw;
@@ -410,7 +640,61 @@ int compile_one_file(const char* file_name,
             print_tokens(color_enabled, tokens.head);
         }
 
-        ast.token_list = preprocessor(&prectx, &tokens, 0);
+        start = time_report_start(p_time_report);
+
+        if (options->preprocess_only && options->emit_pch[0] == '\0')
+        {
+            /*
+              -E writes the output file while preprocessing. When -o is not
+              used the text is also printed at the end. Nothing is printed
+              and the output file is removed if there are errors.
+            */
+            struct preprocessed_output output = { 0 };
+            output.console = options->output[0] == '\0';
+            output.line_markers = options->line_markers;
+
+            if (out_file_name[0] != '\0')
+            {
+                output.file = (FILE * _Owner _Opt) fopen(out_file_name, "w");
+                if (output.file == NULL)
+                {
+                    report->error_count++;
+                    console_printf("cannot open output file '%s' - %s\n", out_file_name, get_posix_error_message(errno));
+                    throw;
+                }
+                setvbuf(output.file, NULL, _IOFBF, 1 << 16);
+            }
+
+            ast.token_list = preprocessor_stream(&prectx, &tokens, &output);
+
+            if (output.file)
+            {
+                fclose(output.file);
+                /*no partial output on errors*/
+                if (prectx.n_errors > 0)
+                    remove(out_file_name);
+            }
+
+            if (prectx.n_errors == 0)
+                preprocessed_output_print_console(&output);
+
+            preprocessed_output_destroy(&output);
+
+            if (ctx.options.test_mode_inout && out_file_name[0] != '\0')
+            {
+                /*the comparison uses what was written*/
+                p_output_string = read_file(out_file_name, false);
+            }
+        }
+        else
+        {
+            if (options->emit_pch[0] != '\0')
+                precompiled_header_state_get(&prectx, &pch_state);
+
+            ast.token_list = preprocessor(&prectx, &tokens, 0);
+        }
+
+        time_report_stop(p_time_report, TIME_PHASE_PREPROCESSOR, start);
 
         report->warnings_count += prectx.n_warnings;
         report->error_count += prectx.n_errors;
@@ -420,37 +704,50 @@ int compile_one_file(const char* file_name,
             throw;
         }
 
+        if (options->dependency_file &&
+            write_dependency_file(&prectx, options, file_name, out_file_name) != 0)
+        {
+            report->error_count++;
+            throw;
+        }
+
         if (options->dump_pptokens)
         {
             if (ast.token_list.head != NULL)
                 print_tokens(color_enabled, ast.token_list.head);
         }
 
-        if (options->preprocess_only)
+        if (options->emit_pch[0] != '\0')
         {
-            p_output_string = print_preprocessed_to_string2(ast.token_list.head);
-            if (p_output_string)
-                printf("%s", p_output_string);
-
-            FILE* _Owner _Opt outfile = fopen(out_file_name, "w");
-            if (outfile)
-            {
-                if (p_output_string)
-                    fprintf(outfile, "%s", p_output_string);
-
-                fclose(outfile);
-            }
-            else
+            if (precompiled_header_save(&prectx,
+                    &pch_state,
+                    pch_options.c_str ? pch_options.c_str : "",
+                    file_name,
+                    &ast.token_list,
+                    options->emit_pch) != 0)
             {
                 report->error_count++;
-                printf("cannot open output file '%s' - %s\n", out_file_name, get_posix_error_message(errno));
                 throw;
             }
         }
+        else if (options->preprocess_only)
+        {
+            /*already written by preprocessor_stream*/
+        }
+        else if (cache.enabled &&
+                 compile_cache_replay(&cache, options, file_name, &ast.token_list, out_file_name, ctx.sarif_file, report))
+        {
+            /*same result of the last time*/
+        }
         else
         {
+            if (cache.enabled)
+                compile_cache_begin(&cache, ctx.sarif_file, report);
+
             bool berror = false;
+            start = time_report_start(p_time_report);
             ast.declaration_list = parse(&ctx, &ast.token_list, &berror);
+            time_report_stop(p_time_report, TIME_PHASE_PARSE, start);
             if (berror || report->error_count > 0)
                 throw;
 
@@ -459,6 +756,7 @@ int compile_one_file(const char* file_name,
 
                 struct osstream ss = { 0 };
 
+                start = time_report_start(p_time_report);
                 if (options->asm_output)
                 {
                     struct asm_visit_ctx actx = { 0 };
@@ -477,7 +775,9 @@ int compile_one_file(const char* file_name,
                     p_output_string = ss.c_str; //MOVE
                     d_visit_ctx_destroy(&ctx2);
                 }
+                time_report_stop(p_time_report, TIME_PHASE_VISIT, start);
 
+                start = time_report_start(p_time_report);
                 FILE* _Owner _Opt outfile = fopen(out_file_name, "w");
                 if (outfile)
                 {
@@ -489,14 +789,18 @@ int compile_one_file(const char* file_name,
                 else
                 {
                     report->error_count++;
-                    printf("cannot open output file '%s' - %s\n", out_file_name, get_posix_error_message(errno));
+                    console_printf("cannot open output file '%s' - %s\n", out_file_name, get_posix_error_message(errno));
                     throw;
                 }
+                time_report_stop(p_time_report, TIME_PHASE_WRITE, start);
             }
+
+            completed = true;
         }
 
         if (ctx.sarif_file)
         {
+            cache.sarif_end = ftell(ctx.sarif_file);
 
 #define SARIF_FOOTER                                                             \
     "      ],\n"                                                        \
@@ -519,7 +823,26 @@ int compile_one_file(const char* file_name,
     }
     catch
     {
-        // printf("Error %s\n", error->message);
+        // console_printf("Error %s\n", error->message);
+    }
+
+    compile_cache_end(&cache,
+        options,
+        completed,
+        options->sarif_output ? sarif_file_name : NULL,
+        p_output_string,
+        report);
+
+    if (p_time_report)
+    {
+        long long counters_end[TIME_COUNTER_COUNT] = { 0 };
+        time_counters_get(counters_end);
+        for (int i = 0; i < TIME_COUNTER_COUNT; i++)
+            p_time_report->counters[i] += counters_end[i] - counters_begin[i];
+        p_time_report->arena_bytes += (long long)ast.arena.size;
+
+        if (p_time_report->trace)
+            time_report_span(p_time_report, TIME_SPAN_FILE, file_name, file_begin, token_list_size(&ast.token_list));
     }
 
     if (ctx.options.test_mode_inout)
@@ -550,32 +873,32 @@ int compile_one_file(const char* file_name,
 
             if (p_output_string && strcmp(content_expected + content_expected_first_line_len, p_output_string + s_first_line_len) != 0)
             {
-                printf("Output file '%s' is different from expected file '%s'\n", out_file_name, buf);
+                console_printf("Output file '%s' is different from expected file '%s'\n", out_file_name, buf);
                 report->error_count++;
             }
             free(content_expected);
         }
         else
         {
-            printf("Missing comparison file '%s' (-test-mode-in-out)\n", buf);
+            console_printf("Missing comparison file '%s' (-test-mode-in-out)\n", buf);
             report->test_failed++;
         }
 
         if (report->error_count > 0 || report->warnings_count > 0)
         {
 
-            printf("-------------------------------------------\n");
-            printf("%s", content);
-            printf("\n-------------------------------------------\n");
+            console_printf("-------------------------------------------\n");
+            console_printf("%s", content.text ? content.text : "");
+            console_printf("\n-------------------------------------------\n");
             if (color_enabled)
             {
-                printf(LIGHTRED "TEST FAILED" COLOR_RESET " : error=%d, warnings=%d\n", report->error_count, report->warnings_count);
+                console_printf(LIGHTRED "TEST FAILED" COLOR_RESET " : error=%d, warnings=%d\n", report->error_count, report->warnings_count);
             }
             else
             {
-                printf("TEST FAILED" " : error=%d, warnings=%d\n", report->error_count, report->warnings_count);
+                console_printf("TEST FAILED" " : error=%d, warnings=%d\n", report->error_count, report->warnings_count);
             }
-            printf("\n\n");
+            console_printf("\n\n");
             report->test_failed++;
         }
         else
@@ -588,19 +911,186 @@ int compile_one_file(const char* file_name,
 
     parser_ctx_destroy(&ctx);
     free((void* _Owner _Opt)p_output_string);
-    free(content);
-    ast_destroy(&ast);
+    file_view_close(&content);
     preprocessor_ctx_destroy(&prectx);
+    ss_close(&pch_options);
+
+    arena_set_current(p_previous_arena);
+    ast_destroy(&ast);
 
     return report->error_count > 0;
 }
 
-static int compile_many_files(const char* file_name,
-    struct options* options,
+/*
+  Each file given in the command line (or matched by *.c) is one job.
+  Jobs are compiled one by one, or in parallel with -j.
+*/
+struct compile_job
+{
+    char file_name[FS_MAX_PATH];
+    char out_file_name[FS_MAX_PATH];
+    struct report report;
+
+    /*messages of this file when they are captured (-j)*/
+    struct osstream output;
+
+    /*-ftime-report*/
+    struct time_report time_report;
+};
+
+struct compile_jobs
+{
+    struct compile_job* _Owner _Opt data;
+    int size;
+    int capacity;
+
+    struct options* options;
+    int argc;
+    const char** argv;
+    bool capture_output;
+};
+
+static void compile_jobs_destroy(_Dtor struct compile_jobs* p)
+{
+    for (int i = 0; i < p->size; i++)
+    {
+        assert(p->data != NULL);
+        ss_close(&p->data[i].output);
+        time_report_destroy(&p->data[i].time_report);
+    }
+    free(p->data);
+}
+
+static struct compile_job* _Opt compile_jobs_push(struct compile_jobs* p, const char* file_name, const char* out_file_name)
+{
+    if (p->size == p->capacity)
+    {
+        const int new_capacity = p->capacity == 0 ? 16 : p->capacity * 2;
+        void* _Owner _Opt pnew = realloc(p->data, new_capacity * sizeof(struct compile_job));
+        if (pnew == NULL)
+            return NULL;
+        static_set(p->data, "moved");
+        p->data = pnew;
+        p->capacity = new_capacity;
+    }
+    assert(p->data != NULL);
+
+    struct compile_job* p_job = &p->data[p->size];
+    memset(p_job, 0, sizeof * p_job);
+    snprintf(p_job->file_name, sizeof p_job->file_name, "%s", file_name);
+    snprintf(p_job->out_file_name, sizeof p_job->out_file_name, "%s", out_file_name);
+    p->size++;
+    return p_job;
+}
+
+static bool time_report_enabled(const struct options* options)
+{
+    return options->time_report ||
+        options->time_report_json[0] != '\0' ||
+        options->time_report_top > 0 ||
+        options->time_trace[0] != '\0';
+}
+
+static void compile_job_run(void* data, int index)
+{
+    struct compile_jobs* p_jobs = data;
+    assert(p_jobs->data != NULL);
+    struct compile_job* p_job = &p_jobs->data[index];
+
+    struct osstream* _Opt p_previous_capture =
+        console_set_capture(p_jobs->capture_output ? &p_job->output : NULL);
+
+    if (time_report_enabled(p_jobs->options))
+    {
+        p_job->time_report.file_name = p_job->file_name;
+        p_job->time_report.profile = p_jobs->options->time_report_top > 0;
+        p_job->time_report.trace = p_jobs->options->time_trace[0] != '\0';
+        p_job->time_report.trace_thread_id = index + 1;
+        p_job->report.p_time_report = &p_job->time_report;
+    }
+
+    compile_one_file(p_job->file_name,
+                     p_jobs->options,
+                     p_job->out_file_name,
+                     p_jobs->argc,
+                     p_jobs->argv,
+                     &p_job->report);
+
+    console_set_capture(p_previous_capture);
+}
+
+static void write_time_report_file(const char* file_name, const struct osstream* ss)
+{
+    FILE* _Owner _Opt file = fopen(file_name, "w");
+    if (file == NULL)
+    {
+        console_printf("cannot open file '%s' - %s\n", file_name, get_posix_error_message(errno));
+        return;
+    }
+    fwrite(ss->c_str ? ss->c_str : "", 1, ss->size, file);
+    fclose(file);
+}
+
+/*
+  -ftime-report, -ftime-report-json, -ftime-report-top and -ftime-trace
+*/
+static void print_time_report(const struct compile_jobs* jobs, const struct options* options)
+{
+    struct time_report total = { .file_name = "all files" };
+    struct osstream json = { 0 };
+    struct osstream trace = { 0 };
+    ss_fprintf(&json, "{\n  \"version\": \"%s\",\n  \"files\": [\n", CAKE_VERSION);
+    ss_fprintf(&trace, "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [\n");
+
+    bool first_trace_file = true;
+    for (int i = 0; i < jobs->size; i++)
+    {
+        assert(jobs->data != NULL);
+        const struct time_report* p = &jobs->data[i].time_report;
+        if (options->time_report)
+            time_report_print(p);
+        time_report_print_json(&json, p);
+        ss_fprintf(&json, i + 1 < jobs->size ? ",\n" : "\n");
+        time_report_sum(&total, p);
+
+        if (p->trace_events.c_str)
+        {
+            ss_fprintf(&trace, "%s%s", first_trace_file ? "" : ",\n", p->trace_events.c_str);
+            first_trace_file = false;
+        }
+    }
+
+    const long long peak_memory = peak_memory_bytes();
+
+    if (options->time_report)
+    {
+        if (jobs->size > 1)
+            time_report_print(&total);
+        console_printf("peak memory %lld KB\n", peak_memory / 1024);
+    }
+
+    if (options->time_report_top > 0)
+        time_report_print_top(&total, options->time_report_top);
+
+    ss_fprintf(&json, "  ],\n  \"total\":\n");
+    time_report_print_json(&json, &total);
+    ss_fprintf(&json, ",\n  \"peak_memory_bytes\": %lld\n}\n", peak_memory);
+    ss_fprintf(&trace, "\n  ]\n}\n");
+
+    if (options->time_report_json[0] != '\0')
+        write_time_report_file(options->time_report_json, &json);
+
+    if (options->time_trace[0] != '\0')
+        write_time_report_file(options->time_trace, &trace);
+
+    ss_close(&json);
+    ss_close(&trace);
+    time_report_destroy(&total);
+}
+
+static int add_many_files(const char* file_name,
     const char* out_file_name,
-    int argc,
-    const char** argv,
-    struct report* report)
+    struct compile_jobs* jobs)
 {
     const char* const file_name_name = basename(file_name);
     const char* _Opt const file_name_extension = strrchr2((char*)file_name_name, '.');
@@ -657,23 +1147,9 @@ static int compile_many_files(const char* file_name,
                 strcat(in_file_name_final, "/");
                 strcat(in_file_name_final, file_name_iter);
 
+                if (compile_jobs_push(jobs, in_file_name_final, out_file_name_final) == NULL)
+                    break;
 
-                struct report report_local = { 0 };
-                report_local.test_mode = report->test_mode;
-                compile_one_file(in_file_name_final,
-                                 options,
-                                 out_file_name_final,
-                                 argc,
-                                 argv,
-                                 &report_local);
-
-
-
-                report->error_count += report_local.error_count;
-                report->warnings_count += report_local.warnings_count;
-                report->info_count += report_local.info_count;
-                report->test_succeeded += report_local.test_succeeded;
-                report->test_failed += report_local.test_failed;
                 num_files++;
             }
         }
@@ -749,7 +1225,7 @@ static int create_multiple_paths(const char* root, const char* outdir)
             er = errno;
             if (er != EEXIST)
             {
-                printf("error creating output folder '%s' - %s\n", temp, get_posix_error_message(er));
+                console_printf("error creating output folder '%s' - %s\n", temp, get_posix_error_message(er));
                 return er;
             }
         }
@@ -774,26 +1250,26 @@ void print_report(struct report* report)
         report->info_count != 0)
     {
 
-        printf("\n");
-        printf("%d"   " errors ", report->error_count);
-        printf("%d"  " warnings ", report->warnings_count);
-        printf("%d"     " notes ", report->info_count);
-        printf("\n");
-        printf("%d files in %.2f seconds", report->no_files, report->cpu_time_used_sec);
+        console_printf("\n");
+        console_printf("%d"   " errors ", report->error_count);
+        console_printf("%d"  " warnings ", report->warnings_count);
+        console_printf("%d"     " notes ", report->info_count);
+        console_printf("\n");
+        console_printf("%d files in %.2f seconds", report->no_files, report->cpu_time_used_sec);
 
         if (report->test_mode)
         {
             if (report->error_count > 0 || report->warnings_count > 0)
-                printf(RED " - TEST FAILED" COLOR_RESET);
+                console_printf(RED " - TEST FAILED" COLOR_RESET);
             else
-                printf(GREEN " - TEST SUCCEEDED" COLOR_RESET);
+                console_printf(GREEN " - TEST SUCCEEDED" COLOR_RESET);
 
         }
-        printf("\n");
+        console_printf("\n");
 
     }
 
-    printf("\n");
+    console_printf("\n");
 }
 
 
@@ -807,7 +1283,7 @@ int compile(int argc, const char** argv, struct report* report)
 
     if (options.target != CAKE_COMPILE_TIME_SELECTED_TARGET)
     {
-        printf("emulating %s\n", get_platform(options.target)->name);
+        console_printf("emulating %s\n", get_platform(options.target)->name);
     }
 
     char executable_path[FS_MAX_PATH - sizeof(CAKE_CONFIG_FILE_NAME)] = { 0 };
@@ -824,7 +1300,11 @@ int compile(int argc, const char** argv, struct report* report)
 
     report->test_mode = options.test_mode;
 
-    clock_t begin_clock = clock();
+    /*
+      wall time; clock() would add the time of all threads (-j)
+    */
+    struct timespec begin_time = { 0 };
+    timespec_get(&begin_time, TIME_UTC);
     int no_files = 0;
 
     char root_dir[FS_MAX_PATH] = { 0 };
@@ -836,11 +1316,25 @@ int compile(int argc, const char** argv, struct report* report)
 
     const size_t root_dir_len = strlen(root_dir);
 
-    /*second loop to compile each file*/
+    struct compile_jobs jobs = { 0 };
+    jobs.options = &options;
+    jobs.argc = argc;
+    jobs.argv = argv;
+
+    /*second loop to collect each file*/
     for (int i = 1; i < argc; i++)
     {
         if (strcmp(argv[i], "-o") == 0 ||
-            strcmp(argv[i], "-sarif-path") == 0)
+            strcmp(argv[i], "-sarif-path") == 0 ||
+            strcmp(argv[i], "-cache-dir") == 0 ||
+            strcmp(argv[i], "-cache-size") == 0 ||
+            strcmp(argv[i], "-MF") == 0 ||
+            strcmp(argv[i], "-MT") == 0 ||
+            strcmp(argv[i], "-ftime-report-json") == 0 ||
+            strcmp(argv[i], "-ftime-report-top") == 0 ||
+            strcmp(argv[i], "-ftime-trace") == 0 ||
+            strcmp(argv[i], "-emit-pch") == 0 ||
+            strcmp(argv[i], "-include-pch") == 0)
         {
             //consumes next
             i++;
@@ -853,7 +1347,8 @@ int compile(int argc, const char** argv, struct report* report)
         no_files++;
         char output_file[FS_MAX_PATH] = { 0 };
 
-        if (!options.no_output)
+        /*-emit-pch writes only the precompiled header*/
+        if (!options.no_output && options.emit_pch[0] == '\0')
         {
             if (no_files == 1 && options.output[0] != '\0')
             {
@@ -879,6 +1374,7 @@ int compile(int argc, const char** argv, struct report* report)
                 dirname(outdir);
                 if (create_multiple_paths(root_dir, outdir) != 0)
                 {
+                    compile_jobs_destroy(&jobs);
                     return 1;
                 }
             }
@@ -892,24 +1388,58 @@ int compile(int argc, const char** argv, struct report* report)
         if (file_extension[0] == '*')
         {
             no_files--; //does not count *.c 
-            no_files += compile_many_files(fullpath, &options, output_file, argc, argv, report);
+            no_files += add_many_files(fullpath, output_file, &jobs);
         }
         else
         {
-            struct report report_local = { 0 };
-            compile_one_file(fullpath, &options, output_file, argc, argv, &report_local);
+            compile_jobs_push(&jobs, fullpath, output_file);
+        }
+    }
 
+    /*
+      With -j the messages of each file are captured and printed
+      after all files are compiled, in the same order of the files.
+    */
+    jobs.capture_output = options.jobs > 1 && jobs.size > 1;
+    run_parallel(jobs.size, options.jobs, compile_job_run, &jobs);
 
-            report->error_count += report_local.error_count;
-            report->warnings_count += report_local.warnings_count;
-            report->info_count += report_local.info_count;
-            report->test_succeeded += report_local.test_succeeded;
-            report->test_failed += report_local.test_failed;
+    for (int i = 0; i < jobs.size; i++)
+    {
+        assert(jobs.data != NULL);
+        const struct compile_job* p_job = &jobs.data[i];
+        if (p_job->output.c_str)
+        {
+            fwrite(p_job->output.c_str, 1, p_job->output.size, stdout);
         }
+
+        report->error_count += p_job->report.error_count;
+        report->warnings_count += p_job->report.warnings_count;
+        report->info_count += p_job->report.info_count;
+        report->test_succeeded += p_job->report.test_succeeded;
+        report->test_failed += p_job->report.test_failed;
     }
 
-    clock_t end_clock = clock();
-    double cpu_time_used = ((double)(end_clock - begin_clock)) / CLOCKS_PER_SEC;
+    if (time_report_enabled(&options))
+    {
+        print_time_report(&jobs, &options);
+    }
+
+    compile_jobs_destroy(&jobs);
+
+    if (options.cache_dir[0] != '\0' && !options.test_mode && !options.test_mode_inout)
+    {
+        /*-cache-size once per run, not after each file stored*/
+        cache_trim(options.cache_dir, (options.cache_size_mb > 0 ? options.cache_size_mb : 1024) * 1024LL * 1024LL);
+    }
+
+    /*tokens of the included files point to atoms*/
+    include_cache_clear();
+    atom_table_clear();
+
+    struct timespec end_time = { 0 };
+    timespec_get(&end_time, TIME_UTC);
+    double cpu_time_used = (double)(end_time.tv_sec - begin_time.tv_sec) +
+                           (double)(end_time.tv_nsec - begin_time.tv_nsec) / 1e9;
     report->no_files = no_files;
     report->cpu_time_used_sec = cpu_time_used;
 
@@ -971,6 +1501,7 @@ const char* _Owner _Opt compile_source(const char* pszoptions, const char* conte
     struct preprocessor_ctx prectx = { 0 };
     struct ast ast = { 0 };
     struct options options = { .input = STD_EXT };
+    struct arena* _Opt p_previous_arena = arena_get_current();
 
 
     try
@@ -1003,6 +1534,9 @@ const char* _Owner _Opt compile_source(const char* pszoptions, const char* conte
             if (report->error_count > 0)
                 throw;
 
+            if (!options.no_arena)
+                arena_set_current(&ast.arena); /*visits can change tokens*/
+
 
             struct osstream ss = { 0 };
 
@@ -1034,8 +1568,12 @@ const char* _Owner _Opt compile_source(const char* pszoptions, const char* conte
 
     preprocessor_ctx_destroy(&prectx);
 
+    arena_set_current(p_previous_arena);
     ast_destroy(&ast);
 
+    include_cache_clear();
+    atom_table_clear();
+
     return s;
 }
 
@@ -1044,9 +1582,9 @@ char* _Owner _Opt CompileText(const char* pszoptions, const char* content)
     /*
       This function is called by the web playground
     */
-    printf(WHITE "cake %s main.c\n", pszoptions);
+    console_printf(WHITE "cake %s main.c\n", pszoptions);
 
-    printf(WHITE "Cake " CAKE_VERSION COLOR_RESET "\n");
+    console_printf(WHITE "Cake " CAKE_VERSION COLOR_RESET "\n");
 
     struct report report = { 0 };
     char* _Owner _Opt s = (char* _Owner _Opt)compile_source(pszoptions, content, &report);
@@ -1056,3 +1594,472 @@ char* _Owner _Opt CompileText(const char* pszoptions, const char* content)
 }
 
 
+
+#ifdef TEST
+#include "unit_test.h"
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+/*
+  The files of a test are created inside a new directory under the
+  temporary directory and they are removed by test_dir_remove.
+*/
+struct test_dir
+{
+    char path[FS_MAX_PATH];
+    char files[24][FS_MAX_PATH];
+    int files_count;
+};
+
+static int test_dir_create(struct test_dir* p, const char* prefix)
+{
+    p->files_count = 0;
+#ifdef _WIN32
+    char temp[FS_MAX_PATH] = { 0 };
+    GetTempPathA(sizeof temp, temp);
+    for (int i = 0; i < 100; i++)
+    {
+        snprintf(p->path, sizeof p->path, "%s%s%lu_%d", temp, prefix, (unsigned long)GetCurrentProcessId(), i);
+        if (mkdir(p->path, 0777) == 0)
+            return 0;
+    }
+    return 1;
+#else
+    const char* _Opt temp = getenv("TMPDIR");
+    if (temp == NULL || temp[0] == '\0')
+        temp = "/tmp";
+    snprintf(p->path, sizeof p->path, "%s/%sXXXXXX", temp, prefix);
+    return mkdtemp(p->path) != NULL ? 0 : 1;
+#endif
+}
+
+/*full path of name inside the directory, it is removed with the directory*/
+static const char* test_dir_file(struct test_dir* p, const char* name)
+{
+    assert(p->files_count < (int)(sizeof p->files / sizeof p->files[0]));
+    char* path = p->files[p->files_count];
+    const int n = snprintf(path, sizeof p->files[0], "%s/%s", p->path, name);
+    assert(n > 0 && n < (int)sizeof p->files[0]);
+    (void)n;
+
+    for (int i = 0; i < p->files_count; i++)
+    {
+        if (strcmp(p->files[i], path) == 0)
+            return p->files[i];
+    }
+    p->files_count++;
+    return path;
+}
+
+static void test_dir_remove(struct test_dir* p)
+{
+    for (int i = p->files_count - 1; i >= 0; i--)
+        remove(p->files[i]);
+    p->files_count = 0;
+    rmdir(p->path);
+}
+
+static void write_test_file(const char* path, const char* text)
+{
+    FILE* _Owner _Opt file = fopen(path, "wb");
+    if (file)
+    {
+        fputs(text, file);
+        fclose(file);
+    }
+}
+
+/*the same escaping used by preprocessor_add_dependency*/
+static void make_escape(const char* path, char* out, int out_size)
+{
+    int n = 0;
+    for (const char* p = path; *p && n < out_size - 3; p++)
+    {
+        if (*p == ' ' || *p == '#')
+            out[n++] = '\\';
+        else if (*p == '$')
+            out[n++] = '$';
+        out[n++] = *p;
+    }
+    out[n] = '\0';
+}
+
+void dependency_file_test(void)
+{
+    /*space and $ in the directory name are escaped as well*/
+    struct test_dir dir = { 0 };
+    assert(test_dir_create(&dir, "cake depfile test$") == 0);
+
+    write_test_file(test_dir_file(&dir, "a b.h"), "int x;\n");
+    write_test_file(test_dir_file(&dir, "blob$.bin"), "xy");
+    write_test_file(test_dir_file(&dir, "main.c"),
+        "#include \"a b.h\"\n"
+        "char b[] = {\n"
+        "#embed \"blob$.bin\"\n"
+        "};\n");
+
+    const char* argv[] = {
+        "cake", "-no-output", "-MD", "-MF", test_dir_file(&dir, "main.d"), "-MT", "main.o", test_dir_file(&dir, "main.c")
+    };
+
+    struct report report = { 0 };
+    compile(sizeof argv / sizeof argv[0], argv, &report);
+    assert(report.error_count == 0);
+
+    char full_dir[FS_MAX_PATH] = { 0 };
+    realpath(dir.path, full_dir);
+    path_normalize(full_dir);
+
+    char escaped_dir[FS_MAX_PATH * 2] = { 0 };
+    make_escape(full_dir, escaped_dir, sizeof escaped_dir);
+
+    char* _Owner _Opt text = read_file(test_dir_file(&dir, "main.d"), false);
+    assert(text != NULL);
+    if (text)
+    {
+        char expected[FS_MAX_PATH * 3] = { 0 };
+
+        assert(strncmp(text, "main.o: \\\n", 10) == 0);
+
+        snprintf(expected, sizeof expected, " \\\n  %s/main.c", escaped_dir);
+        assert(strstr(text, expected) != NULL);
+
+        /*header and #embed resource are written in the same way*/
+        snprintf(expected, sizeof expected, " \\\n  %s/a\\ b.h", escaped_dir);
+        assert(strstr(text, expected) != NULL);
+
+        snprintf(expected, sizeof expected, " \\\n  %s/blob$$.bin\n", escaped_dir);
+        assert(strstr(text, expected) != NULL);
+
+        free(text);
+    }
+
+    /*
+      With -include-pch the files included by the header are not opened,
+      they and the .pch are prerequisites as well
+    */
+    write_test_file(test_dir_file(&dir, "inner.h"), "int inner;\n");
+    write_test_file(test_dir_file(&dir, "outer.h"), "#include \"inner.h\"\n");
+    write_test_file(test_dir_file(&dir, "m.c"), "#include \"outer.h\"\n");
+
+    const char* argv_emit[] = {
+        "cake", "-emit-pch", test_dir_file(&dir, "outer.h.pch"), test_dir_file(&dir, "outer.h")
+    };
+    report = (struct report){ 0 };
+    compile(sizeof argv_emit / sizeof argv_emit[0], argv_emit, &report);
+    assert(report.error_count == 0);
+
+    const char* argv_pch[] = {
+        "cake", "-no-output", "-include-pch", test_dir_file(&dir, "outer.h.pch"), "-MD", "-MF", test_dir_file(&dir, "m.d"), test_dir_file(&dir, "m.c")
+    };
+    report = (struct report){ 0 };
+    compile(sizeof argv_pch / sizeof argv_pch[0], argv_pch, &report);
+    assert(report.error_count == 0);
+
+    text = read_file(test_dir_file(&dir, "m.d"), false);
+    assert(text != NULL);
+    if (text)
+    {
+        char expected[FS_MAX_PATH * 3] = { 0 };
+
+        snprintf(expected, sizeof expected, " \\\n  %s/outer.h", escaped_dir);
+        assert(strstr(text, expected) != NULL);
+
+        snprintf(expected, sizeof expected, " \\\n  %s/inner.h", escaped_dir);
+        assert(strstr(text, expected) != NULL);
+
+        snprintf(expected, sizeof expected, " \\\n  %s/outer.h.pch", escaped_dir);
+        assert(strstr(text, expected) != NULL);
+
+        free(text);
+    }
+
+    test_dir_remove(&dir);
+}
+
+static int compile_test(int argc, const char** argv)
+{
+    struct report report = { 0 };
+    compile(argc, argv, &report);
+    return report.error_count;
+}
+
+void precompiled_header_test(void)
+{
+    struct test_dir dir = { 0 };
+    assert(test_dir_create(&dir, "cake pch test") == 0);
+
+    write_test_file(test_dir_file(&dir, "w.h"),
+        "#ifdef WIDE\n"
+        "#define W 64\n"
+        "#else\n"
+        "#define W 32\n"
+        "#endif\n"
+        "#undef GONE\n");
+    write_test_file(test_dir_file(&dir, "pch.h"), "#include \"w.h\"\n");
+    write_test_file(test_dir_file(&dir, "main.c"),
+        "#include \"pch.h\"\n"
+        "static_assert(W == 32);\n"
+        "#ifdef GONE\n"
+        "#error GONE is removed by w.h\n"
+        "#endif\n");
+    write_test_file(test_dir_file(&dir, "main2.c"),
+        "#define WIDE\n"
+        "#include \"pch.h\"\n"
+        "static_assert(W == 64);\n");
+
+    const char* pch = test_dir_file(&dir, "pch.pch");
+    const char* main_c = test_dir_file(&dir, "main.c");
+
+    const char* emit[] = { "cake", "-DGONE", "-emit-pch", pch, test_dir_file(&dir, "pch.h") };
+    assert(compile_test(sizeof emit / sizeof emit[0], emit) == 0);
+
+    /*same state, the #undef inside the header is applied*/
+    const char* use[] = { "cake", "-DGONE", "-no-output", "-include-pch", pch, main_c };
+    assert(compile_test(sizeof use / sizeof use[0], use) == 0);
+
+    /*other -D*/
+    const char* wide[] = { "cake", "-DGONE", "-DWIDE", "-no-output", "-include-pch", pch, main_c };
+    assert(compile_test(sizeof wide / sizeof wide[0], wide) != 0);
+
+    /*WIDE defined before the #include*/
+    const char* use2[] = { "cake", "-DGONE", "-no-output", "-include-pch", pch, test_dir_file(&dir, "main2.c") };
+    assert(compile_test(sizeof use2 / sizeof use2[0], use2) != 0);
+
+    /*truncated files are rejected before the counts are used*/
+    char buffer[1 << 16] = { 0 };
+    size_t size = 0;
+    FILE* _Owner _Opt file = fopen(pch, "rb");
+    assert(file != NULL);
+    if (file)
+    {
+        size = fread(buffer, 1, sizeof buffer, file);
+        fclose(file);
+    }
+    assert(size > 0 && size < sizeof buffer);
+
+    const char* bad_pch = test_dir_file(&dir, "bad.pch");
+    for (size_t length = 0; length < size; length += 1 + size / 100)
+    {
+        FILE* _Owner _Opt bad = fopen(bad_pch, "wb");
+        assert(bad != NULL);
+        if (bad)
+        {
+            fwrite(buffer, 1, length, bad);
+            fclose(bad);
+        }
+        struct preprocessor_ctx prectx = { 0 };
+        assert(precompiled_header_load(&prectx, "-DGONE\n", bad_pch) != 0);
+        preprocessor_ctx_destroy(&prectx);
+    }
+
+    /*w.h is included by the header and it was changed*/
+    const char* w_h = test_dir_file(&dir, "w.h");
+    struct stat st = { 0 };
+    stat(w_h, &st);
+    struct utimbuf times = { .actime = st.st_atime, .modtime = st.st_mtime + 10 };
+    utime(w_h, &times);
+    assert(compile_test(sizeof use / sizeof use[0], use) != 0);
+
+    test_dir_remove(&dir);
+}
+
+void preprocessed_output_test(void)
+{
+    struct test_dir dir = { 0 };
+    assert(test_dir_create(&dir, "cake pp test") == 0);
+
+    write_test_file(test_dir_file(&dir, "a.h"), "int a;\n");
+    write_test_file(test_dir_file(&dir, "main.c"),
+        "int m;\n"
+        "#include \"a.h\"\n"
+        "int z;\n"
+        "#if 0\n"
+        "#endif\n"
+        "int w;\n");
+
+    const char* argv[] = { "cake", "-E", "-line-markers", "-o", test_dir_file(&dir, "main.i"), test_dir_file(&dir, "main.c") };
+    assert(compile_test(sizeof argv / sizeof argv[0], argv) == 0);
+
+    char full_dir[FS_MAX_PATH] = { 0 };
+    realpath(dir.path, full_dir);
+    path_normalize(full_dir);
+
+    char* _Owner _Opt text = read_file(test_dir_file(&dir, "main.i"), false);
+    assert(text != NULL);
+    if (text)
+    {
+        char expected[FS_MAX_PATH * 2] = { 0 };
+
+        snprintf(expected, sizeof expected, "#line 1 \"%s/a.h\"\nint a;\n", full_dir);
+        assert(strstr(text, expected) != NULL);
+
+        /*back to main.c after the #include*/
+        snprintf(expected, sizeof expected, "#line 3 \"%s/main.c\"\nint z;\n", full_dir);
+        const char* p = strstr(text, expected);
+        assert(p != NULL);
+
+        /*int w; is at line 6*/
+        if (p)
+        {
+            p = strstr(p, "int z;");
+            int line = 3;
+            while (p && *p && strncmp(p, "int w;", 6) != 0)
+            {
+                if (*p == '\n')
+                    line++;
+                p++;
+            }
+            assert(p && *p);
+            assert(line == 6);
+        }
+        free(text);
+    }
+
+    /*no partial output file when there are errors*/
+    write_test_file(test_dir_file(&dir, "bad.c"),
+        "#include \"a.h\"\n"
+        "#error stop\n"
+        "int q;\n");
+    const char* argv_bad[] = { "cake", "-E", "-o", test_dir_file(&dir, "bad.i"), test_dir_file(&dir, "bad.c") };
+    assert(compile_test(sizeof argv_bad / sizeof argv_bad[0], argv_bad) != 0);
+
+    FILE* _Owner _Opt file = fopen(test_dir_file(&dir, "bad.i"), "r");
+    assert(file == NULL);
+    if (file)
+        fclose(file);
+
+    test_dir_remove(&dir);
+}
+
+/*
+  Number of -cache-dir files in the test directory. They are removed
+  with the directory; *pp_path is one of them.
+*/
+static int cache_files_count(struct test_dir* p, const char* _Opt* _Opt pp_path)
+{
+    int count = 0;
+    DIR* _Owner _Opt dir = opendir(p->path);
+    if (dir == NULL)
+        return 0;
+
+    struct dirent* _Opt dp;
+    while ((dp = readdir(dir)) != NULL)
+    {
+        const char* _Opt extension = strrchr(dp->d_name, '.');
+        if (extension && strcmp(extension, ".cakecache") == 0)
+        {
+            const char* path = test_dir_file(p, dp->d_name);
+            if (pp_path)
+                *pp_path = path;
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+static bool file_contains(const char* path, const char* text)
+{
+    char* _Owner _Opt content = read_file(path, false);
+    const bool found = content && strstr(content, text) != NULL;
+    free(content);
+    return found;
+}
+
+void cache_test(void)
+{
+    struct test_dir dir = { 0 };
+    assert(test_dir_create(&dir, "cake cache test") == 0);
+
+    const char* h = test_dir_file(&dir, "h.h");
+    const char* main_c = test_dir_file(&dir, "main.c");
+    const char* sarif = test_dir_file(&dir, "main.c.cake.sarif");
+    const char* out1 = test_dir_file(&dir, "out1.c");
+    const char* out2 = test_dir_file(&dir, "out2.c");
+
+    write_test_file(h, "#define H 1\n");
+    write_test_file(main_c,
+        "#include \"h.h\"\n"
+        "int h = H;\n"
+        "void f(void)\n"
+        "{\n"
+        "    int cached_a;\n"
+        "    int y = cached_a;\n"
+        "}\n");
+
+    struct osstream messages = { 0 };
+    struct osstream* _Opt previous = console_set_capture(&messages);
+    const char* argv[] = { "cake", "-fdiagnostics-color=never", "-fanalyzer", "-sarif", "-cache-dir", dir.path, "-o", out1, main_c };
+    struct report report = { 0 };
+    compile(sizeof argv / sizeof argv[0], argv, &report);
+    console_set_capture(previous);
+
+    assert(report.error_count == 0 && report.warnings_count == 1);
+    assert(messages.c_str && strstr(messages.c_str, "uninitialized object 'cached_a'") != NULL);
+    ss_close(&messages);
+    assert(file_contains(sarif, "cached_a"));
+
+    const char* _Opt cache_file = NULL;
+    assert(cache_files_count(&dir, &cache_file) == 1);
+    assert(cache_file != NULL);
+
+    /*
+      The saved result is changed, so we can see when it is used
+      instead of compiling the file again.
+    */
+    char* _Owner _Opt content = cache_file ? read_file(cache_file, false) : NULL;
+    assert(content != NULL);
+    if (content && cache_file)
+    {
+        for (char* p = strstr(content, "cached_a"); p; p = strstr(p, "cached_a"))
+            p[7] = 'b';
+        write_test_file(cache_file, content);
+        free(content);
+    }
+
+    /*messages, sarif and output are replayed. -o is not part of the key*/
+    const char* argv_o[] = { "cake", "-fdiagnostics-color=never", "-fanalyzer", "-sarif", "-cache-dir", dir.path, "-o", out2, main_c };
+    messages = (struct osstream){ 0 };
+    previous = console_set_capture(&messages);
+    report = (struct report){ 0 };
+    compile(sizeof argv_o / sizeof argv_o[0], argv_o, &report);
+    console_set_capture(previous);
+
+    assert(report.error_count == 0 && report.warnings_count == 1);
+    assert(messages.c_str && strstr(messages.c_str, "uninitialized object 'cached_b'") != NULL);
+    ss_close(&messages);
+    assert(file_contains(sarif, "cached_b"));
+    assert(file_contains(out2, "cached_b"));
+
+    /*-j and -cache-size are not part of the key*/
+    const char* argv_j[] = { "cake", "-fdiagnostics-color=never", "-fanalyzer", "-sarif", "-j2", "-cache-size", "100", "-cache-dir", dir.path, "-o", out1, main_c };
+    assert(compile_test(sizeof argv_j / sizeof argv_j[0], argv_j) == 0);
+    assert(file_contains(out1, "cached_b"));
+    assert(cache_files_count(&dir, NULL) == 1);
+
+    /*hashed options*/
+    const char* argv_style[] = { "cake", "-fdiagnostics-color=never", "-fanalyzer", "-sarif", "-w11", "-cache-dir", dir.path, "-o", out1, main_c };
+    assert(compile_test(sizeof argv_style / sizeof argv_style[0], argv_style) == 0);
+    assert(file_contains(out1, "cached_a"));
+    assert(cache_files_count(&dir, NULL) == 2);
+
+    const char* argv_target[] = { "cake", "-fdiagnostics-color=never", "-fanalyzer", "-sarif", "-target=x86_msvc", "-cache-dir", dir.path, "-o", out1, main_c };
+    assert(compile_test(sizeof argv_target / sizeof argv_target[0], argv_target) == 0);
+    assert(file_contains(out1, "cached_a"));
+    assert(cache_files_count(&dir, NULL) == 3);
+
+    /*included file changed*/
+    write_test_file(h, "#define H 2\n");
+    assert(compile_test(sizeof argv_o / sizeof argv_o[0], argv_o) == 0);
+    assert(file_contains(out2, "cached_a"));
+    assert(cache_files_count(&dir, NULL) == 4);
+
+    test_dir_remove(&dir);
+}
+
+#endif
@@ -19,7 +19,10 @@
 #endif
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include "console.h"
+#include "osstream.h"
+#include "thread.h"
 
 #ifndef WIN32
 
@@ -120,4 +123,26 @@ void c_gotoxy(int x, int y)
 {
     printf("\x1b[%d;%dH", y, x);
     fflush(stdout);
-}
\ No newline at end of file
+}
+static THREAD_LOCAL struct osstream* _Opt s_capture = NULL;
+
+struct osstream* _Opt console_set_capture(struct osstream* _Opt stream)
+{
+    struct osstream* _Opt previous = s_capture;
+    s_capture = stream;
+    return previous;
+}
+
+int console_printf(const char* fmt, ...)
+{
+    va_list args = { 0 };
+    va_start(args, fmt);
+    const int n = s_capture ? ss_vafprintf(s_capture, fmt, args) : vprintf(fmt, args);
+    va_end(args);
+    return n;
+}
+
+int console_putc(char ch)
+{
+    return s_capture ? ss_putc(ch, s_capture) : putc(ch, stdout);
+}
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include "ownership.h"
 
 bool enable_vt_mode(void);
 
@@ -55,4 +56,15 @@ bool enable_vt_mode(void);
 int c_kbhit(void);
 int c_getch(void);
 void c_clrscr();
-void c_gotoxy(int x, int y);
\ No newline at end of file
+void c_gotoxy(int x, int y);
+/*
+  Compiler messages are written using console_printf/console_putc.
+  They go to stdout unless the current thread is capturing them.
+  Files compiled in parallel (-j) capture their messages, which are
+  printed later in the order of the files.
+  Returns the previous capture stream.
+*/
+struct osstream;
+struct osstream* _Opt console_set_capture(struct osstream* _Opt stream);
+int console_printf(const char* fmt, ...);
+int console_putc(char ch);
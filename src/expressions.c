@@ -15,6 +15,9 @@
 #include <string.h>
 #include "parser.h"
 #include "type.h"
+#include "arena.h"
+#include "thread.h"
+#include "time_report.h"
 #include <math.h>
 #include <float.h>
 
@@ -29,7 +32,7 @@
 
 
 //TODO i am doing this to same stack on expressoins TODO
-static char warning_message[200] = { 0 };
+static THREAD_LOCAL char warning_message[200] = { 0 };
 
 struct expression* _Owner _Opt postfix_expression(struct parser_ctx* ctx, enum expression_eval_mode eval_mode);
 struct expression* _Owner _Opt cast_expression(struct parser_ctx* ctx, enum expression_eval_mode eval_mode);
@@ -232,7 +235,8 @@ bool is_first_of_primary_expression(const struct parser_ctx* ctx)
         is_first_of_constant(ctx) ||
         ctx->current->type == TK_STRING_LITERAL ||
         ctx->current->type == '(' ||
-        ctx->current->type == TK_KEYWORD__GENERIC;
+        ctx->current->type == TK_KEYWORD__GENERIC ||
+        ctx->current->type == TK_EMBED;
 }
 
 struct generic_association* _Owner _Opt generic_association(struct parser_ctx* ctx, enum expression_eval_mode eval_mode)
@@ -575,7 +579,7 @@ struct expression* _Owner _Opt character_constant_expression(struct parser_ctx*
             throw;
         }
 
-        p_expression_node = calloc(1, sizeof * p_expression_node);
+        p_expression_node = expression_new();
         if (p_expression_node == NULL)
             throw;
 
@@ -1225,9 +1229,16 @@ struct expression* _Owner _Opt primary_expression(struct parser_ctx* ctx, enum e
     struct expression* _Owner _Opt p_expression_node = NULL;
     try
     {
+        if (ctx->current->type == TK_EMBED)
+        {
+            /*#embed "file" here is the list of numbers n0, n1, ...*/
+            if (parser_expand_embed(ctx) != 0 || ctx->current == NULL)
+                throw;
+        }
+
         if (ctx->current->type == TK_IDENTIFIER)
         {
-            p_expression_node = calloc(1, sizeof * p_expression_node);
+            p_expression_node = expression_new();
 
             if (p_expression_node == NULL)
                 throw;
@@ -1356,7 +1367,7 @@ struct expression* _Owner _Opt primary_expression(struct parser_ctx* ctx, enum e
         }
         else if (ctx->current->type == TK_STRING_LITERAL)
         {
-            p_expression_node = calloc(1, sizeof * p_expression_node);
+            p_expression_node = expression_new();
             if (p_expression_node == NULL)
                 throw;
 
@@ -1543,7 +1554,7 @@ struct expression* _Owner _Opt primary_expression(struct parser_ctx* ctx, enum e
         else if (ctx->current->type == TK_KEYWORD_TRUE ||
                  ctx->current->type == TK_KEYWORD_FALSE)
         {
-            p_expression_node = calloc(1, sizeof * p_expression_node);
+            p_expression_node = expression_new();
             if (p_expression_node == NULL)
                 throw;
 
@@ -1565,7 +1576,7 @@ struct expression* _Owner _Opt primary_expression(struct parser_ctx* ctx, enum e
         }
         else if (ctx->current->type == TK_KEYWORD_NULLPTR)
         {
-            p_expression_node = calloc(1, sizeof * p_expression_node);
+            p_expression_node = expression_new();
             if (p_expression_node == NULL)
                 throw;
 
@@ -1588,7 +1599,7 @@ struct expression* _Owner _Opt primary_expression(struct parser_ctx* ctx, enum e
         }
         else if (is_integer_or_floating_constant(ctx->current->type))
         {
-            p_expression_node = calloc(1, sizeof * p_expression_node);
+            p_expression_node = expression_new();
             if (p_expression_node == NULL)
                 throw;
 
@@ -1607,7 +1618,7 @@ struct expression* _Owner _Opt primary_expression(struct parser_ctx* ctx, enum e
         }
         else if (ctx->current->type == TK_KEYWORD__GENERIC)
         {
-            p_expression_node = calloc(1, sizeof * p_expression_node);
+            p_expression_node = expression_new();
             if (p_expression_node == NULL)
                 throw;
             p_expression_node->first_token = ctx->current;
@@ -1633,7 +1644,7 @@ struct expression* _Owner _Opt primary_expression(struct parser_ctx* ctx, enum e
         }
         else if (ctx->current->type == '(')
         {
-            p_expression_node = calloc(1, sizeof * p_expression_node);
+            p_expression_node = expression_new();
             if (p_expression_node == NULL) throw;
 
             p_expression_node->expression_type = PRIMARY_EXPRESSION_PARENTHESIS;
@@ -1908,7 +1919,7 @@ struct expression* _Owner _Opt postfix_expression_tail(struct parser_ctx* ctx, s
         {
             if (ctx->current->type == '[')
             {
-                struct expression* _Owner _Opt p_expression_node_new = calloc(1, sizeof * p_expression_node_new);
+                struct expression* _Owner _Opt p_expression_node_new = expression_new();
                 if (p_expression_node_new == NULL) throw;
                 p_expression_node->last_token = ctx->current;
                 p_expression_node_new->first_token = ctx->current;
@@ -1977,10 +1988,19 @@ struct expression* _Owner _Opt postfix_expression_tail(struct parser_ctx* ctx, s
                             }
 
 
-                            struct object* _Opt it = object_get_member(&p_expression_node->object, (int)index);
+                            /*elements inside runs are not created just to read the value*/
+                            struct object value = { 0 };
+                            if (object_get_element_value(&p_expression_node->object, (size_t)index, &value) == 0)
+                            {
+                                p_expression_node_new->object = value;
+                            }
+                            else
+                            {
+                                struct object* _Opt it = object_get_member(&p_expression_node->object, (int)index);
 
-                            if (it != NULL)
-                                p_expression_node_new->object = object_make_reference(it);
+                                if (it != NULL)
+                                    p_expression_node_new->object = object_make_reference(it);
+                            }
                         }
                     }
                 }
@@ -1996,7 +2016,7 @@ struct expression* _Owner _Opt postfix_expression_tail(struct parser_ctx* ctx, s
             }
             else if (ctx->current->type == '(')
             {
-                struct expression* _Owner _Opt p_expression_node_new = calloc(1, sizeof * p_expression_node_new);
+                struct expression* _Owner _Opt p_expression_node_new = expression_new();
                 if (p_expression_node_new == NULL) throw;
                 p_expression_node->last_token = ctx->current;
                 p_expression_node_new->first_token = p_expression_node->first_token;
@@ -2051,7 +2071,7 @@ struct expression* _Owner _Opt postfix_expression_tail(struct parser_ctx* ctx, s
             }
             else if (ctx->current->type == '.')
             {
-                struct expression* _Owner _Opt p_expression_node_new = calloc(1, sizeof * p_expression_node_new);
+                struct expression* _Owner _Opt p_expression_node_new = expression_new();
                 if (p_expression_node_new == NULL) throw;
                 p_expression_node->last_token = ctx->current;
                 p_expression_node_new->first_token = ctx->current;
@@ -2089,7 +2109,7 @@ struct expression* _Owner _Opt postfix_expression_tail(struct parser_ctx* ctx, s
 
                         int member_index = 0;
                         struct member_declarator* _Opt p_member_declarator =
-                            find_member_declarator(&p_complete->member_declaration_list, ctx->current->lexeme, &member_index);
+                            find_member_declarator(p_complete, ctx->current->lexeme, &member_index, ctx->options.target);
 
                         if (p_member_declarator)
                         {
@@ -2172,7 +2192,7 @@ struct expression* _Owner _Opt postfix_expression_tail(struct parser_ctx* ctx, s
                   p_expression_node      NULL
                 */
 
-                struct expression* _Owner _Opt p_expression_node_new = calloc(1, sizeof * p_expression_node_new);
+                struct expression* _Owner _Opt p_expression_node_new = expression_new();
                 if (p_expression_node_new == NULL) throw;
 
                 p_expression_node->last_token = ctx->current;
@@ -2215,7 +2235,7 @@ struct expression* _Owner _Opt postfix_expression_tail(struct parser_ctx* ctx, s
                         {
                             int member_index = 0;
                             struct member_declarator* _Opt p_member_declarator =
-                                find_member_declarator(&p_complete->member_declaration_list, ctx->current->lexeme, &member_index);
+                                find_member_declarator(p_complete, ctx->current->lexeme, &member_index, ctx->options.target);
 
                             if (p_member_declarator)
                             {
@@ -2298,7 +2318,7 @@ struct expression* _Owner _Opt postfix_expression_tail(struct parser_ctx* ctx, s
                 }
 
 
-                struct expression* _Owner _Opt p_expression_node_new = calloc(1, sizeof * p_expression_node_new);
+                struct expression* _Owner _Opt p_expression_node_new = expression_new();
                 if (p_expression_node_new == NULL) throw;
 
                 p_expression_node->last_token = ctx->current;
@@ -2338,7 +2358,7 @@ struct expression* _Owner _Opt postfix_expression_tail(struct parser_ctx* ctx, s
                                                 "lvalue required as decrement operand");
                 }
 
-                struct expression* _Owner _Opt p_expression_node_new = calloc(1, sizeof * p_expression_node_new);
+                struct expression* _Owner _Opt p_expression_node_new = expression_new();
                 if (p_expression_node_new == NULL) throw;
 
 
@@ -2391,7 +2411,7 @@ struct expression* _Owner _Opt postfix_expression_type_name(struct parser_ctx* c
 
     try
     {
-        p_expression_node = calloc(1, sizeof * p_expression_node);
+        p_expression_node = expression_new();
         if (p_expression_node == NULL)
             throw;
 
@@ -2520,7 +2540,7 @@ struct expression* _Owner _Opt postfix_expression(struct parser_ctx* ctx, enum e
         if (first_of_type_name_ahead(ctx)) /* need to check if this is not a primary expression */
         {
             assert(false); /* this case is handled inside cast_expression */
-            p_expression_node = calloc(1, sizeof * p_expression_node);
+            p_expression_node = expression_new();
             if (p_expression_node == NULL)
                 throw;
 
@@ -2725,7 +2745,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
 
         if (ctx->current->type == '++' || ctx->current->type == '--')
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
 
             new_expression->first_token = ctx->current;
@@ -2761,7 +2781,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
                  ctx->current->type == '!')
         {
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
 
             new_expression->first_token = ctx->current;
@@ -2994,7 +3014,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
         }
         else if (ctx->current->type == TK_KEYWORD_GCC__BUILTIN_C23_VA_START)
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
             new_expression->first_token = ctx->current;
             new_expression->expression_type = UNARY_EXPRESSION_GCC__BUILTIN_VA_START;
@@ -3047,7 +3067,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
         }
         else if (ctx->current->type == TK_KEYWORD_GCC__BUILTIN_VA_END)
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
             new_expression->first_token = ctx->current;
             new_expression->expression_type = UNARY_EXPRESSION_GCC__BUILTIN_VA_END;
@@ -3083,7 +3103,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
         }
         else if (ctx->current->type == TK_KEYWORD_GCC__BUILTIN_VA_ARG)
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
             new_expression->first_token = ctx->current;
             new_expression->expression_type = UNARY_EXPRESSION_GCC__BUILTIN_VA_ARG;
@@ -3133,7 +3153,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
         }
         else if (ctx->current->type == TK_KEYWORD_GCC__BUILTIN_VA_COPY)
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
             new_expression->first_token = ctx->current;
             new_expression->expression_type = UNARY_EXPRESSION_GCC__BUILTIN_VA_COPY;
@@ -3182,7 +3202,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
         }
         else if (ctx->current->type == TK_KEYWORD_GCC__BUILTIN_OFFSETOF)
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
             new_expression->first_token = ctx->current;
             new_expression->expression_type = UNARY_EXPRESSION_GCC__BUILTIN_OFFSETOF;
@@ -3277,7 +3297,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
                 throw;
             }
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
 
             new_expression->first_token = ctx->current;
@@ -3397,7 +3417,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
             /* a defer statement would be useful here */
 
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
 
             new_expression->first_token = ctx->current;
@@ -3564,7 +3584,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
 
         else if (ctx->current->type == TK_KEYWORD_ASSERT)
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
 
             new_expression->expression_type = UNARY_EXPRESSION_ASSERT;
@@ -3588,7 +3608,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
         }
         else if (ctx->current->type == TK_KEYWORD_CONST) /*new keyword consteval?? */
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
 
             new_expression->expression_type = UNARY_EXPRESSION_CONSTEVAL;
@@ -3621,7 +3641,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
                 throw;
             }
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
 
             new_expression->first_token = ctx->current;
@@ -3731,7 +3751,7 @@ struct expression* _Owner _Opt unary_expression(struct parser_ctx* ctx, enum exp
 
             struct token* traits_token = ctx->current;
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
 
             new_expression->first_token = ctx->current;
@@ -3885,7 +3905,7 @@ struct expression* _Owner _Opt cast_expression(struct parser_ctx* ctx, enum expr
 
         if (first_of_type_name_ahead(ctx))
         {
-            p_expression_node = calloc(1, sizeof * p_expression_node);
+            p_expression_node = expression_new();
             if (p_expression_node == NULL)
                 throw;
 
@@ -4116,7 +4136,7 @@ struct expression* _Owner _Opt multiplicative_expression(struct parser_ctx* ctx,
                    ctx->current->type == '/' ||
                    ctx->current->type == '%'))
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL)
             {
                 expression_delete(p_expression_node);
@@ -4311,7 +4331,7 @@ struct expression* _Owner _Opt additive_expression(struct parser_ctx* ctx, enum
         {
             struct token* operator_position = ctx->current;
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL)
             {
                 compiler_diagnostic(C_ERROR_OUT_OF_MEM, ctx, ctx->current, NULL, "out of mem");
@@ -4568,7 +4588,7 @@ struct expression* _Owner _Opt shift_expression(struct parser_ctx* ctx, enum exp
                (ctx->current->type == '>>' ||
                    ctx->current->type == '<<'))
         {
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL) throw;
 
             new_expression->first_token = ctx->current;
@@ -4788,7 +4808,7 @@ struct expression* _Owner _Opt relational_expression(struct parser_ctx* ctx, enu
                    ctx->current->type == '<='))
         {
             assert(new_expression == NULL);
-            new_expression = calloc(1, sizeof * new_expression);
+            new_expression = expression_new();
             if (new_expression == NULL)
             {
                 throw;
@@ -5035,7 +5055,7 @@ struct expression* _Owner _Opt equality_expression(struct parser_ctx* ctx, enum
         {
             struct token* p_token_operator = ctx->current;
             assert(new_expression == NULL);
-            new_expression = calloc(1, sizeof * new_expression);
+            new_expression = expression_new();
             if (new_expression == NULL)
                 throw;
 
@@ -5136,7 +5156,7 @@ struct expression* _Owner _Opt and_expression(struct parser_ctx* ctx, enum expre
             }
 
             assert(new_expression == NULL);
-            new_expression = calloc(1, sizeof * new_expression);
+            new_expression = expression_new();
             if (new_expression == NULL)
                 throw;
 
@@ -5216,7 +5236,7 @@ struct expression* _Owner _Opt  exclusive_or_expression(struct parser_ctx* ctx,
             }
 
             assert(new_expression == NULL);
-            new_expression = calloc(1, sizeof * new_expression);
+            new_expression = expression_new();
             if (new_expression == NULL)
                 throw;
 
@@ -5295,7 +5315,7 @@ struct expression* _Owner _Opt inclusive_or_expression(struct parser_ctx* ctx, e
                 throw;
             }
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL)
                 throw;
 
@@ -5380,7 +5400,7 @@ struct expression* _Owner _Opt logical_and_expression(struct parser_ctx* ctx, en
                 throw;
             }
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL)
                 throw;
 
@@ -5492,7 +5512,7 @@ struct expression* _Owner _Opt logical_or_expression(struct parser_ctx* ctx, enu
                 throw;
             }
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL)
                 throw;
 
@@ -5634,7 +5654,7 @@ struct expression* _Owner _Opt assignment_expression(struct parser_ctx* ctx, enu
                 throw;
             }
 
-            struct expression* _Owner _Opt new_expression = calloc(1, sizeof * new_expression);
+            struct expression* _Owner _Opt new_expression = expression_new();
             if (new_expression == NULL)
                 throw;
 
@@ -5814,7 +5834,7 @@ struct expression* _Owner _Opt checked_expression(struct parser_ctx* ctx, enum e
                 compiler_diagnostic(C_ERROR_LEFT_IS_NOT_SCALAR, ctx, p_expression_node->first_token, NULL, "left operator is not scalar");
             }
 
-            struct expression* _Owner _Opt p_expression_node_new = calloc(1, sizeof * p_expression_node_new);
+            struct expression* _Owner _Opt p_expression_node_new = expression_new();
             if (p_expression_node_new == NULL) throw;
 
             p_expression_node_new->first_token = ctx->current;
@@ -5905,9 +5925,30 @@ void expression_delete(struct expression* _Owner _Opt p)
         /* crashing */
         //object_destroy(&p->object);
 
+        if (p->in_arena)
+            static_set(p, "moved"); /*released with the arena*/
+        else
+            free(p);
+    }
+}
 
-        free(p);
+/*
+  Allocates a zeroed expression node from the current arena if there is one.
+*/
+struct expression* _Owner _Opt expression_new(void)
+{
+    time_counter_add(TIME_COUNTER_AST_NODES);
+
+    struct arena* _Opt p_arena = arena_get_current();
+    if (p_arena)
+    {
+        struct expression* _Opt p = arena_calloc(p_arena, sizeof(struct expression));
+        if (p == NULL)
+            return NULL;
+        p->in_arena = true;
+        return (struct expression* _Owner)p;
     }
+    return calloc(1, sizeof(struct expression));
 }
 struct expression* _Owner _Opt expression(struct parser_ctx* ctx, enum expression_eval_mode eval_mode)
 {
@@ -5945,7 +5986,7 @@ struct expression* _Owner _Opt expression(struct parser_ctx* ctx, enum expressio
                     throw;
                 }
 
-                struct expression* _Owner _Opt p_expression_node_new = calloc(1, sizeof * p_expression_node_new);
+                struct expression* _Owner _Opt p_expression_node_new = expression_new();
                 if (p_expression_node_new == NULL)
                     throw;
 
@@ -6074,7 +6115,7 @@ struct expression* _Owner _Opt conditional_expression(struct parser_ctx* ctx, en
 
         if (ctx->current && ctx->current->type == '?')
         {
-            struct expression* _Owner _Opt p_conditional_expression = calloc(1, sizeof(struct expression));
+            struct expression* _Owner _Opt p_conditional_expression = expression_new();
             if (p_conditional_expression == NULL) throw;
 
 
@@ -241,6 +241,9 @@ struct expression
     /*  used to check how contexpr can be used inside function literals */
     bool lvalue_disabled;       
 
+    /*node memory belongs to an arena (see expression_new)*/
+    bool in_arena;
+
     struct defer_list defer_list; //arguments
 };
 
@@ -248,6 +251,7 @@ struct expression
 bool expression_is_malloc(const struct expression* p);
 bool expression_is_calloc(const struct expression* p);
 
+struct expression* _Owner _Opt expression_new(void);
 void expression_delete(struct expression* _Owner _Opt p);
 
 /*cake extension*/
@@ -15,6 +15,7 @@
 #include <stdint.h>
 #include <limits.h>
 #include "console.h"
+#include "thread.h"
 
 static void flow_visit_unlabeled_statement(struct flow_visit_ctx* ctx, struct unlabeled_statement* p_unlabeled_statement);
 
@@ -25,7 +26,12 @@ struct object_visitor
     struct flow_object* p_object;
 };
 
-unsigned int s_visit_number = 1; //creates a unique number
+/*
+  Creates a unique number used to mark visited objects.
+  Objects are never shared between files compiled in parallel (-j),
+  so each thread has its own counter.
+*/
+static THREAD_LOCAL unsigned int s_visit_number = 1;
 _Opt struct flow_object* _Opt arena_new_object(struct flow_visit_ctx* ctx);
 
 bool flow_object_is_not_null(const struct flow_object* p)
@@ -112,14 +118,14 @@ static void object_state_to_string_core(enum flow_state e)
 {
     bool first = true;
 
-    printf("\"");
+    console_printf("\"");
     if (e & FLOW_OBJECT_STATE_UNINITIALIZED)
     {
         if (first)
             first = false;
         else
-            printf(" | ");
-        printf("uninitialized");
+            console_printf(" | ");
+        console_printf("uninitialized");
     }
 
     if (e & FLOW_OBJECT_STATE_NOT_NULL)
@@ -127,8 +133,8 @@ static void object_state_to_string_core(enum flow_state e)
         if (first)
             first = false;
         else
-            printf(" | ");
-        printf("not-null");
+            console_printf(" | ");
+        console_printf("not-null");
     }
 
     if (e & FLOW_OBJECT_STATE_NULL)
@@ -136,8 +142,8 @@ static void object_state_to_string_core(enum flow_state e)
         if (first)
             first = false;
         else
-            printf(" | ");
-        printf("null");
+            console_printf(" | ");
+        console_printf("null");
     }
 
     if (e & FLOW_OBJECT_STATE_ZERO)
@@ -145,8 +151,8 @@ static void object_state_to_string_core(enum flow_state e)
         if (first)
             first = false;
         else
-            printf(" | ");
-        printf("zero");
+            console_printf(" | ");
+        console_printf("zero");
     }
 
     if (e & FLOW_OBJECT_STATE_NOT_ZERO)
@@ -154,8 +160,8 @@ static void object_state_to_string_core(enum flow_state e)
         if (first)
             first = false;
         else
-            printf(" | ");
-        printf("not-zero");
+            console_printf(" | ");
+        console_printf("not-zero");
     }
 
 
@@ -164,8 +170,8 @@ static void object_state_to_string_core(enum flow_state e)
         if (first)
             first = false;
         else
-            printf(" | ");
-        printf("lifetime-ended");
+            console_printf(" | ");
+        console_printf("lifetime-ended");
     }
 
     if (e & FLOW_OBJECT_STATE_MOVED)
@@ -173,11 +179,11 @@ static void object_state_to_string_core(enum flow_state e)
         if (first)
             first = false;
         else
-            printf(" | ");
-        printf("moved");
+            console_printf(" | ");
+        console_printf("moved");
     }
 
-    printf("\"");
+    console_printf("\"");
 
 }
 
@@ -766,8 +772,8 @@ void print_object_core(bool color_enabled,
 
         if (p_struct_or_union_specifier)
         {
-            printf("%*c", ident + 1, ' ');
-            printf("#%02d {\n", p_visitor->p_object->id);
+            console_printf("%*c", ident + 1, ' ');
+            console_printf("#%02d {\n", p_visitor->p_object->id);
 
             struct member_declaration* _Opt p_member_declaration =
                 p_struct_or_union_specifier->member_declaration_list.head;
@@ -832,18 +838,18 @@ void print_object_core(bool color_enabled,
                 p_member_declaration = p_member_declaration->next;
             }
 
-            printf("%*c", ident + 1, ' ');
-            printf("}\n");
+            console_printf("%*c", ident + 1, ' ');
+            console_printf("}\n");
         }
     }
     else if (type_is_pointer(p_visitor->p_type))
     {
         struct type t2 = type_remove_pointer(p_visitor->p_type);
-        printf("%*c", ident, ' ');
+        console_printf("%*c", ident, ' ');
 
         if (short_version)
         {
-            printf("#%02d %s == ", p_visitor->p_object->id, previous_names);
+            console_printf("#%02d %s == ", p_visitor->p_object->id, previous_names);
             flow_object_print_state(p_visitor->p_object);
             if (flow_object_is_null(p_visitor->p_object))
             {
@@ -853,46 +859,46 @@ void print_object_core(bool color_enabled,
             }
             else
             {
-                printf(" -> ");
+                console_printf(" -> ");
 
                 if (p_visitor->p_object->current.pointed != NULL)
                 {
-                    printf(" #%02d", p_visitor->p_object->current.pointed->id);
+                    console_printf(" #%02d", p_visitor->p_object->current.pointed->id);
                 }
                 else
                 {
-                    printf("{...}");
+                    console_printf("{...}");
                 }
             }
         }
         else
         {
-            printf("%p:%s == ", p_visitor->p_object, previous_names);
-            printf("{");
+            console_printf("%p:%s == ", p_visitor->p_object, previous_names);
+            console_printf("{");
 
             struct flow_object_state* _Opt it = p_visitor->p_object->current.next;
             while (it)
             {
                 if (color_enabled)
-                    printf(LIGHTCYAN);
+                    console_printf(LIGHTCYAN);
 
-                printf("(#%02d %s)", it->state_number, it->dbg_name);
+                console_printf("(#%02d %s)", it->state_number, it->dbg_name);
                 object_state_set_item_print(it);
                 if (color_enabled)
-                    printf(COLOR_RESET);
-                printf(",");
+                    console_printf(COLOR_RESET);
+                console_printf(",");
                 it = it->next;
             }
-            //printf("*");
+            //console_printf("*");
             if (color_enabled)
-                printf(LIGHTMAGENTA);
-            printf("(current)");
+                console_printf(LIGHTMAGENTA);
+            console_printf("(current)");
             flow_object_print_state(p_visitor->p_object);
             if (color_enabled)
-                printf(COLOR_RESET);
-            printf("}");
+                console_printf(COLOR_RESET);
+            console_printf("}");
         }
-        printf("\n");
+        console_printf("\n");
 
 #if 0
         if (p_visitor->p_object->current.ref.size > 0)
@@ -920,33 +926,33 @@ void print_object_core(bool color_enabled,
     }
     else
     {
-        printf("%*c", ident, ' ');
+        console_printf("%*c", ident, ' ');
 
         if (short_version)
         {
-            printf("#%02d %s == ", p_visitor->p_object->id, previous_names);
+            console_printf("#%02d %s == ", p_visitor->p_object->id, previous_names);
             flow_object_print_state(p_visitor->p_object);
         }
         else
         {
-            printf("%p:%s == ", p_visitor->p_object, previous_names);
-            printf("{");
+            console_printf("%p:%s == ", p_visitor->p_object, previous_names);
+            console_printf("{");
 
             struct flow_object_state* _Opt it = p_visitor->p_object->current.next;
             while (it)
             {
-                printf("(#%02d %s)", it->state_number, it->dbg_name);
+                console_printf("(#%02d %s)", it->state_number, it->dbg_name);
                 object_state_set_item_print(it);
-                printf(",");
+                console_printf(",");
                 it = it->next;
             }
 
 
             flow_object_print_state(p_visitor->p_object);
-            printf("}");
+            console_printf("}");
         }
 
-        printf("\n");
+        console_printf("\n");
     }
 
 
@@ -2539,11 +2545,11 @@ static void flow_assignment_core(
         break;
     }
 #endif
-    // printf("line  %d\n", error_position->line);
+    // console_printf("line  %d\n", error_position->line);
      //type_print(p_a_type);
-     //printf(" = ");
+     //console_printf(" = ");
      //type_print(p_b_type);
-     //printf("\n");
+     //console_printf("\n");
 
      /*general check for copying uninitialized object*/
 
@@ -3058,10 +3064,10 @@ struct flow_object* _Opt  expression_get_flow_object(struct flow_visit_ctx* ctx,
                 if (p_expression->declarator->declaration_specifiers &&
                     !is_automatic_variable(p_expression->declarator->declaration_specifiers->storage_class_specifier_flags))
                 {
-                    assert(p_expression->declarator->p_flow_object != NULL);
-
                     //External flow_objects are added to the arena on-demand
-                    if (flow_objects_find(&ctx->arena, p_expression->declarator->p_flow_object) == NULL)
+                    //(functions used as values, like callbacks, do not have one yet)
+                    if (p_expression->declarator->p_flow_object == NULL ||
+                        flow_objects_find(&ctx->arena, p_expression->declarator->p_flow_object) == NULL)
                     {
                         p_expression->declarator->p_flow_object = make_flow_object(ctx, &p_expression->declarator->type, p_expression->declarator, NULL);
                         if (p_expression->declarator->p_flow_object == NULL)
@@ -3450,7 +3456,7 @@ struct flow_object* _Opt  expression_get_flow_object(struct flow_visit_ctx* ctx,
     {
 
     }
-    //printf("null object");
+    //console_printf("null object");
     //assert(false);
     return NULL;
 }
@@ -3598,7 +3604,7 @@ void flow_object_state_print(struct flow_object_state* p_state)
 
         ss_fprintf(&ss, "%d", p_state->alternatives.data[i]->id);
     }
-    printf("%-25s│", ss.c_str);
+    console_printf("%-25s│", ss.c_str);
     ss_close(&ss);
 }
 
@@ -3613,8 +3619,8 @@ void print_object_line(struct flow_object* p_object, int extra_cols)
         //if (p_object->current.alternatives.size > 0)
          //ss_fprintf(&ss, " &");
 
-        printf("│%-2d│", p_object->id);
-        printf("%-20s│", ss.c_str); //here we need compesate the unicode byte len of ↑
+        console_printf("│%-2d│", p_object->id);
+        console_printf("%-20s│", ss.c_str); //here we need compesate the unicode byte len of ↑
     }
     else
     {
@@ -3646,8 +3652,8 @@ void print_object_line(struct flow_object* p_object, int extra_cols)
         {
             ss_fprintf(&ss, "&");
         }
-        printf("│%-2d│", p_object->id);
-        printf("%-18s│", ss.c_str);
+        console_printf("│%-2d│", p_object->id);
+        console_printf("%-18s│", ss.c_str);
     }
 
     ss_close(&ss);
@@ -3664,9 +3670,9 @@ void print_object_line(struct flow_object* p_object, int extra_cols)
 
     for (int i = 0; i <= extra_cols - cols; i++)
     {
-        printf("%-25s│", " ");
+        console_printf("%-25s│", " ");
     }
-    printf("\n");
+    console_printf("\n");
 
 }
 
@@ -4505,44 +4511,44 @@ void print_arena(struct flow_visit_ctx* ctx)
 
 
     //┐
-    printf("\n");
-    printf("┌──┬──────────────────┬─────────────────────────");
+    console_printf("\n");
+    console_printf("┌──┬──────────────────┬─────────────────────────");
     if (extra_cols > 0)
     {
         for (int i = 0; i < extra_cols; i++)
         {
             if (i < extra_cols - 1)
-                printf("┬─────────────────────────");
+                console_printf("┬─────────────────────────");
             else
-                printf("┬─────────────────────────");
+                console_printf("┬─────────────────────────");
         }
     }
 
-    printf("┐");
+    console_printf("┐");
 
-    printf("\n");
+    console_printf("\n");
 
     for (int i = 0; i < ctx->arena.size; i++)
     {
         struct flow_object* p = ctx->arena.data[i];
         print_object_line(p, extra_cols);
     }
-    printf("└──┴──────────────────┴─────────────────────────");
+    console_printf("└──┴──────────────────┴─────────────────────────");
     if (extra_cols > 0)
     {
         for (int i = 0; i < extra_cols; i++)
         {
             if (i < extra_cols - 1)
-                printf("┴─────────────────────────");
+                console_printf("┴─────────────────────────");
             else
-                printf("┴─────────────────────────");
+                console_printf("┴─────────────────────────");
         }
     }
 
-    printf("┘");
+    console_printf("┘");
 
-    printf("\n");
-    printf("\n");
+    console_printf("\n");
+    console_printf("\n");
 }
 
 static void flow_visit_if_statement(struct flow_visit_ctx* ctx, struct selection_statement* p_selection_statement)
@@ -6942,10 +6948,10 @@ static void flow_visit_static_assert_declaration(struct flow_visit_ctx* ctx, str
                 {
                     compiler_diagnostic(C_ANALIZER_ERROR_STATIC_STATE_FAILED, ctx->ctx, p_static_assert_declaration->first_token, NULL, "static_state failed");
                     if (p_static_assert_declaration->string_literal_opt)
-                        printf("expected :%s\n", p_static_assert_declaration->string_literal_opt->lexeme);
-                    printf("current  :");
+                        console_printf("expected :%s\n", p_static_assert_declaration->string_literal_opt->lexeme);
+                    console_printf("current  :");
                     flow_object_print_state(p_obj);
-                    printf("\n");
+                    console_printf("\n");
                 }
             }
             else
@@ -8,8 +8,6 @@
 
 struct flow_visit_ctx;
 
-extern unsigned int s_visit_number; //creates a unique number
-
 
 enum flow_state
 {
@@ -38,6 +38,12 @@
 #include <unistd.h>
 #endif
 
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__) && !defined(MOCKFILES)
+#define HAS_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
 #include <assert.h>
 
 #include <string.h>
@@ -772,4 +778,105 @@ char* _Owner read_file(const char* path, bool append_newline)
 }
 #endif
 
+#ifdef HAS_MMAP
+
+/*
+  Maps the file when the mapped text can be used directly by the tokenizer:
+  the file ends with new-line and the page has room for the '\0'
+  (bytes after the end of file in the last page are zero).
+*/
+static int file_view_map(_Ctor struct file_view* view, const char* path)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return errno;
+
+    struct stat st = { 0 };
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return EINVAL;
+    }
+
+    const long page_size = sysconf(_SC_PAGESIZE);
+    const unsigned long long size = (unsigned long long)st.st_size;
+    if (size == 0 || page_size <= 0 || size % (unsigned long long)page_size == 0)
+    {
+        close(fd);
+        return EINVAL;
+    }
+
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return EINVAL;
+
+    const char* text = (const char*)mapping;
+    if (text[size - 1] != '\n')
+    {
+        munmap(mapping, size);
+        return EINVAL;
+    }
+
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    /*BOM*/
+    if (size >= 3 &&
+        (unsigned char)text[0] == 0xEF &&
+        (unsigned char)text[1] == 0xBB &&
+        (unsigned char)text[2] == 0xBF)
+    {
+        text += 3;
+    }
+
+    view->mapping = (void* _Owner)mapping;
+    view->mapping_size = size;
+    view->text = text;
+    return 0;
+}
+
+#endif
+
+int file_view_open(_Ctor struct file_view* view, const char* path)
+{
+    *view = (struct file_view){ 0 };
+
+#ifdef HAS_MMAP
+    if (file_view_map(view, path) == 0)
+        return 0;
+#endif
+
+    view->buffer = read_file(path, true);
+    if (view->buffer == NULL)
+        return ENOENT;
+    view->text = view->buffer;
+    return 0;
+}
+
+void file_view_close(_Dtor struct file_view* view)
+{
+#ifdef HAS_MMAP
+    if (view->mapping)
+        munmap(view->mapping, view->mapping_size);
+#else
+    static_set(view->mapping, "moved");
+#endif
+    free(view->buffer);
+}
+
+long long file_mtime(const char* path)
+{
+#ifdef MOCKFILES
+    /*embedded files never change*/
+    (void)path;
+    return 0;
+#else
+    struct stat st = { 0 };
+    if (stat(path, &st) != 0)
+        return -1;
+    return (long long)st.st_mtime;
+#endif
+}
+
 
@@ -104,6 +104,29 @@ char* _Opt realpath(const char* restrict path, char* restrict resolved_path);
 int get_self_path(char* buffer, int maxsize);
 
 char* _Owner _Opt read_file(const char* path, bool append_newline);
+
+/*
+  Read-only contents of a source file, as returned by read_file(path, true):
+  BOM removed, terminated by a new-line and '\0'.
+  When possible the file is memory mapped and not copied.
+*/
+struct file_view
+{
+    const char* _Opt text;
+
+    void* _Owner _Opt mapping;
+    unsigned long long mapping_size;
+    char* _Owner _Opt buffer;
+};
+
+/*returns 0 on success*/
+int file_view_open(_Ctor struct file_view* view, const char* path);
+void file_view_close(_Dtor struct file_view* view);
+
+/*
+  Last modification time of the file or -1 if the file does not exist.
+*/
+long long file_mtime(const char* path);
 char* dirname(char* path);
 char* basename(const char* filename);
 void remove_file_extension(const char* filename, int n, char out[/*n*/]);
@@ -11,6 +11,8 @@
 #include <stdbool.h>
 #include <assert.h>
 #include "hashmap.h"
+#include "arena.h"
+#include "thread.h"
 
 #include "error.h"
 #include <assert.h>
@@ -22,23 +24,224 @@
 #include <crtdbg.h>
 #endif
 
-static unsigned int string_hash(const char* key)
+static unsigned int string_hash(const char* key, size_t length)
 {
-    // hash key to unsigned int value by pseudorandomizing transform
-    // (algorithm copied from STL char hash in xfunctional)
+    /*
+      FNV-1a over the whole key.
+      Identifiers sharing long prefixes (SQLITE_OMIT_..., __builtin_...)
+      must not collide, so every character is used.
+    */
     unsigned int hash_val = 2166136261U;
-    unsigned int first = 0;
-    unsigned int last = (unsigned int)strlen(key);
-    unsigned int stride = 1 + last / 10;
 
-    for (; first < last; first += stride)
+    for (size_t i = 0; i < length; i++)
     {
-        hash_val = 16777619U * hash_val ^ (unsigned int)key[first];
+        hash_val ^= (unsigned int)(unsigned char)key[i];
+        hash_val *= 16777619U;
     }
 
-    return (hash_val);
+    return hash_val;
 }
 
+/*
+  Each atom is stored inside the atoms arena as
+  [struct atom_header][text][\0]
+  and the atom pointer points to the text.
+*/
+struct atom_header
+{
+    unsigned int hash;
+    unsigned int length;
+};
+
+static struct
+{
+    /*open addressing table of atoms*/
+    const char* _Opt* _Owner _Opt table;
+    unsigned int capacity;
+    unsigned int size;
+
+    /*atoms live until atom_table_clear*/
+    struct arena arena;
+} s_atoms;
+
+unsigned int atom_hash(const char* atom)
+{
+    const struct atom_header* p_header = (const struct atom_header*)(atom - sizeof(struct atom_header));
+    return p_header->hash;
+}
+
+static unsigned int atom_length(const char* atom)
+{
+    const struct atom_header* p_header = (const struct atom_header*)(atom - sizeof(struct atom_header));
+    return p_header->length;
+}
+
+static unsigned int atom_find_slot(const char* text, size_t length, unsigned int hash)
+{
+    assert(s_atoms.table != NULL);
+    const unsigned int mask = s_atoms.capacity - 1;
+    unsigned int index = hash & mask;
+    for (;;)
+    {
+        const char* _Opt atom = s_atoms.table[index];
+        if (atom == NULL)
+            break;
+        if (atom_hash(atom) == hash &&
+            atom_length(atom) == length &&
+            memcmp(atom, text, length) == 0)
+        {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+static int atom_table_grow(void)
+{
+    const unsigned int new_capacity = s_atoms.capacity == 0 ? 4096 : s_atoms.capacity * 2;
+    const char* _Opt* _Owner _Opt new_table = calloc(new_capacity, sizeof(new_table[0]));
+    if (new_table == NULL)
+        return 1;
+
+    for (unsigned int i = 0; i < s_atoms.capacity; i++)
+    {
+        assert(s_atoms.table != NULL);
+        const char* _Opt atom = s_atoms.table[i];
+        if (atom == NULL)
+            continue;
+        unsigned int index = atom_hash(atom) & (new_capacity - 1);
+        while (new_table[index] != NULL)
+            index = (index + 1) & (new_capacity - 1);
+        new_table[index] = atom;
+    }
+
+    free(s_atoms.table);
+    s_atoms.table = new_table;
+    s_atoms.capacity = new_capacity;
+    return 0;
+}
+
+enum
+{
+    ATOM_CACHE_SIZE = 2048
+};
+
+/*
+  Atoms recently found by this thread. Atoms never change or move, so
+  the cache is read without locking the shared table.
+*/
+static THREAD_LOCAL const char* _Opt s_atom_cache[ATOM_CACHE_SIZE];
+
+static const char* _Opt atom_cache_find(const char* text, size_t length, unsigned int hash)
+{
+    const char* _Opt atom = s_atom_cache[hash & (ATOM_CACHE_SIZE - 1)];
+    if (atom != NULL &&
+        atom_hash(atom) == hash &&
+        atom_length(atom) == length &&
+        memcmp(atom, text, length) == 0)
+    {
+        return atom;
+    }
+    return NULL;
+}
+
+/*
+  The atoms table is shared by all files compiled in parallel (-j).
+*/
+const char* _Opt atom_find(const char* text)
+{
+    const size_t length = strlen(text);
+    const unsigned int hash = string_hash(text, length);
+
+    const char* _Opt atom = atom_cache_find(text, length, hash);
+    if (atom != NULL)
+        return atom;
+
+    shared_lock_acquire(SHARED_LOCK_ATOMS);
+    if (s_atoms.table != NULL)
+        atom = s_atoms.table[atom_find_slot(text, length, hash)];
+    shared_lock_release(SHARED_LOCK_ATOMS);
+
+    if (atom != NULL)
+        s_atom_cache[hash & (ATOM_CACHE_SIZE - 1)] = atom;
+
+    return atom;
+}
+
+static const char* _Opt atom_intern_core(const char* text, size_t length, unsigned int hash)
+{
+    if ((s_atoms.size + 1) * 4 > s_atoms.capacity * 3)
+    {
+        if (atom_table_grow() != 0)
+            return NULL;
+    }
+    assert(s_atoms.table != NULL);
+
+    const unsigned int index = atom_find_slot(text, length, hash);
+    if (s_atoms.table[index] != NULL)
+        return s_atoms.table[index];
+
+    char* _Opt p = arena_calloc(&s_atoms.arena, sizeof(struct atom_header) + length + 1);
+    if (p == NULL)
+        return NULL;
+
+    struct atom_header* p_header = (struct atom_header*)p;
+    p_header->hash = hash;
+    p_header->length = (unsigned int)length;
+
+    char* atom = p + sizeof(struct atom_header);
+    memcpy(atom, text, length);
+
+    s_atoms.table[index] = atom;
+    s_atoms.size++;
+    return atom;
+}
+
+const char* _Opt atom_intern(const char* text, size_t length)
+{
+    const unsigned int hash = string_hash(text, length);
+
+    const char* _Opt atom = atom_cache_find(text, length, hash);
+    if (atom != NULL)
+        return atom;
+
+    shared_lock_acquire(SHARED_LOCK_ATOMS);
+    atom = atom_intern_core(text, length, hash);
+    shared_lock_release(SHARED_LOCK_ATOMS);
+
+    if (atom != NULL)
+        s_atom_cache[hash & (ATOM_CACHE_SIZE - 1)] = atom;
+
+    return atom;
+}
+
+void atom_table_clear(void)
+{
+    shared_lock_acquire(SHARED_LOCK_ATOMS);
+    free(s_atoms.table);
+    s_atoms.table = NULL;
+    s_atoms.capacity = 0;
+    s_atoms.size = 0;
+    arena_destroy(&s_atoms.arena);
+    s_atoms.arena = (struct arena){ 0 };
+    shared_lock_release(SHARED_LOCK_ATOMS);
+
+    /*worker threads have finished, only the cache of this thread is left*/
+    memset(s_atom_cache, 0, sizeof s_atom_cache);
+}
+
+/*
+  capacity is always a power of two; the initial value set by the
+  user is just a hint.
+*/
+static int round_up_capacity(int capacity)
+{
+    int n = 8;
+    while (n < capacity)
+        n *= 2;
+    return n;
+}
 
 void map_entry_delete(struct map_entry* _Owner _Opt p)
 {
@@ -72,9 +275,12 @@ void map_entry_delete(struct map_entry* _Owner _Opt p)
     case TAG_TYPE_STRUCT_ENTRY:
         struct_entry_delete(p->data.p_struct_entry);
         break;
+
+    case TAG_TYPE_INCLUDE_FILE:
+        include_file_delete(p->data.p_include_file);
+        break;
     }
 
-    free(p->key);
     free(p);
 }
 
@@ -85,14 +291,7 @@ void hashmap_remove_all(struct hash_map* map)
     {
         for (int i = 0; i < map->capacity; i++)
         {
-            struct map_entry* _Owner _Opt pentry = map->table[i];
-
-            while (pentry != NULL)
-            {
-                struct map_entry* _Owner _Opt next = pentry->next;
-                map_entry_delete(pentry);
-                pentry = next;
-            }
+            map_entry_delete(map->table[i]);
         }
 
         free(map->table);
@@ -107,57 +306,132 @@ void hashmap_destroy(_Dtor struct hash_map* map)
     assert(map->table == NULL);
 }
 
-struct map_entry* _Opt hashmap_find(struct hash_map* map, const char* key)
+/*
+  Open addressing with linear probing.
+  Returns the slot of key or the empty slot where it would be inserted.
+  Keys are atoms so they are compared by pointer.
+*/
+static int hashmap_find_slot(const struct hash_map* map, const char* atom)
 {
-    if (map->table == NULL)
-        return NULL;
+    assert(map->table != NULL);
+    const unsigned int mask = (unsigned int)map->capacity - 1;
+    unsigned int index = atom_hash(atom) & mask;
+
+    for (;;)
+    {
+        struct map_entry* _Opt pentry = map->table[index];
+        if (pentry == NULL)
+            break;
+
+        if (pentry->key == atom)
+            break;
+
+        index = (index + 1) & mask;
+    }
+
+    return (int)index;
+}
 
-    const unsigned int hash = string_hash(key);
-    const int index = hash % map->capacity;
+static int hashmap_grow(struct hash_map* map)
+{
+    const int new_capacity = map->capacity * 2;
+
+    struct map_entry* _Owner _Opt* _Owner _Opt new_table = calloc(new_capacity, sizeof(new_table[0]));
+    if (new_table == NULL)
+        return 1;
 
-    struct map_entry* _Opt pentry = map->table[index];
+    const unsigned int mask = (unsigned int)new_capacity - 1;
 
-    for (; pentry != NULL; pentry = pentry->next)
+    for (int i = 0; i < map->capacity; i++)
     {
-        if (pentry->hash == hash && strcmp(pentry->key, key) == 0)
-        {
-            return pentry;
-        }
+        struct map_entry* _Owner _Opt pentry = map->table[i];
+        if (pentry == NULL)
+            continue;
+
+        unsigned int index = pentry->hash & mask;
+        while (new_table[index] != NULL)
+            index = (index + 1) & mask;
+
+        new_table[index] = pentry;
     }
 
-    return NULL;
+    free(map->table);
+    map->table = new_table;
+    map->capacity = new_capacity;
+    return 0;
+}
+
+struct map_entry* _Opt hashmap_find_atom(const struct hash_map* map, const char* atom)
+{
+    if (map->table == NULL)
+        return NULL;
+
+    return map->table[hashmap_find_slot(map, atom)];
+}
+
+struct map_entry* _Opt hashmap_find(struct hash_map* map, const char* key)
+{
+    if (map->table == NULL)
+        return NULL;
+
+    /*a key that was never interned cannot be inside any map*/
+    const char* _Opt atom = atom_find(key);
+    if (atom == NULL)
+        return NULL;
+
+    return map->table[hashmap_find_slot(map, atom)];
 }
 
 
 void* _Opt hashmap_remove(struct hash_map* map, const char* key, enum tag* _Opt p_type_opt)
 {
-    if (map->table != NULL)
-    {
-        const unsigned int hash = string_hash(key);
-        struct map_entry** pp_entry = &map->table[hash % map->capacity];
-        struct map_entry* _Opt p_entry = *pp_entry;
+    if (map->table == NULL)
+        return NULL;
 
-        for (; p_entry != NULL; p_entry = p_entry->next)
-        {
-            if ((p_entry->hash == hash) && (strcmp(p_entry->key, key) == 0))
-            {
-                *pp_entry = p_entry->next;
+    const char* _Opt atom = atom_find(key);
+    if (atom == NULL)
+        return NULL;
+
+    int index = hashmap_find_slot(map, atom);
 
-                if (p_type_opt)
-                    *p_type_opt = p_entry->type;
+    struct map_entry* _Owner _Opt p_entry = map->table[index];
+    if (p_entry == NULL)
+        return NULL;
 
-                void* _Opt p = p_entry->data.p_declarator;
-                free((void* _Owner)p_entry->key);
-                free((void* _Owner)p_entry);
-                map->size--;
+    map->table[index] = NULL;
+    map->size--;
+
+    /*
+      backward shift deletion: entries after the hole that would not be
+      reachable anymore are moved back, so we don't need tombstones.
+    */
+    const unsigned int mask = (unsigned int)map->capacity - 1;
+    unsigned int hole = (unsigned int)index;
+    unsigned int next = (hole + 1) & mask;
+    while (map->table[next] != NULL)
+    {
+        const unsigned int home = map->table[next]->hash & mask;
 
-                return p;
-            }
-            pp_entry = &p_entry->next;
+        /*distance from the home slot to the current and to the hole slots*/
+        const unsigned int dist_next = (next - home) & mask;
+        const unsigned int dist_hole = (hole - home) & mask;
+
+        if (dist_hole < dist_next)
+        {
+            map->table[hole] = map->table[next];
+            map->table[next] = NULL;
+            hole = next;
         }
+        next = (next + 1) & mask;
     }
 
-    return NULL;
+    if (p_type_opt)
+        *p_type_opt = p_entry->type;
+
+    void* _Opt p = p_entry->data.p_declarator;
+    free((void* _Owner)p_entry);
+
+    return p;
 }
 
 void hash_item_set_destroy(_Dtor struct hash_item_set* p)
@@ -168,7 +442,7 @@ void hash_item_set_destroy(_Dtor struct hash_item_set* p)
     init_declarator_delete(p->p_init_declarator);
     struct_or_union_specifier_delete(p->p_struct_or_union_specifier);
     macro_delete(p->p_macro);
-
+    include_file_delete(p->p_include_file);
 }
 
 int hashmap_set(struct hash_map* map, const char* key, struct hash_item_set* item /*in out*/)
@@ -224,6 +498,12 @@ int hashmap_set(struct hash_map* map, const char* key, struct hash_item_set* ite
         p = item->p_struct_entry;
         item->p_struct_entry = NULL;
     }
+    else if (item->p_include_file)
+    {
+        type = TAG_TYPE_INCLUDE_FILE;
+        p = item->p_include_file;
+        item->p_include_file = NULL;
+    }
     else //if (item->number)
     {
         type = TAG_TYPE_NUMBER;
@@ -243,45 +523,37 @@ int hashmap_set(struct hash_map* map, const char* key, struct hash_item_set* ite
                 map->capacity = 1000;
             }
 
+            map->capacity = round_up_capacity(map->capacity);
             map->table = calloc(map->capacity, sizeof(map->table[0]));
             if (map->table == NULL) throw;
         }
+        else if ((map->size + 1) * 4 > map->capacity * 3)
+        {
+            /*keeps the load factor below 3/4*/
+            if (hashmap_grow(map) != 0) throw;
+        }
 
         if (map->table != NULL)
         {
-            unsigned int hash = string_hash(key);
-            int index = hash % map->capacity;
+            const char* _Opt atom = atom_intern(key, strlen(key));
+            if (atom == NULL) throw;
 
-            struct map_entry* _Opt pentry = map->table[index];
+            int index = hashmap_find_slot(map, atom);
 
-            for (; pentry != NULL; pentry = pentry->next)
-            {
-                if (pentry->hash == hash && strcmp(pentry->key, key) == 0)
-                {
-                    break;
-                }
-            }
+            struct map_entry* _Opt pentry = map->table[index];
 
             if (pentry == NULL)
             {
                 struct map_entry* _Owner _Opt p_new_entry = calloc(1, sizeof(*pentry));
                 if (p_new_entry == NULL) throw;
 
-                p_new_entry->hash = hash;
+                p_new_entry->hash = atom_hash(atom);
 
                 p_new_entry->data.p_declarator = (void*)p;
 
                 p_new_entry->type = type;
 
-                char* _Opt _Owner temp_key = strdup(key);
-                if (temp_key == NULL)
-                {
-                    map_entry_delete(p_new_entry);
-                    throw;
-                }
-
-                p_new_entry->key = temp_key;
-                p_new_entry->next = map->table[index];
+                p_new_entry->key = atom;
                 map->table[index] = p_new_entry;
                 map->size++;
                 result = 0;
@@ -321,6 +593,10 @@ int hashmap_set(struct hash_map* map, const char* key, struct hash_item_set* ite
                     assert(pentry->data.p_struct_entry != NULL);
                     item->p_struct_entry = pentry->data.p_struct_entry;
                     break;
+                case TAG_TYPE_INCLUDE_FILE:
+                    assert(pentry->data.p_include_file != NULL);
+                    item->p_include_file = pentry->data.p_include_file;
+                    break;
                 }
 
                 result = 1;
@@ -333,4 +609,46 @@ int hashmap_set(struct hash_map* map, const char* key, struct hash_item_set* ite
     {
     }
     return result;
-}
\ No newline at end of file
+}
+#ifdef TEST
+#include <stdio.h>
+#include "unit_test.h"
+
+void hashmap_grow_and_remove_test()
+{
+    struct hash_map map = { .capacity = 1 };
+    char key[20];
+
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(key, sizeof key, "k%d", i);
+        struct hash_item_set item = { .number = (size_t)i };
+        hashmap_set(&map, key, &item);
+    }
+    assert(map.size == 1000);
+    assert(map.size * 4 <= map.capacity * 3);
+
+    /*removing must not break the probe sequence of the remaining keys*/
+    for (int i = 0; i < 1000; i += 2)
+    {
+        snprintf(key, sizeof key, "k%d", i);
+        hashmap_remove(&map, key, NULL);
+    }
+    assert(map.size == 500);
+
+    bool all_found = true;
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(key, sizeof key, "k%d", i);
+        struct map_entry* _Opt p_entry = hashmap_find(&map, key);
+        if (i % 2 == 0)
+            all_found = all_found && p_entry == NULL;
+        else
+            all_found = all_found && p_entry != NULL && p_entry->data.number == (size_t)i;
+    }
+    assert(all_found);
+
+    hashmap_destroy(&map);
+}
+
+#endif
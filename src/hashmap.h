@@ -5,6 +5,22 @@
 
 #pragma once
 #include "ownership.h"
+#include <stddef.h>
+
+/*
+  Atoms are interned strings. Equal strings are stored once and have the same
+  address until atom_table_clear, so they can be compared by pointer.
+  The hash is computed once, when the string is interned.
+*/
+const char* _Opt atom_intern(const char* text, size_t length);
+const char* _Opt atom_find(const char* text);
+unsigned int atom_hash(const char* atom);
+
+/*
+  Releases all atoms. It can be called only when no atom is in use,
+  after all files were compiled and no other thread is running.
+*/
+void atom_table_clear(void);
 
 struct declarator;
 struct enumerator;
@@ -13,6 +29,7 @@ struct init_declarator;
 struct struct_or_union_specifier;
 struct macro;
 struct struct_entry;
+struct include_file;
 
 void declarator_delete(struct declarator* _Owner _Opt p);
 void init_declarator_delete(struct init_declarator* _Owner _Opt p);
@@ -23,6 +40,7 @@ void struct_or_union_specifier_delete(struct struct_or_union_specifier* _Owner _
 void struct_entry_delete(struct struct_entry* _Opt _Owner p);
 
 void macro_delete(struct macro* _Owner _Opt p);
+void include_file_delete(struct include_file* _Owner _Opt p);
 
 
 /*
@@ -39,15 +57,15 @@ enum tag
     TAG_TYPE_DECLARATOR,
     TAG_TYPE_INIT_DECLARATOR,
     TAG_TYPE_MACRO,
-    TAG_TYPE_STRUCT_ENTRY
+    TAG_TYPE_STRUCT_ENTRY,
+    TAG_TYPE_INCLUDE_FILE
 };
 
 
 struct map_entry 
 {
-    struct map_entry* _Owner _Opt next;
     unsigned int hash;
-    char* _Owner key;
+    const char* key; /*atom*/
 
     enum tag type; /*type of the object pointed by p*/
 
@@ -61,10 +79,16 @@ struct map_entry
         struct init_declarator* _Opt _Owner p_init_declarator;
         struct macro* _Opt _Owner p_macro;
         struct struct_entry* _Opt _Owner p_struct_entry;
+        struct include_file* _Opt _Owner p_include_file;
     } data;
     
 };
 
+/*
+  Open addressing hash map that grows when the load factor exceeds 3/4.
+  capacity can be set before the first insertion as an initial size hint.
+  To iterate, visit all table[0..capacity) slots that are not NULL.
+*/
 struct hash_map 
 {
     struct map_entry* _Owner _Opt * _Owner _Opt table;
@@ -75,6 +99,12 @@ struct hash_map
 void hashmap_remove_all(struct hash_map* map);
 void hashmap_destroy(_Dtor struct hash_map* map);
 struct map_entry* _Opt hashmap_find(struct hash_map* map, const char* key);
+
+/*
+  Same as hashmap_find but key must be an atom. Useful when the same key
+  is searched in many maps.
+*/
+struct map_entry* _Opt hashmap_find_atom(const struct hash_map* map, const char* atom);
 void* _Opt hashmap_remove(struct hash_map* map, const char* key, enum tag* _Opt p_type_opt);
 
 /*
@@ -91,6 +121,7 @@ struct hash_item_set
     struct init_declarator* _Owner _Opt p_init_declarator;
     struct macro* _Owner _Opt p_macro;
     struct struct_entry* _Owner _Opt p_struct_entry;
+    struct include_file* _Owner _Opt p_include_file;
 };
 void hash_item_set_destroy(_Dtor struct hash_item_set* p);
 
@@ -9,10 +9,13 @@
 #include "object.h"
 #include <limits.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
 #include <assert.h>
 #include "type.h"
 #include "error.h"
 #include "parser.h"
+#include "console.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -327,6 +330,8 @@ bool signed_long_long_mul(_Ctor signed long long* result, signed long long a, si
 
 void object_list_push(struct object_list* list, struct object* _Owner pnew)
 {
+    const size_t count = pnew->run_count > 0 ? pnew->run_count : 1;
+
     if (list->head == NULL)
     {
         list->head = pnew;
@@ -335,10 +340,15 @@ void object_list_push(struct object_list* list, struct object* _Owner pnew)
     else
     {
         assert(list->tail != NULL);
+
+        /*a run at the tail may have been split*/
+        while (list->tail->next)
+            list->tail = list->tail->next;
+
         list->tail->next = pnew;
         list->tail = pnew;
     }
-    list->count++;
+    list->count += count;
 }
 
 void object_swap(struct object* a, struct object* b)
@@ -354,6 +364,7 @@ void object_destroy(_Opt _Dtor struct object* p)
 
     type_destroy(&p->type);
     free((void* _Owner)p->member_designator);
+    free(p->run_values);
 
     struct object* _Owner _Opt item = p->members.head;
     while (item)
@@ -889,6 +900,14 @@ struct object object_cast(enum target target, enum object_type dest_type, const
 
 void object_default_initialization(struct object* p_object, bool is_constant)
 {
+    if (p_object->run_values)
+    {
+        /*all elements of the run are zero again*/
+        free(p_object->run_values);
+        p_object->run_values = NULL;
+        p_object->run_values_capacity = 0;
+    }
+
     if (p_object->members.head == NULL)
     {
         if (is_constant)
@@ -1121,6 +1140,169 @@ static void object_fix_parent(struct object* p_object, struct object* parent)
     }
 }
 
+static struct object* _Owner _Opt object_run_new(const struct type* p_item_type,
+    const char* _Opt member_designator,
+    size_t index,
+    size_t count,
+    enum object_value_state state,
+    enum target target)
+{
+    struct object* _Owner _Opt p_run = calloc(1, sizeof * p_run);
+    if (p_run == NULL)
+        return NULL;
+
+    p_run->member_designator = strdup(member_designator ? member_designator : "");
+    if (p_run->member_designator == NULL)
+    {
+        free(p_run);
+        return NULL;
+    }
+
+    p_run->type = type_dup(p_item_type);
+    if (type_is_arithmetic(p_item_type))
+        p_run->value_type = type_to_object_type(p_item_type, target);
+    p_run->state = state;
+    p_run->run_index = index;
+    p_run->run_count = count;
+    p_run->run_target = target;
+    return p_run;
+}
+
+static bool object_run_can_pack(const struct object* p_run)
+{
+    return type_is_integer(&p_run->type) && !type_is_bool(&p_run->type);
+}
+
+static int object_run_reserve(struct object* p_run, size_t count)
+{
+    if (count > p_run->run_values_capacity)
+    {
+        size_t n = p_run->run_values_capacity > 0 ? p_run->run_values_capacity : 16;
+        while (n < count)
+            n *= 2;
+
+        void* _Owner _Opt pnew = realloc(p_run->run_values, n * p_run->run_value_size);
+        if (pnew == NULL) return ENOMEM;
+
+        static_set(p_run->run_values, "moved"); //p_run->run_values was moved to pnew
+
+        p_run->run_values = pnew;
+        p_run->run_values_capacity = n;
+    }
+    return 0;
+}
+
+static void object_run_store(struct object* p_run, size_t i, unsigned long long value)
+{
+    assert(p_run->run_values != NULL);
+    unsigned char* p = p_run->run_values + i * p_run->run_value_size;
+
+    switch (p_run->run_value_size)
+    {
+    case 1: { const uint8_t v = (uint8_t)value; memcpy(p, &v, sizeof v); } break;
+    case 2: { const uint16_t v = (uint16_t)value; memcpy(p, &v, sizeof v); } break;
+    case 4: { const uint32_t v = (uint32_t)value; memcpy(p, &v, sizeof v); } break;
+    default: { const uint64_t v = (uint64_t)value; memcpy(p, &v, sizeof v); } break;
+    }
+}
+
+static unsigned long long object_run_load(const struct object* p_run, size_t i)
+{
+    assert(p_run->run_values != NULL);
+    const unsigned char* p = p_run->run_values + i * p_run->run_value_size;
+    const bool is_signed = object_type_is_signed_integer(p_run->value_type);
+
+    switch (p_run->run_value_size)
+    {
+    case 1:
+    {
+        uint8_t v;
+        memcpy(&v, p, sizeof v);
+        return is_signed ? (unsigned long long)(int8_t)v : v;
+    }
+    case 2:
+    {
+        uint16_t v;
+        memcpy(&v, p, sizeof v);
+        return is_signed ? (unsigned long long)(int16_t)v : v;
+    }
+    case 4:
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof v);
+        return is_signed ? (unsigned long long)(int32_t)v : v;
+    }
+    default:
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof v);
+        return v;
+    }
+    }
+}
+
+/*
+  Splits the run at index. The run keeps the elements before index and
+  the new run, linked after it, has the others.
+*/
+static struct object* _Opt object_run_split(struct object* p_run, size_t index)
+{
+    assert(index > p_run->run_index);
+    assert(index - p_run->run_index < p_run->run_count);
+
+    const size_t offset = index - p_run->run_index;
+
+    struct object* _Owner _Opt p_rest =
+        object_run_new(&p_run->type, p_run->member_designator, index, p_run->run_count - offset, p_run->state, p_run->run_target);
+
+    if (p_rest == NULL)
+        return NULL;
+
+    p_rest->value = p_run->value;
+    p_rest->parent = p_run->parent;
+
+    if (p_run->run_values)
+    {
+        p_rest->run_value_size = p_run->run_value_size;
+        if (object_run_reserve(p_rest, p_rest->run_count) != 0)
+        {
+            object_delete(p_rest);
+            return NULL;
+        }
+        memcpy(p_rest->run_values,
+               p_run->run_values + offset * p_run->run_value_size,
+               p_rest->run_count * p_run->run_value_size);
+    }
+
+    p_rest->next = p_run->next;
+    struct object* p_result = p_rest;
+    p_run->next = p_rest;
+    p_run->run_count = offset;
+    return p_result;
+}
+
+/*returns the run or the element that has the element index of the array*/
+static struct object* _Opt object_find_member(const struct object* p_array, size_t index, struct object* _Opt* _Opt pp_previous)
+{
+    struct object* _Opt p_previous = NULL;
+    struct object* _Opt it = p_array->members.head;
+    size_t count = 0;
+    while (it)
+    {
+        const size_t n = object_is_run(it) ? it->run_count : 1;
+        if (index - count < n)
+            break;
+        count += n;
+        p_previous = it;
+        it = it->next;
+    }
+
+    if (pp_previous)
+        *pp_previous = p_previous;
+
+    return it;
+}
+
 struct object* _Opt object_get_member(struct object* p_object, size_t index)
 {
     p_object = (struct object* _Opt) object_get_referenced(p_object);
@@ -1132,9 +1314,19 @@ struct object* _Opt object_get_member(struct object* p_object, size_t index)
     size_t count = 0;
     while (it)
     {
-        if (index == count)
-            return it;
-        count++;
+        if (object_is_run(it))
+        {
+            assert(it->run_index == count);
+            if (index - count < it->run_count)
+                return object_run_take(it, index);
+            count += it->run_count;
+        }
+        else
+        {
+            if (index == count)
+                return it;
+            count++;
+        }
         it = it->next;
     }
 
@@ -1162,6 +1354,77 @@ int object_set(
 
             while (it_from && it_to)
             {
+                if (object_is_run(it_from) && it_from->run_values)
+                {
+                    /*packed values are copied one at a time, packed when possible*/
+                    const size_t first = it_from->run_index;
+                    const size_t end = first + it_from->run_count;
+                    for (size_t i = first; i < end; i++)
+                    {
+                        const struct object value = object_run_value(it_from, i);
+                        if (object_set_element_value(to, i, &value, is_constant) != 0)
+                        {
+                            struct object* _Opt p_to_element = object_get_member(to, i);
+                            if (p_to_element == NULL)
+                                throw;
+                            object_set(ctx, p_to_element, NULL, &value, is_constant, requires_constant_initialization);
+                        }
+                    }
+
+                    it_to = object_find_member(to, end, NULL);
+                    if (it_to && object_is_run(it_to) && it_to->run_index < end)
+                        it_to = object_run_split(it_to, end);
+
+                    it_from = it_from->next;
+                    continue;
+                }
+
+                if (object_is_run(it_from))
+                {
+                    /*all elements of the run are equal*/
+                    struct object* _Owner _Opt p_from_element = object_run_make_element(it_from, it_from->run_index);
+                    if (p_from_element == NULL)
+                        throw;
+
+                    size_t n = it_from->run_count;
+                    while (n > 0 && it_to)
+                    {
+                        if (object_is_run(it_to) && it_to->run_count <= n)
+                        {
+                            free(it_to->run_values);
+                            it_to->run_values = NULL;
+                            it_to->run_values_capacity = 0;
+                            it_to->state = it_from->state;
+                            if (it_to->state == CONSTANT_VALUE_STATE_CONSTANT && !is_constant)
+                                it_to->state = CONSTANT_VALUE_EQUAL;
+                            it_to->value = it_from->value;
+                            n -= it_to->run_count;
+                        }
+                        else
+                        {
+                            if (object_is_run(it_to))
+                            {
+                                it_to = object_run_take(it_to, it_to->run_index);
+                                if (it_to == NULL)
+                                    break;
+                            }
+                            object_set(ctx, it_to, NULL, p_from_element, is_constant, requires_constant_initialization);
+                            n--;
+                        }
+                        it_to = it_to->next;
+                    }
+                    object_delete(p_from_element);
+                    it_from = it_from->next;
+                    continue;
+                }
+
+                if (object_is_run(it_to))
+                {
+                    it_to = object_run_take(it_to, it_to->run_index);
+                    if (it_to == NULL)
+                        throw;
+                }
+
                 object_set(ctx, it_to, NULL, it_from, is_constant, requires_constant_initialization);
                 it_to = it_to->next;
                 it_from = it_from->next;
@@ -1226,6 +1489,11 @@ int object_set(
     return 0;
 }
 
+bool object_is_run(const struct object* p_object)
+{
+    return p_object->run_count > 0;
+}
+
 struct object* _Owner _Opt make_object_ptr_core(const struct type* p_type, const char* member_designator, enum target target)
 {
     struct object* _Owner _Opt p_object = NULL;
@@ -1271,27 +1539,21 @@ struct object* _Owner _Opt make_object_ptr_core(const struct type* p_type, const
             {
                 struct type array_item_type = get_array_item_type(p_type);
 
-                //too big..
-                const unsigned long long max_elements = p_type->array_num_elements > 1000 ? 1000 : p_type->array_num_elements;
+                struct object* _Owner _Opt p_run =
+                    object_run_new(&array_item_type,
+                                   member_designator,
+                                   0,
+                                   p_type->array_num_elements,
+                                   CONSTANT_VALUE_STATE_UNINITIALIZED,
+                                   target);
 
+                type_destroy(&array_item_type);
 
-                for (unsigned long long i = 0; i < max_elements; i++)
-                {
-                    char buffer[200] = { 0 };
-                    snprintf(buffer, sizeof buffer, "%s[%llu]", member_designator, i);
-                    struct object* _Owner _Opt p_member_obj = make_object_ptr_core(&array_item_type, buffer, target);
-                    if (p_member_obj == NULL)
-                    {
-                        type_destroy(&array_item_type);
-                        throw;
-                    }
-                    p_member_obj->parent = p_object;
+                if (p_run == NULL)
+                    throw;
 
-                    free((void* _Owner)p_member_obj->member_designator);
-                    p_member_obj->member_designator = strdup(buffer);
-                    object_list_push(&p_object->members, p_member_obj);
-                }
-                type_destroy(&array_item_type);
+                p_run->parent = p_object;
+                object_list_push(&p_object->members, p_run);
             }
 
             return p_object;
@@ -1423,6 +1685,7 @@ int make_object_with_member_designator(const struct type* p_type, struct object*
 struct object object_dup(const struct object* src)
 {
     assert(src->members.head == NULL);
+    assert(src->run_values == NULL);
     //assert(src->next == NULL); ??
 
     struct object result = *src;
@@ -1441,6 +1704,183 @@ int make_object(const struct type* p_type, struct object* obj, enum target targe
     return make_object_with_member_designator(p_type, obj, "", target);
 }
 
+struct object* _Owner _Opt object_run_make_element(const struct object* p_run, size_t index)
+{
+    assert(object_is_run(p_run));
+    assert(index - p_run->run_index < p_run->run_count);
+
+    char name[200] = { 0 };
+    snprintf(name, sizeof name, "%s[%zu]", p_run->member_designator ? p_run->member_designator : "", index);
+
+    struct object* _Owner _Opt p_element = make_object_ptr_core(&p_run->type, name, p_run->run_target);
+    if (p_element == NULL)
+        return NULL;
+
+    p_element->parent = p_run->parent;
+
+    if (p_run->run_values)
+    {
+        p_element->state = p_run->state;
+        p_element->value = object_run_value(p_run, index).value;
+        return p_element;
+    }
+
+    switch (p_run->state)
+    {
+    case CONSTANT_VALUE_STATE_UNINITIALIZED:
+        break;
+    case CONSTANT_VALUE_STATE_ANY:
+        object_set_any(p_element);
+        break;
+    default:
+        object_default_initialization(p_element, p_run->state == CONSTANT_VALUE_STATE_CONSTANT);
+        break;
+    }
+
+    return p_element;
+}
+
+struct object* _Opt object_run_take(struct object* p_run, size_t index)
+{
+    assert(object_is_run(p_run));
+    assert(index - p_run->run_index < p_run->run_count);
+
+    if (index > p_run->run_index)
+    {
+        p_run = object_run_split(p_run, index);
+        if (p_run == NULL)
+            return NULL;
+    }
+
+    if (p_run->run_count > 1 && object_run_split(p_run, index + 1) == NULL)
+        return NULL;
+
+    struct object* _Owner _Opt p_element = object_run_make_element(p_run, index);
+    if (p_element == NULL)
+        return NULL;
+
+    /*the element takes the place of the run of one element*/
+    object_swap(p_run, p_element);
+    object_fix_parent(p_run, p_run);
+
+    p_run->next = p_element->next;
+    p_element->next = NULL;
+    object_delete(p_element);
+
+    return p_run;
+}
+
+struct object object_run_value(const struct object* p_run, size_t index)
+{
+    assert(object_is_run(p_run));
+    assert(index - p_run->run_index < p_run->run_count);
+
+    struct object r = { 0 };
+    r.state = p_run->state;
+    r.value_type = p_run->value_type;
+
+    if (p_run->run_values)
+        r.value.host_u_long_long = object_run_load(p_run, index - p_run->run_index);
+    else
+        r.value = p_run->value;
+
+    return r;
+}
+
+int object_get_element_value(const struct object* p_array, size_t index, struct object* p_value)
+{
+    p_array = object_get_referenced(p_array);
+
+    const struct object* _Opt p_member = object_find_member(p_array, index, NULL);
+    if (p_member == NULL ||
+        !object_is_run(p_member) ||
+        !type_is_arithmetic(&p_member->type))
+    {
+        return 1;
+    }
+
+    *p_value = object_run_value(p_member, index);
+    return 0;
+}
+
+int object_set_element_value(struct object* p_array, size_t index, const struct object* p_value, bool is_constant)
+{
+    p_array = object_get_non_const_referenced(p_array);
+    p_value = object_get_referenced(p_value);
+
+    /*only values of constant expressions are packed*/
+    if (p_value->state != CONSTANT_VALUE_STATE_CONSTANT)
+        return 1;
+
+    struct object* _Opt p_previous = NULL;
+    struct object* _Opt p_member = object_find_member(p_array, index, &p_previous);
+    if (p_member == NULL ||
+        !object_is_run(p_member) ||
+        !object_run_can_pack(p_member))
+    {
+        return 1;
+    }
+
+    const enum object_value_state state =
+        is_constant ? CONSTANT_VALUE_STATE_CONSTANT : CONSTANT_VALUE_EQUAL;
+
+    const unsigned long long value =
+        object_cast(p_member->run_target, p_member->value_type, p_value).value.host_u_long_long;
+
+    if (p_member->run_values)
+    {
+        if (p_member->state != state)
+            return 1;
+        object_run_store(p_member, index - p_member->run_index, value);
+        return 0;
+    }
+
+    if (p_previous &&
+        p_previous->run_values &&
+        p_previous->state == state &&
+        index == p_member->run_index)
+    {
+        /*the element moves from the run to the end of the packed run before it*/
+        if (object_run_reserve(p_previous, p_previous->run_count + 1) != 0)
+            return 1;
+
+        object_run_store(p_previous, p_previous->run_count, value);
+        p_previous->run_count++;
+
+        p_member->run_index++;
+        p_member->run_count--;
+        if (p_member->run_count == 0)
+        {
+            if (p_array->members.tail == p_member)
+                p_array->members.tail = p_previous;
+
+            p_previous->next = p_member->next;
+            p_member->next = NULL;
+            object_delete(p_member);
+        }
+        return 0;
+    }
+
+    /*the element becomes a packed run of one element*/
+    if (index > p_member->run_index)
+    {
+        p_member = object_run_split(p_member, index);
+        if (p_member == NULL)
+            return 1;
+    }
+
+    if (p_member->run_count > 1 && object_run_split(p_member, index + 1) == NULL)
+        return 1;
+
+    p_member->run_value_size = target_get_num_of_bits(p_member->run_target, p_member->value_type) / 8;
+    if (object_run_reserve(p_member, 1) != 0)
+        return 1;
+
+    object_run_store(p_member, 0, value);
+    p_member->state = state;
+    return 0;
+}
+
 enum type_specifier_flags object_type_to_type_specifier(enum object_type type)
 {
     switch (type)
@@ -1537,55 +1977,55 @@ void object_print_value_debug(const struct object* a)
     switch (a->value_type)
     {
     case TYPE_SIGNED_CHAR:
-        printf("%lld (signed char)", a->value.host_long_long);
+        console_printf("%lld (signed char)", a->value.host_long_long);
         break;
 
 
     case TYPE_UNSIGNED_CHAR:
-        printf("%llu (unsigned char)", a->value.host_u_long_long);
+        console_printf("%llu (unsigned char)", a->value.host_u_long_long);
         break;
 
 
     case TYPE_SIGNED_SHORT:
-        printf("%lld (short)", a->value.host_long_long);
+        console_printf("%lld (short)", a->value.host_long_long);
         break;
 
     case TYPE_UNSIGNED_SHORT:
-        printf("%llu (unsigned short)", a->value.host_u_long_long);
+        console_printf("%llu (unsigned short)", a->value.host_u_long_long);
         break;
 
     case TYPE_SIGNED_INT:
-        printf("%lld (int)", a->value.host_long_long);
+        console_printf("%lld (int)", a->value.host_long_long);
         break;
 
     case TYPE_UNSIGNED_INT:
-        printf("%llu (unsigned int)", a->value.host_u_long_long);
+        console_printf("%llu (unsigned int)", a->value.host_u_long_long);
         break;
 
     case TYPE_SIGNED_LONG:
-        printf("%lld (long)", a->value.host_long_long);
+        console_printf("%lld (long)", a->value.host_long_long);
         break;
 
     case TYPE_UNSIGNED_LONG:
-        printf("%llu (unsigned long)", a->value.host_u_long_long);
+        console_printf("%llu (unsigned long)", a->value.host_u_long_long);
         break;
 
     case TYPE_SIGNED_LONG_LONG:
-        printf("%lld (long long)", a->value.host_long_long);
+        console_printf("%lld (long long)", a->value.host_long_long);
         break;
     case TYPE_UNSIGNED_LONG_LONG:
-        printf("%llu (unsigned long long)", a->value.host_u_long_long);
+        console_printf("%llu (unsigned long long)", a->value.host_u_long_long);
         break;
     case TYPE_FLOAT:
-        printf("%Lf (float)", a->value.host_long_double);
+        console_printf("%Lf (float)", a->value.host_long_double);
         break;
 
     case TYPE_DOUBLE:
-        printf("%Lf (double)", a->value.host_long_double);
+        console_printf("%Lf (double)", a->value.host_long_double);
         break;
 
     case TYPE_LONG_DOUBLE:
-        printf("%Lf (long double)", a->value.host_long_double);
+        console_printf("%Lf (long double)", a->value.host_long_double);
         break;
 
     }
@@ -1601,16 +2041,21 @@ void object_print_to_debug_core(const struct object* object, int n, enum target
     }
 
 
-    for (int i = 0; i < n; i++) printf("  ");
+    for (int i = 0; i < n; i++) console_printf("  ");
     if (object->member_designator)
-        printf("%s ", object->member_designator);
+        console_printf("%s", object->member_designator);
+
+    if (object_is_run(object))
+        console_printf("[%zu..%zu]%s", object->run_index, object->run_index + object->run_count - 1, object->run_values ? " packed" : "");
+
+    console_printf(" ");
 
     if (object->members.head != NULL)
     {
 
         type_print(&object->type, target);
 
-        printf(" {\n");
+        console_printf(" {\n");
 
         struct object* _Opt member = object->members.head;
         while (member)
@@ -1619,28 +2064,28 @@ void object_print_to_debug_core(const struct object* object, int n, enum target
             member = member->next;
         }
 
-        for (int i = 0; i < n; i++) printf("  ");
-        printf("}\n");
+        for (int i = 0; i < n; i++) console_printf("  ");
+        console_printf("}\n");
     }
     else
     {
 
         type_print(&object->type, target);
 
-        printf(" = ");
+        console_printf(" = ");
 
         object_print_value_debug(object);
 
         switch (object->state)
         {
-        case CONSTANT_VALUE_STATE_UNINITIALIZED: printf(" uninitialized "); break;
-        case CONSTANT_VALUE_STATE_ANY:printf(" unknown "); break;
-        case CONSTANT_VALUE_EQUAL:printf(" exact "); break;
-        case CONSTANT_VALUE_STATE_CONSTANT:printf(" constant_exact "); break;
-        case CONSTANT_VALUE_NOT_EQUAL:printf(" not_equal "); break;
+        case CONSTANT_VALUE_STATE_UNINITIALIZED: console_printf(" uninitialized "); break;
+        case CONSTANT_VALUE_STATE_ANY:console_printf(" unknown "); break;
+        case CONSTANT_VALUE_EQUAL:console_printf(" exact "); break;
+        case CONSTANT_VALUE_STATE_CONSTANT:console_printf(" constant_exact "); break;
+        case CONSTANT_VALUE_NOT_EQUAL:console_printf(" not_equal "); break;
         }
 
-        printf("\n");
+        console_printf("\n");
     }
 
 }
@@ -1652,33 +2097,68 @@ void object_print_to_debug(const struct object* object, enum target target)
 }
 
 
-/*
-   extends the array to the max_index returning the added item.
-*/
-struct object* object_extend_array_to_index(const struct type* p_type, struct object* a, size_t max_index, bool is_constant, enum target target)
+int object_extend_array(const struct type* p_type, struct object* a, size_t max_index, bool is_constant, enum target target)
 {
-    try
+    if (a->members.count >= max_index + 1)
+        return 0;
+
+    const size_t count = max_index + 1 - a->members.count;
+    const enum object_value_state state =
+        is_constant ? CONSTANT_VALUE_STATE_CONSTANT : CONSTANT_VALUE_EQUAL;
+
+    /*a run at the tail may have been split*/
+    struct object* _Opt p_tail = a->members.tail;
+    while (p_tail && p_tail->next)
+        p_tail = p_tail->next;
+    a->members.tail = p_tail;
+
+    if (p_tail && object_is_run(p_tail) && p_tail->state == state)
     {
-        for (size_t count = a->members.count; count < (max_index + 1); count++)
+        if (p_tail->run_values == NULL)
         {
-            char name[50] = { 0 };
-            snprintf(name, sizeof name, "[%zu]", count);
-
-            struct object* _Owner _Opt p = make_object_ptr_core(p_type, name, target);
-            if (p == NULL)
-                throw;
+            /*default values, the run just grows*/
+            p_tail->run_count += count;
+            a->members.count += count;
+            return 0;
+        }
 
-            p->parent = a;
-            object_default_initialization(p, is_constant);
-            object_list_push(&a->members, p);
+        if (count == 1)
+        {
+            if (object_run_reserve(p_tail, p_tail->run_count + 1) != 0)
+                return ENOMEM;
+            object_run_store(p_tail, p_tail->run_count, 0);
+            p_tail->run_count++;
+            a->members.count++;
+            return 0;
         }
     }
-    catch
-    {
 
-    }
+    struct object* _Owner _Opt p_run =
+        object_run_new(p_type,
+                       a->member_designator,
+                       a->members.count,
+                       count,
+                       state,
+                       target);
+
+    if (p_run == NULL)
+        return ENOMEM;
+
+    p_run->parent = a;
+    object_list_push(&a->members, p_run);
+    return 0;
+}
+
+/*
+   extends the array to the max_index returning the item max_index.
+   The new items are a run.
+*/
+struct object* _Opt object_extend_array_to_index(const struct type* p_type, struct object* a, size_t max_index, bool is_constant, enum target target)
+{
+    if (object_extend_array(p_type, a, max_index, is_constant, target) != 0)
+        return NULL;
 
-    return a->members.tail;
+    return object_get_member(a, max_index);
 }
 
 
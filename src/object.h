@@ -43,6 +43,8 @@ enum object_value_state
 struct object_list
 {
     struct object* _Owner _Opt head, * _Opt tail;
+
+    /*number of members, a run counts as run_count members*/
     size_t count;
 };
 
@@ -69,6 +71,26 @@ struct object
     struct expression* _Opt p_init_expression;
     struct object_list members;
     struct object* _Opt _Owner next;
+
+    /*
+      Array elements are created when they are used. Until then, a run
+      stands for run_count elements, from run_index, that have the state of
+      the run and no initializer. The type of the run is the element type
+      and member_designator is the one of the array.
+    */
+    size_t run_index;
+    size_t run_count;
+    enum target run_target;
+
+    /*
+      Arrays of integers keep the values set by constant initializers
+      packed. When run_values is not NULL, the element run_index + i has
+      the value stored at run_values + i * run_value_size (the size of
+      value_type) and all elements have the state of the run.
+    */
+    unsigned char* _Owner _Opt run_values;
+    size_t run_values_capacity;
+    int run_value_size;
 };
 
 void object_swap(struct object* a, struct object* b);
@@ -169,7 +191,35 @@ enum object_type type_to_object_type(const struct type* type, enum target target
 
 void object_print_to_debug(const struct object* object, enum target target);
 
-struct object* object_extend_array_to_index(const struct type* p_type, struct object* a, size_t n, bool is_constant, enum target target);
+struct object* _Opt object_extend_array_to_index(const struct type* p_type, struct object* a, size_t n, bool is_constant, enum target target);
+
+bool object_is_run(const struct object* p_object);
+
+/*creates a copy of the element index of the run, the run is not changed*/
+struct object* _Owner _Opt object_run_make_element(const struct object* p_run, size_t index);
+
+/*creates the element index of the run, splitting the run, and returns it*/
+struct object* _Opt object_run_take(struct object* p_run, size_t index);
+
+/*value of the element index of the run, the element is not created*/
+struct object object_run_value(const struct object* p_run, size_t index);
+
+/*
+  Value of the element index of the array when it is an integer or
+  floating element inside a run. The element is not created.
+  Returns 0 on success.
+*/
+int object_get_element_value(const struct object* p_array, size_t index, struct object* p_value);
+
+/*
+  Stores the value of a constant expression in the element index of an
+  array of integers, packed, without creating the element. Returns 0 on
+  success; otherwise the element is an object and object_set must be used.
+*/
+int object_set_element_value(struct object* p_array, size_t index, const struct object* p_value, bool is_constant);
+
+/*extends the array to max_index + 1 elements, the new elements are a run*/
+int object_extend_array(const struct type* p_type, struct object* a, size_t max_index, bool is_constant, enum target target);
 struct object* object_get_non_const_referenced(struct object* p_object);
 
 
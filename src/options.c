@@ -8,6 +8,7 @@
 #include "options.h"
 #include <string.h>
 #include "console.h"
+#include "thread.h"
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -254,6 +255,30 @@ int fill_options(struct options* options,
             continue;
         }
 
+        if (strcmp(argv[i], "-no-arena") == 0)
+        {
+            options->no_arena = true;
+            continue;
+        }
+
+        if (strncmp(argv[i], "-j", 2) == 0)
+        {
+            if (argv[i][2] == '\0')
+            {
+                options->jobs = hardware_concurrency();
+            }
+            else
+            {
+                options->jobs = atoi(argv[i] + 2);
+                if (options->jobs < 1)
+                {
+                    printf("invalid number of jobs '%s'\n", argv[i]);
+                    return 1;
+                }
+            }
+            continue;
+        }
+
         if (strcmp(argv[i], "-o") == 0)
         {
             if (i + 1 < argc)
@@ -268,6 +293,154 @@ int fill_options(struct options* options,
             continue;
         }
 
+        if (strcmp(argv[i], "-emit-pch") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                snprintf(options->emit_pch, sizeof options->emit_pch, "%s", argv[i + 1]);
+                i++;
+            }
+            else
+            {
+                printf("missing file name after '-emit-pch'\n");
+                return 1;
+            }
+            continue;
+        }
+
+        if (strcmp(argv[i], "-include-pch") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                snprintf(options->include_pch, sizeof options->include_pch, "%s", argv[i + 1]);
+                i++;
+            }
+            else
+            {
+                printf("missing file name after '-include-pch'\n");
+                return 1;
+            }
+            continue;
+        }
+
+        if (strcmp(argv[i], "-cache-dir") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                snprintf(options->cache_dir, sizeof options->cache_dir, "%s", argv[i + 1]);
+                i++;
+            }
+            else
+            {
+                printf("missing directory name after '-cache-dir'\n");
+                return 1;
+            }
+            continue;
+        }
+
+        if (strcmp(argv[i], "-cache-size") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                options->cache_size_mb = atoi(argv[i + 1]);
+                i++;
+            }
+            else
+            {
+                printf("missing size after '-cache-size'\n");
+                return 1;
+            }
+            continue;
+        }
+
+        if (strcmp(argv[i], "-MD") == 0)
+        {
+            options->dependency_file = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "-MF") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                snprintf(options->dependency_file_name, sizeof options->dependency_file_name, "%s", argv[i + 1]);
+                options->dependency_file = true;
+                i++;
+            }
+            else
+            {
+                printf("missing file name after '-MF'\n");
+                return 1;
+            }
+            continue;
+        }
+
+        if (strcmp(argv[i], "-MT") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                snprintf(options->dependency_target, sizeof options->dependency_target, "%s", argv[i + 1]);
+                i++;
+            }
+            else
+            {
+                printf("missing target after '-MT'\n");
+                return 1;
+            }
+            continue;
+        }
+
+        if (strcmp(argv[i], "-ftime-report") == 0)
+        {
+            options->time_report = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "-ftime-report-json") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                snprintf(options->time_report_json, sizeof options->time_report_json, "%s", argv[i + 1]);
+                i++;
+            }
+            else
+            {
+                printf("missing file name after '-ftime-report-json'\n");
+                return 1;
+            }
+            continue;
+        }
+
+        if (strcmp(argv[i], "-ftime-report-top") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                options->time_report_top = atoi(argv[i + 1]);
+                i++;
+            }
+            else
+            {
+                printf("missing number after '-ftime-report-top'\n");
+                return 1;
+            }
+            continue;
+        }
+
+        if (strcmp(argv[i], "-ftime-trace") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                snprintf(options->time_trace, sizeof options->time_trace, "%s", argv[i + 1]);
+                i++;
+            }
+            else
+            {
+                printf("missing file name after '-ftime-trace'\n");
+                return 1;
+            }
+            continue;
+        }
+
         if (strcmp(argv[i], "-sarif-path") == 0)
         {
             if (i + 1 < argc)
@@ -294,6 +467,12 @@ int fill_options(struct options* options,
             continue;
         }
 
+        if (strcmp(argv[i], "-line-markers") == 0)
+        {
+            options->line_markers = true;
+            continue;
+        }
+
         if (strcmp(argv[i], "-S") == 0)
         {
             options->asm_output = true;
@@ -596,9 +775,23 @@ void print_help()
     print_option("-I", "Adds a directory to the list of directories searched for include files");
     print_option("-auto-config", "Generates cakeconfig.h with include directories");
     print_option("-no-output", "Cake will not generate output");
+    print_option("-no-arena", "Tokens and expressions are released one by one (no arena per file)");
+    print_option("-jN", "Compiles N files in parallel. -j uses one thread per core");
     print_option("-D", "Defines a preprocessing symbol for a source file");
     print_option("-E", "Copies preprocessor output to standard output");
+    print_option("-line-markers", "Adds #line directives to the -E output");
     print_option("-o name", "Defines the output name when compiling one file");
+    print_option("-emit-pch file", "Saves the preprocessed header and macros as precompiled header");
+    print_option("-include-pch file", "Uses the precompiled header instead of preprocessing it");
+    print_option("-cache-dir dir", "Saves the results and uses them again for files that did not change");
+    print_option("-cache-size N", "Maximum size of the cache in megabytes (default 1024)");
+    print_option("-MD", "Writes a make dependency file with the files used");
+    print_option("-MF file", "Name of the dependency file");
+    print_option("-MT target", "Target of the rule in the dependency file");
+    print_option("-ftime-report", "Prints the time of each phase and counters for each file");
+    print_option("-ftime-report-json file", "Writes the time report as json");
+    print_option("-ftime-report-top N", "Prints the N include files and macros that took more time");
+    print_option("-ftime-trace file", "Writes include files and macros as chrome trace events");
     print_option("-no-discard", "Makes [[nodiscard]] default implicitly");
     print_option("-w -wd", "Enables or disable warning number");
     print_option("-wall", "Enables all warnings");
@@ -220,6 +220,7 @@ enum diagnostic_id {
     C_ERROR_ARGUMENT_SIZE_SMALLER_THAN_PARAMETER_SIZE = 1130,
     C_ERROR_TOKEN_NOT_VALID_IN_PREPROCESSOR_EXPRESSIONS = 1140,
     C_ERROR_FILE_NOT_FOUND = 1150,
+    C_ERROR_PRECOMPILED_HEADER_REJECTED = 1151,
     C_ERROR_MISSING_CLOSE_PARENTHESIS = 1160,
     C_ERROR_EXPRESSION_ERROR = 1170,
     C_ERROR_PREPROCESSOR_C_ERROR_DIRECTIVE = 1180,
@@ -401,6 +402,12 @@ struct options
     */
     bool preprocess_only;
 
+    /*
+      -line-markers
+      -E output has #line directives with the original file and line
+    */
+    bool line_markers;
+
 
 
     /*
@@ -469,6 +476,88 @@ struct options
     */
     bool asm_output;
 
+    /*
+      -no-arena
+      tokens and expressions are allocated and released one by one
+      instead of using one arena per file
+    */
+    bool no_arena;
+
+    /*
+      -jN
+      number of files compiled in parallel. -j uses one thread per core.
+      0 or 1 compiles one file at a time.
+    */
+    int jobs;
+
+    /*
+      -emit-pch filename
+      preprocesses the input header and saves the tokens and the
+      preprocessor state at filename. Nothing else is generated.
+    */
+    char emit_pch[200];
+
+    /*
+      -include-pch filename
+      the header saved with -emit-pch is not preprocessed when included
+    */
+    char include_pch[200];
+
+    /*
+      -cache-dir dir
+      results of parse and flow analysis are saved at dir and used
+      again when the options and the preprocessed tokens are the same
+    */
+    char cache_dir[200];
+
+    /*
+      -cache-size N
+      maximum size of the cache in megabytes (default 1024)
+    */
+    int cache_size_mb;
+
+    /*
+      -MD
+      writes a make rule with the files used by each source file
+    */
+    bool dependency_file;
+
+    /*
+      -MF filename
+      name of the dependency file (implies -MD)
+    */
+    char dependency_file_name[200];
+
+    /*
+      -MT target
+      target of the make rule. The default is the output file
+    */
+    char dependency_target[200];
+
+    /*
+      -ftime-report
+      prints the time of each phase and some counters for each file
+    */
+    bool time_report;
+
+    /*
+      -ftime-report-json filename
+      writes the same report as json
+    */
+    char time_report_json[200];
+
+    /*
+      -ftime-report-top N
+      prints the N include files and macros that took more time
+    */
+    int time_report_top;
+
+    /*
+      -ftime-trace filename
+      writes the include files and macros as chrome trace events
+    */
+    char time_trace[200];
+
     /*
       -o filename
       defines the ouputfile when 1 file is used
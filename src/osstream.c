@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
 #include "ownership.h"
 
 void ss_swap(_View struct osstream* a, _View struct osstream* b)
@@ -38,12 +39,17 @@ static int reserve(struct osstream* stream, int size)
     int errorcode = 0;
     if (size > stream->capacity)
     {
-        void* _Owner _Opt pnew = realloc(stream->c_str, (size + 1) * sizeof(char));
+        /*grows geometrically, large outputs are built one value at a time*/
+        int n = size;
+        if (stream->capacity < INT_MAX / 2 && stream->capacity * 2 > n)
+            n = stream->capacity * 2;
+
+        void* _Owner _Opt pnew = realloc(stream->c_str, (n + 1) * sizeof(char));
         if (pnew)
         {
             static_set(stream->c_str, "moved");
             stream->c_str = pnew;
-            stream->capacity = size;
+            stream->capacity = n;
             stream->c_str[size] = 0;
         }
         else
@@ -81,6 +87,13 @@ int ss_vafprintf(struct osstream* stream, const char* fmt, va_list args)
         return -1;
     }
 
+    if (size < stream->capacity - stream->size)
+    {
+        /*it was written*/
+        stream->size += size;
+        return size;
+    }
+
     if (reserve(stream, stream->size + size) != 0)
     {
         return -1;
@@ -105,6 +118,7 @@ int ss_putc(char ch, struct osstream* stream)
     }
     stream->c_str[stream->size] = ch;
     stream->size++;
+    stream->c_str[stream->size] = 0;
 
     return ch;
 }
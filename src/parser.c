@@ -21,6 +21,7 @@
 #include <ctype.h>
 #include "flow.h"
 #include "visit_defer.h"
+#include "time_report.h"
 #include <errno.h>
 
 #ifdef _WIN32
@@ -162,6 +163,115 @@ void scope_destroy(_Dtor struct scope* p)
     hashmap_destroy(&p->variables);
 }
 
+void scope_list_destroy(_Dtor struct scope_list* list)
+{
+    free(list->bindings);
+    hashmap_destroy(&list->variables);
+    hashmap_destroy(&list->tags);
+}
+
+/*
+  Makes p_entry of p_scope the visible declaration of its name.
+  map is the variables or tags of the scope list.
+*/
+static void scope_list_bind(struct scope_list* list, struct hash_map* map, struct map_entry* p_entry, struct scope* p_scope)
+{
+    struct map_entry* _Opt p_top = hashmap_find_atom(map, p_entry->key);
+    if (p_top == NULL)
+    {
+        struct hash_item_set item = { 0 };
+        hashmap_set(map, p_entry->key, &item);
+        hash_item_set_destroy(&item);
+
+        p_top = hashmap_find_atom(map, p_entry->key);
+        if (p_top == NULL)
+            return;
+    }
+
+    if (list->bindings_size == list->bindings_capacity)
+    {
+        const int new_capacity = list->bindings_capacity == 0 ? 256 : list->bindings_capacity * 2;
+        void* _Owner _Opt pnew = realloc(list->bindings, new_capacity * sizeof(struct binding));
+        if (pnew == NULL)
+            return;
+        static_set(list->bindings, "moved");
+        list->bindings = pnew;
+        list->bindings_capacity = new_capacity;
+    }
+
+    assert(list->bindings != NULL);
+    struct binding* p_binding = &list->bindings[list->bindings_size];
+    p_binding->p_entry = p_entry;
+    p_binding->p_scope = p_scope;
+    p_binding->p_top = p_top;
+    p_binding->shadowed = (int)p_top->data.number - 1;
+
+    list->bindings_size++;
+    p_top->data.number = (size_t)list->bindings_size;
+}
+
+static void scope_list_bind_all(struct scope_list* list, struct hash_map* map, struct hash_map* scope_map, struct scope* p_scope)
+{
+    if (scope_map->table == NULL)
+        return;
+
+    for (int i = 0; i < scope_map->capacity; i++)
+    {
+        struct map_entry* _Opt p_entry = scope_map->table[i];
+        if (p_entry)
+            scope_list_bind(list, map, p_entry, p_scope);
+    }
+}
+
+static int scope_list_set(struct scope_list* list, struct hash_map* map, struct hash_map* scope_map, const char* key, struct hash_item_set* item)
+{
+    assert(list->tail != NULL);
+
+    const int result = hashmap_set(scope_map, key, item);
+    if (result == 0)
+    {
+        /*new name in this scope, an existing one is already bound*/
+        struct map_entry* _Opt p_entry = hashmap_find(scope_map, key);
+        if (p_entry)
+            scope_list_bind(list, map, p_entry, list->tail);
+    }
+    return result;
+}
+
+int scope_list_set_variable(struct scope_list* list, const char* key, struct hash_item_set* item)
+{
+    assert(list->tail != NULL);
+    return scope_list_set(list, &list->variables, &list->tail->variables, key, item);
+}
+
+int scope_list_set_tag(struct scope_list* list, const char* key, struct hash_item_set* item)
+{
+    assert(list->tail != NULL);
+    return scope_list_set(list, &list->tags, &list->tail->tags, key, item);
+}
+
+/*
+  Returns the visible binding of atom, NULL if it is not declared
+*/
+static struct binding* _Opt scope_list_find(const struct scope_list* list, const struct hash_map* map, const char* atom)
+{
+    const struct map_entry* _Opt p_top = hashmap_find_atom(map, atom);
+    if (p_top == NULL || p_top->data.number == 0)
+        return NULL;
+
+    assert(list->bindings != NULL);
+    return &list->bindings[p_top->data.number - 1];
+}
+
+static struct binding* _Opt scope_list_shadowed(const struct scope_list* list, const struct binding* p_binding)
+{
+    if (p_binding->shadowed < 0)
+        return NULL;
+
+    assert(list->bindings != NULL);
+    return &list->bindings[p_binding->shadowed];
+}
+
 void scope_list_push(struct scope_list* list, struct scope* pnew)
 {
     if (list->tail)
@@ -180,6 +290,11 @@ void scope_list_push(struct scope_list* list, struct scope* pnew)
         list->tail->next = pnew;
         list->tail = pnew;
     }
+
+    /*parameters scope is pushed again for the function body*/
+    pnew->bindings_start = list->bindings_size;
+    scope_list_bind_all(list, &list->variables, &pnew->variables, pnew);
+    scope_list_bind_all(list, &list->tags, &pnew->tags, pnew);
 }
 
 void scope_list_pop(struct scope_list* list)
@@ -189,6 +304,16 @@ void scope_list_pop(struct scope_list* list)
         return;
     assert(list->tail != NULL);
     struct scope* p = list->tail;
+
+    /*names of this scope are not visible anymore*/
+    while (list->bindings_size > p->bindings_start)
+    {
+        assert(list->bindings != NULL);
+        list->bindings_size--;
+        struct binding* p_binding = &list->bindings[list->bindings_size];
+        p_binding->p_top->data.number = (size_t)(p_binding->shadowed + 1);
+    }
+
     if (list->head == list->tail)
     {
         list->head = NULL;
@@ -210,6 +335,10 @@ void scope_list_pop(struct scope_list* list)
 
 void parser_ctx_destroy(_Opt _Dtor struct parser_ctx* ctx)
 {
+    free(ctx->final_tokens);
+
+    scope_list_destroy(&ctx->scopes);
+
     label_list_clear(&ctx->label_list);
     assert(ctx->label_list.head == NULL);
     assert(ctx->label_list.tail == NULL);
@@ -382,42 +511,42 @@ _Bool compiler_diagnostic(enum diagnostic_id w,
     if (ctx->options.visual_studio_ouput_format)
     {
         if (is_error)
-            printf("error %d: ", w);
+            console_printf("error %d: ", w);
         else if (is_warning)
-            printf("warning %d: ", w);
+            console_printf("warning %d: ", w);
         else if (is_note)
-            printf("note: ");
+            console_printf("note: ");
         else if (is_location)
-            printf(": ");
+            console_printf(": ");
 
-        printf("%s", buffer);
+        console_printf("%s", buffer);
     }
     else
     {
         if (is_error)
         {
             if (color_enabled)
-                printf(LIGHTRED "error " WHITE "%d: %s" COLOR_RESET, w, buffer);
+                console_printf(LIGHTRED "error " WHITE "%d: %s" COLOR_RESET, w, buffer);
             else
-                printf("error "        "%d: %s", w, buffer);
+                console_printf("error "        "%d: %s", w, buffer);
         }
         else if (is_warning)
         {
             if (color_enabled)
-                printf(LIGHTMAGENTA "warning " WHITE "%d: %s" COLOR_RESET, w, buffer);
+                console_printf(LIGHTMAGENTA "warning " WHITE "%d: %s" COLOR_RESET, w, buffer);
             else
-                printf("warning "  "%d: %s", w, buffer);
+                console_printf("warning "  "%d: %s", w, buffer);
         }
         else if (is_note || is_location)
         {
             if (color_enabled)
-                printf(LIGHTCYAN "note: " WHITE "%s" COLOR_RESET, buffer);
+                console_printf(LIGHTCYAN "note: " WHITE "%s" COLOR_RESET, buffer);
             else
-                printf("note: " "%s", buffer);
+                console_printf("note: " "%s", buffer);
         }
     }
 
-    printf("\n");
+    console_printf("\n");
     print_line_and_token(&marker, color_enabled);
 
 
@@ -486,7 +615,7 @@ _Bool compiler_diagnostic(enum diagnostic_id w,
 
 void print_scope(struct scope_list* e)
 {
-    printf("--- begin of scope---\n");
+    console_printf("--- begin of scope---\n");
     struct scope* _Opt p = e->head;
     int level = 0;
     while (p)
@@ -498,8 +627,8 @@ void print_scope(struct scope_list* e)
                 if (p->variables.table[i])
                 {
                     for (int k = 0; k < level; k++)
-                        printf(" ");
-                    printf("%s\n", p->variables.table[i]->key);
+                        console_printf(" ");
+                    console_printf("%s\n", p->variables.table[i]->key);
                 }
             }
 
@@ -508,8 +637,8 @@ void print_scope(struct scope_list* e)
                 if (p->tags.table[i])
                 {
                     for (int k = 0; k < level; k++)
-                        printf(" ");
-                    printf("tag %s\n", p->tags.table[i]->key);
+                        console_printf(" ");
+                    console_printf("tag %s\n", p->tags.table[i]->key);
                 }
             }
         }
@@ -517,7 +646,7 @@ void print_scope(struct scope_list* e)
         level++;
         p = p->next;
     }
-    printf("--- end of scope---\n");
+    console_printf("--- end of scope---\n");
 }
 
 
@@ -642,17 +771,13 @@ bool first_of_type_qualifier(const struct parser_ctx* ctx)
 
 struct map_entry* _Opt find_tag(struct parser_ctx* ctx, const char* lexeme)
 {
-    struct scope* _Opt scope = ctx->scopes.tail;
-    while (scope)
-    {
-        struct map_entry* _Opt p_entry = hashmap_find(&scope->tags, lexeme);
-        if (p_entry)
-        {
-            return p_entry;
-        }
-        scope = scope->previous;
-    }
-    return NULL;
+    /*lexeme is interned once, then the binding stack gives the visible tag*/
+    const char* _Opt atom = atom_find(lexeme);
+    if (atom == NULL)
+        return NULL;
+
+    const struct binding* _Opt p_binding = scope_list_find(&ctx->scopes, &ctx->scopes.tags, atom);
+    return p_binding ? p_binding->p_entry : NULL;
 }
 
 struct map_entry* _Opt find_variables(const struct parser_ctx* ctx, const char* lexeme, struct scope* _Opt* _Opt ppscope_opt)
@@ -660,30 +785,32 @@ struct map_entry* _Opt find_variables(const struct parser_ctx* ctx, const char*
     if (ppscope_opt != NULL)
         *ppscope_opt = NULL; // out
 
-    struct scope* _Opt scope = ctx->scopes.tail;
-    while (scope)
-    {
-        struct map_entry* _Opt p_entry = hashmap_find(&scope->variables, lexeme);
-        if (p_entry)
-        {
-            if (ppscope_opt)
-                *ppscope_opt = scope;
-            return p_entry;
-        }
-        scope = scope->previous;
-    }
-    return NULL;
+    /*lexeme is interned once, then the binding stack gives the visible declaration*/
+    const char* _Opt atom = atom_find(lexeme);
+    if (atom == NULL)
+        return NULL;
+
+    const struct binding* _Opt p_binding = scope_list_find(&ctx->scopes, &ctx->scopes.variables, atom);
+    if (p_binding == NULL)
+        return NULL;
+
+    if (ppscope_opt)
+        *ppscope_opt = p_binding->p_scope;
+    return p_binding->p_entry;
 }
 
 struct enum_specifier* _Opt find_enum_specifier(struct parser_ctx* ctx, const char* lexeme)
 {
     struct enum_specifier* _Opt best = NULL;
-    struct scope* _Opt scope = ctx->scopes.tail;
-    while (scope)
+    const char* _Opt atom = atom_find(lexeme);
+    if (atom == NULL)
+        return NULL;
+
+    const struct binding* _Opt p_binding = scope_list_find(&ctx->scopes, &ctx->scopes.tags, atom);
+    while (p_binding)
     {
-        struct map_entry* _Opt p_entry = hashmap_find(&scope->tags, lexeme);
-        if (p_entry &&
-            p_entry->type == TAG_TYPE_ENUM_SPECIFIER)
+        const struct map_entry* p_entry = p_binding->p_entry;
+        if (p_entry->type == TAG_TYPE_ENUM_SPECIFIER)
         {
             assert(p_entry->data.p_enum_specifier != NULL);
 
@@ -695,7 +822,7 @@ struct enum_specifier* _Opt find_enum_specifier(struct parser_ctx* ctx, const ch
                 /* not complete, keep searching up the scope chain */
             }
         }
-        scope = scope->previous;
+        p_binding = scope_list_shadowed(&ctx->scopes, p_binding);
     }
     return best; /* return even if not complete */
 }
@@ -703,18 +830,21 @@ struct enum_specifier* _Opt find_enum_specifier(struct parser_ctx* ctx, const ch
 struct struct_or_union_specifier* _Opt find_struct_or_union_specifier(const struct parser_ctx* ctx, const char* lexeme)
 {
     struct struct_or_union_specifier* _Opt p = NULL;
-    struct scope* _Opt scope = ctx->scopes.tail;
-    while (scope)
+    const char* _Opt atom = atom_find(lexeme);
+    if (atom == NULL)
+        return NULL;
+
+    const struct binding* _Opt p_binding = scope_list_find(&ctx->scopes, &ctx->scopes.tags, atom);
+    while (p_binding)
     {
-        struct map_entry* _Opt p_entry = hashmap_find(&scope->tags, lexeme);
-        if (p_entry &&
-            p_entry->type == TAG_TYPE_STRUCT_OR_UNION_SPECIFIER)
+        const struct map_entry* p_entry = p_binding->p_entry;
+        if (p_entry->type == TAG_TYPE_STRUCT_OR_UNION_SPECIFIER)
         {
             assert(p_entry->data.p_struct_or_union_specifier != NULL);
             p = p_entry->data.p_struct_or_union_specifier;
             break;
         }
-        scope = scope->previous;
+        p_binding = scope_list_shadowed(&ctx->scopes, p_binding);
     }
     return p;
 }
@@ -1004,356 +1134,342 @@ struct token* _Opt previous_parser_token(const struct token* token)
     return prev;
 }
 
+/*
+  Keywords are grouped by length, so each identifier is compared only
+  with the keywords that have the same length.
+*/
 enum token_type is_keyword(const char* text, enum target target)
 {
-    switch (text[0])
+    const bool msvc = target == TARGET_X86_MSVC || target == TARGET_X64_MSVC;
+
+    switch (strlen(text))
     {
-    case 'a':
-        if (strcmp("alignof", text) == 0)
-            return TK_KEYWORD__ALIGNOF;
-        if (strcmp("auto", text) == 0)
-            return TK_KEYWORD_AUTO;
-        if (strcmp("alignas", text) == 0)
-            return TK_KEYWORD__ALIGNAS; /* C23 alternate spelling for _Alignas */
-        if (strcmp("alignof", text) == 0)
-            return TK_KEYWORD__ALIGNAS; /* C23 alternate spelling for _Alignof */
-        if (strcmp("assert", text) == 0)
-            return TK_KEYWORD_ASSERT; /* extension */
-        if (strcmp("asm", text) == 0)
-            return TK_KEYWORD__ASM;
+    case 2:
+        if (memcmp("do", text, 2) == 0)
+            return TK_KEYWORD_DO;
+        if (memcmp("if", text, 2) == 0)
+            return TK_KEYWORD_IF;
         break;
 
-    case 'b':
-        if (strcmp("break", text) == 0)
-            return TK_KEYWORD_BREAK;
-        if (strcmp("bool", text) == 0)
-            return TK_KEYWORD__BOOL; /* C23 alternate spelling for _Bool */
+    case 3:
+        if (memcmp("asm", text, 3) == 0)
+            return TK_KEYWORD__ASM;
+        if (memcmp("for", text, 3) == 0)
+            return TK_KEYWORD_FOR;
+        if (memcmp("int", text, 3) == 0)
+            return TK_KEYWORD_INT;
+        if (memcmp("try", text, 3) == 0)
+            return TK_KEYWORD_CAKE_TRY;
         break;
 
-    case 'c':
-        if (strcmp("case", text) == 0)
+    case 4:
+        if (memcmp("auto", text, 4) == 0)
+            return TK_KEYWORD_AUTO;
+        if (memcmp("bool", text, 4) == 0)
+            return TK_KEYWORD__BOOL; /* C23 alternate spelling for _Bool */
+        if (memcmp("case", text, 4) == 0)
             return TK_KEYWORD_CASE;
-        if (strcmp("char", text) == 0)
+        if (memcmp("char", text, 4) == 0)
             return TK_KEYWORD_CHAR;
-        if (strcmp("const", text) == 0)
-            return TK_KEYWORD_CONST;
-        if (strcmp("constexpr", text) == 0)
-            return TK_KEYWORD_CONSTEXPR;
-        if (strcmp("continue", text) == 0)
-            return TK_KEYWORD_CONTINUE;
-        if (strcmp("catch", text) == 0)
-            return TK_KEYWORD_CAKE_CATCH;
-        break;
-
-    case 'd':
-        if (strcmp("default", text) == 0)
-            return TK_KEYWORD_DEFAULT;
-        if (strcmp("do", text) == 0)
-            return TK_KEYWORD_DO;
-        if (strcmp("defer", text) == 0)
-            return TK_KEYWORD_DEFER;
-        if (strcmp("double", text) == 0)
-            return TK_KEYWORD_DOUBLE;
-        break;
-
-    case 'e':
-        if (strcmp("else", text) == 0)
+        if (memcmp("else", text, 4) == 0)
             return TK_KEYWORD_ELSE;
-        if (strcmp("enum", text) == 0)
+        if (memcmp("enum", text, 4) == 0)
             return TK_KEYWORD_ENUM;
-        if (strcmp("extern", text) == 0)
-            return TK_KEYWORD_EXTERN;
+        if (memcmp("goto", text, 4) == 0)
+            return TK_KEYWORD_GOTO;
+        if (memcmp("long", text, 4) == 0)
+            return TK_KEYWORD_LONG;
+        if (memcmp("true", text, 4) == 0)
+            return TK_KEYWORD_TRUE; /* C23 */
+        if (memcmp("void", text, 4) == 0)
+            return TK_KEYWORD_VOID;
+        if (memcmp("_Opt", text, 4) == 0)
+            return TK_KEYWORD_CAKE_OPT; /* extension */
+        if (memcmp("_asm", text, 4) == 0)
+            return TK_KEYWORD__ASM;
         break;
 
-    case 'f':
-        if (strcmp("float", text) == 0)
+    case 5:
+        if (memcmp("break", text, 5) == 0)
+            return TK_KEYWORD_BREAK;
+        if (memcmp("const", text, 5) == 0)
+            return TK_KEYWORD_CONST;
+        if (memcmp("catch", text, 5) == 0)
+            return TK_KEYWORD_CAKE_CATCH;
+        if (memcmp("defer", text, 5) == 0)
+            return TK_KEYWORD_DEFER;
+        if (memcmp("float", text, 5) == 0)
             return TK_KEYWORD_FLOAT;
-        if (strcmp("for", text) == 0)
-            return TK_KEYWORD_FOR;
-        if (strcmp("false", text) == 0)
+        if (memcmp("false", text, 5) == 0)
             return TK_KEYWORD_FALSE;
+        if (memcmp("short", text, 5) == 0)
+            return TK_KEYWORD_SHORT;
+        if (memcmp("throw", text, 5) == 0)
+            return TK_KEYWORD_CAKE_THROW;
+        if (memcmp("union", text, 5) == 0)
+            return TK_KEYWORD_UNION;
+        if (memcmp("while", text, 5) == 0)
+            return TK_KEYWORD_WHILE;
+        if (memcmp("_Ctor", text, 5) == 0)
+            return TK_KEYWORD__CTOR; /* extension */
+        if (memcmp("_Dtor", text, 5) == 0)
+            return TK_KEYWORD__DTOR; /* extension */
+        if (memcmp("_View", text, 5) == 0)
+            return TK_KEYWORD_CAKE_VIEW; /* extension */
+        if (memcmp("_Bool", text, 5) == 0)
+            return TK_KEYWORD__BOOL;
+        if (memcmp("__asm", text, 5) == 0)
+            return TK_KEYWORD__ASM;
+        if (msvc)
+        {
+            if (memcmp("__try", text, 5) == 0)
+                return TK_KEYWORD_MSVC__TRY;
+        }
         break;
 
-    case 'g':
-        if (strcmp("goto", text) == 0)
-            return TK_KEYWORD_GOTO;
-        break;
-
-    case 'i':
-        if (strcmp("if", text) == 0)
-            return TK_KEYWORD_IF;
-        if (strcmp("inline", text) == 0)
+    case 6:
+        if (memcmp("assert", text, 6) == 0)
+            return TK_KEYWORD_ASSERT; /* extension */
+        if (memcmp("double", text, 6) == 0)
+            return TK_KEYWORD_DOUBLE;
+        if (memcmp("extern", text, 6) == 0)
+            return TK_KEYWORD_EXTERN;
+        if (memcmp("inline", text, 6) == 0)
             return TK_KEYWORD_INLINE;
-        if (strcmp("int", text) == 0)
-            return TK_KEYWORD_INT;
-        break;
-
-    case 'n':
-        if (strcmp("nullptr", text) == 0)
-            return TK_KEYWORD_NULLPTR;
-        break;
-
-    case 'o':
-        if (strcmp("offsetof", text) == 0)
-            return TK_KEYWORD_GCC__BUILTIN_OFFSETOF;
-        break;
-
-    case 'l':
-        if (strcmp("long", text) == 0)
-            return TK_KEYWORD_LONG;
-        break;
-
-    case 'r':
-        if (strcmp("register", text) == 0)
-            return TK_KEYWORD_REGISTER;
-        if (strcmp("restrict", text) == 0)
-            return TK_KEYWORD_RESTRICT;
-        if (strcmp("return", text) == 0)
+        if (memcmp("return", text, 6) == 0)
             return TK_KEYWORD_RETURN;
-        break;
-
-    case 's':
-        if (strcmp("short", text) == 0)
-            return TK_KEYWORD_SHORT;
-        if (strcmp("signed", text) == 0)
+        if (memcmp("signed", text, 6) == 0)
             return TK_KEYWORD_SIGNED;
-        if (strcmp("sizeof", text) == 0)
+        if (memcmp("sizeof", text, 6) == 0)
             return TK_KEYWORD_SIZEOF;
-        if (strcmp("static", text) == 0)
+        if (memcmp("static", text, 6) == 0)
             return TK_KEYWORD_STATIC;
-        if (strcmp("struct", text) == 0)
+        if (memcmp("struct", text, 6) == 0)
             return TK_KEYWORD_STRUCT;
-        if (strcmp("switch", text) == 0)
+        if (memcmp("switch", text, 6) == 0)
             return TK_KEYWORD_SWITCH;
-        if (strcmp("static_assert", text) == 0)
-            return TK_KEYWORD__STATIC_ASSERT; /* C23 alternate spelling for _Static_assert */
-        if (strcmp("static_debug", text) == 0)
-            return TK_KEYWORD_CAKE_STATIC_DEBUG;
-        if (strcmp("static_debug_ex", text) == 0)
-            return TK_KEYWORD_CAKE_STATIC_DEBUG_EX;
-        if (strcmp("static_state", text) == 0)
-            return TK_KEYWORD_STATIC_STATE;
-        if (strcmp("static_set", text) == 0)
-            return TK_KEYWORD_STATIC_SET;
+        if (memcmp("typeof", text, 6) == 0)
+            return TK_KEYWORD_TYPEOF; /* C23 */
+        if (memcmp("_Owner", text, 6) == 0)
+            return TK_KEYWORD_CAKE_OWNER; /* extension */
+        if (memcmp("_Defer", text, 6) == 0)
+            return TK_KEYWORD_DEFER;
+        if (msvc)
+        {
+            if (memcmp("__int8", text, 6) == 0)
+                return TK_KEYWORD_MSVC__INT8;
+        }
         break;
 
-    case 't':
-        if (strcmp("typedef", text) == 0)
+    case 7:
+        if (memcmp("alignof", text, 7) == 0)
+            return TK_KEYWORD__ALIGNOF;
+        if (memcmp("alignas", text, 7) == 0)
+            return TK_KEYWORD__ALIGNAS; /* C23 alternate spelling for _Alignas */
+        if (memcmp("default", text, 7) == 0)
+            return TK_KEYWORD_DEFAULT;
+        if (memcmp("nullptr", text, 7) == 0)
+            return TK_KEYWORD_NULLPTR;
+        if (memcmp("typedef", text, 7) == 0)
             return TK_KEYWORD_TYPEDEF;
-        if (strcmp("typeof", text) == 0)
-            return TK_KEYWORD_TYPEOF; /* C23 */
-        if (strcmp("typeof_unqual", text) == 0)
-            return TK_KEYWORD_TYPEOF_UNQUAL; /* C23 */
-        if (strcmp("true", text) == 0)
-            return TK_KEYWORD_TRUE; /* C23 */
-        if (strcmp("thread_local", text) == 0)
-            return TK_KEYWORD__THREAD_LOCAL; /* C23 alternate spelling for _Thread_local */
-        if (strcmp("try", text) == 0)
-            return TK_KEYWORD_CAKE_TRY;
-        if (strcmp("throw", text) == 0)
-            return TK_KEYWORD_CAKE_THROW;
+        if (memcmp("_Atomic", text, 7) == 0)
+            return TK_KEYWORD__ATOMIC;
+        if (memcmp("_BitInt", text, 7) == 0)
+            return TK_KEYWORD__BITINT; /* C23 */
+        if (memcmp("__asm__", text, 7) == 0)
+            return TK_KEYWORD__ASM;
+        if (msvc)
+        {
+            if (memcmp("__ptr32", text, 7) == 0)
+                return TK_KEYWORD_MSVC__PTR32;
+            if (memcmp("__ptr64", text, 7) == 0)
+                return TK_KEYWORD_MSVC__PTR64;
+            if (memcmp("__leave", text, 7) == 0)
+                return TK_KEYWORD_MSVC__LEAVE;
+            if (memcmp("__int16", text, 7) == 0)
+                return TK_KEYWORD_MSVC__INT16;
+            if (memcmp("__int32", text, 7) == 0)
+                return TK_KEYWORD_MSVC__INT32;
+            if (memcmp("__int64", text, 7) == 0)
+                return TK_KEYWORD_MSVC__INT64;
+            if (memcmp("__cdecl", text, 7) == 0)
+                return TK_KEYWORD_MSVC__CDECL;
+        }
         break;
 
-    case 'u':
-        if (strcmp("union", text) == 0)
-            return TK_KEYWORD_UNION;
-        if (strcmp("unsigned", text) == 0)
+    case 8:
+        if (memcmp("continue", text, 8) == 0)
+            return TK_KEYWORD_CONTINUE;
+        if (memcmp("offsetof", text, 8) == 0)
+            return TK_KEYWORD_GCC__BUILTIN_OFFSETOF;
+        if (memcmp("register", text, 8) == 0)
+            return TK_KEYWORD_REGISTER;
+        if (memcmp("restrict", text, 8) == 0)
+            return TK_KEYWORD_RESTRICT;
+        if (memcmp("unsigned", text, 8) == 0)
             return TK_KEYWORD_UNSIGNED;
-        break;
-
-    case 'v':
-        if (strcmp("void", text) == 0)
-            return TK_KEYWORD_VOID;
-        if (strcmp("volatile", text) == 0)
+        if (memcmp("volatile", text, 8) == 0)
             return TK_KEYWORD_VOLATILE;
-        break;
-
-    case 'w':
-        if (strcmp("while", text) == 0)
-            return TK_KEYWORD_WHILE;
-        break;
-    case '_':
-
-        /*ownership*/
-        if (strcmp("_Ctor", text) == 0)
-            return TK_KEYWORD__CTOR; /* extension */
-        if (strcmp("_Owner", text) == 0)
-            return TK_KEYWORD_CAKE_OWNER; /* extension */
-        if (strcmp("_Dtor", text) == 0)
-            return TK_KEYWORD__DTOR; /* extension */
-        if (strcmp("_Opt", text) == 0)
-            return TK_KEYWORD_CAKE_OPT; /* extension */
-
-        if (strcmp("_Defer", text) == 0)
-            return TK_KEYWORD_DEFER;
-
-        if (strcmp("_View", text) == 0)
-            return TK_KEYWORD_CAKE_VIEW; /* extension */
-
-        if (strcmp("_Countof", text) == 0)
+        if (memcmp("_Countof", text, 8) == 0)
             return TK_KEYWORD__COUNTOF; /* C2Y */
+        if (memcmp("_Alignof", text, 8) == 0)
+            return TK_KEYWORD__ALIGNOF;
+        if (memcmp("_Alignas", text, 8) == 0)
+            return TK_KEYWORD__ALIGNAS;
+        if (memcmp("_Complex", text, 8) == 0)
+            return TK_KEYWORD__COMPLEX;
+        if (memcmp("_Generic", text, 8) == 0)
+            return TK_KEYWORD__GENERIC;
+        if (memcmp("__inline", text, 8) == 0)
+            return TK_KEYWORD_INLINE;
+        if (msvc)
+        {
+            if (memcmp("__except", text, 8) == 0)
+                return TK_KEYWORD_MSVC__EXCEPT;
+            if (memcmp("_stdcall", text, 8) == 0)
+                return TK_KEYWORD_MSVC__STDCALL;
+        }
+        break;
 
-        /*TRAITS EXTENSION*/
-        if (strcmp("_is_lvalue", text) == 0)
-            return TK_KEYWORD_IS_LVALUE;
-        if (strcmp("_is_const", text) == 0)
+    case 9:
+        if (memcmp("constexpr", text, 9) == 0)
+            return TK_KEYWORD_CONSTEXPR;
+        if (memcmp("_is_const", text, 9) == 0)
             return TK_KEYWORD_IS_CONST;
-        if (strcmp("_is_owner", text) == 0)
+        if (memcmp("_is_owner", text, 9) == 0)
             return TK_KEYWORD_IS_OWNER;
-        if (strcmp("_is_pointer", text) == 0)
-            return TK_KEYWORD_IS_POINTER;
-        if (strcmp("_is_array", text) == 0)
+        if (memcmp("_is_array", text, 9) == 0)
             return TK_KEYWORD_IS_ARRAY;
-        if (strcmp("_is_function", text) == 0)
-            return TK_KEYWORD_IS_FUNCTION;
-        if (strcmp("_is_arithmetic", text) == 0)
-            return TK_KEYWORD_IS_ARITHMETIC;
-        if (strcmp("_is_floating_point", text) == 0)
-            return TK_KEYWORD_IS_FLOATING_POINT;
-        if (strcmp("_is_integral", text) == 0)
-            return TK_KEYWORD_IS_INTEGRAL;
-        if (strcmp("_is_scalar", text) == 0)
-            return TK_KEYWORD_IS_SCALAR;
-        /*TRAITS EXTENSION*/
-
-        if (strcmp("_Alignof", text) == 0)
-            return TK_KEYWORD__ALIGNOF;
-        if (strcmp("_Alignas", text) == 0)
-            return TK_KEYWORD__ALIGNAS;
-        if (strcmp("_Atomic", text) == 0)
-            return TK_KEYWORD__ATOMIC;
-
-        if (strcmp("__builtin_va_list", text) == 0)
-            return TK_KEYWORD_GCC__BUILTIN_VA_LIST;
-
-        if (strcmp("__attribute__", text) == 0)
-            return TK_KEYWORD_GCC__ATTRIBUTE;
-
-        if (strcmp("__builtin_offsetof", text) == 0)
-            return TK_KEYWORD_GCC__BUILTIN_OFFSETOF;
-
-        if (strcmp("__builtin_va_end", text) == 0)
-            return TK_KEYWORD_GCC__BUILTIN_VA_END;
-
-        if (strcmp("__builtin_va_arg", text) == 0)
-            return TK_KEYWORD_GCC__BUILTIN_VA_ARG;
-
-        if (strcmp("__builtin_c23_va_start", text) == 0)
-            return TK_KEYWORD_GCC__BUILTIN_C23_VA_START;
-
-        if (strcmp("__builtin_va_start", text) == 0)
-            return TK_KEYWORD_GCC__BUILTIN_C23_VA_START;
-
-        if (strcmp("__builtin_va_copy", text) == 0)
-            return TK_KEYWORD_GCC__BUILTIN_VA_COPY;
-
-
-        if (strstr(text, "__volatile__") != NULL) //GCC
-            return TK_KEYWORD_VOLATILE;
-
+        if (memcmp("_Noreturn", text, 9) == 0)
+            return TK_KEYWORD__NORETURN; /* _Noreturn is deprecated in C23 */
+        if (msvc)
+        {
+            if (memcmp("__finally", text, 9) == 0)
+                return TK_KEYWORD_MSVC__FINALLY;
+            if (memcmp("__stdcall", text, 9) == 0)
+                return TK_KEYWORD_MSVC__STDCALL;
+            if (memcmp("__alignof", text, 9) == 0)
+                return TK_KEYWORD__ALIGNOF;
+        }
+        break;
 
-        if (strcmp("_Bool", text) == 0)
-            return TK_KEYWORD__BOOL;
-        if (strcmp("_Complex", text) == 0)
-            return TK_KEYWORD__COMPLEX;
-        if (strcmp("_Decimal32", text) == 0)
+    case 10:
+        if (memcmp("static_set", text, 10) == 0)
+            return TK_KEYWORD_STATIC_SET;
+        if (memcmp("_is_lvalue", text, 10) == 0)
+            return TK_KEYWORD_IS_LVALUE;
+        if (memcmp("_is_scalar", text, 10) == 0)
+            return TK_KEYWORD_IS_SCALAR;
+        if (memcmp("_Decimal32", text, 10) == 0)
             return TK_KEYWORD__DECIMAL32;
-        if (strcmp("_Decimal64", text) == 0)
+        if (memcmp("_Decimal64", text, 10) == 0)
             return TK_KEYWORD__DECIMAL64;
-        if (strcmp("_Decimal128", text) == 0)
-            return TK_KEYWORD__DECIMAL128;
-        if (strcmp("_Generic", text) == 0)
-            return TK_KEYWORD__GENERIC;
-
-        if (strcmp("_Imaginary", text) == 0)
+        if (memcmp("_Imaginary", text, 10) == 0)
             return TK_KEYWORD__IMAGINARY;
-
-        if (strcmp("_Noreturn", text) == 0)
-            return TK_KEYWORD__NORETURN; /* _Noreturn is deprecated in C23 */
-
-        if (strcmp("_Static_assert", text) == 0)
-            return TK_KEYWORD__STATIC_ASSERT;
-
-        if (strcmp("_Thread_local", text) == 0)
-            return TK_KEYWORD__THREAD_LOCAL;
-
-        if (strcmp("_BitInt", text) == 0)
-            return TK_KEYWORD__BITINT; /* C23 */
-
-        if (strcmp("__typeof__", text) == 0)
-            return TK_KEYWORD_TYPEOF; /* C23 */
-
-        if (strcmp("__asm__", text) == 0 || strcmp("_asm", text) == 0 || strcmp("__asm", text) == 0)
-            return TK_KEYWORD__ASM;
-
-        if (strcmp("__restrict", text) == 0)
+        if (memcmp("__typeof__", text, 10) == 0)
+            return TK_KEYWORD_TYPEOF; /* C23 */
+        if (memcmp("__restrict", text, 10) == 0)
             return TK_KEYWORD_RESTRICT;
-
-        if (strcmp("__inline", text) == 0 || strcmp("__inline__", text) == 0)
+        if (memcmp("__inline__", text, 10) == 0)
             return TK_KEYWORD_INLINE;
+        if (msvc)
+        {
+            if (memcmp("__fastcall", text, 10) == 0)
+                return TK_KEYWORD_MSVC__FASTCALL;
+            if (memcmp("__declspec", text, 10) == 0)
+                return TK_KEYWORD_MSVC__DECLSPEC;
+        }
+        break;
 
-        if (strcmp("__alignof__", text) == 0)
+    case 11:
+        if (memcmp("_is_pointer", text, 11) == 0)
+            return TK_KEYWORD_IS_POINTER;
+        if (memcmp("_Decimal128", text, 11) == 0)
+            return TK_KEYWORD__DECIMAL128;
+        if (memcmp("__alignof__", text, 11) == 0)
             return TK_KEYWORD__ALIGNOF;
-
-        if (target == TARGET_X86_MSVC || target == TARGET_X64_MSVC)
+        if (msvc)
         {
-            if (strcmp("__ptr32", text) == 0)
-                return TK_KEYWORD_MSVC__PTR32;
-
-            if (strcmp("__ptr64", text) == 0)
-                return TK_KEYWORD_MSVC__PTR64;
-
-            if (strcmp("__unaligned", text) == 0)
+            if (memcmp("__unaligned", text, 11) == 0)
                 return TK_KEYWORD_MSVC__UNALIGNED;
+        }
+        break;
 
-            if (strcmp("__try", text) == 0)
-                return TK_KEYWORD_MSVC__TRY;
-
-            if (strcmp("__except", text) == 0)
-                return TK_KEYWORD_MSVC__EXCEPT;
-
-            if (strcmp("__finally", text) == 0)
-                return TK_KEYWORD_MSVC__FINALLY;
-
-            if (strcmp("__leave", text) == 0)
-                return TK_KEYWORD_MSVC__LEAVE;
-
-            // begin microsoft
-            if (strcmp("__int8", text) == 0)
-                return TK_KEYWORD_MSVC__INT8;
-
-            if (strcmp("__int16", text) == 0)
-                return TK_KEYWORD_MSVC__INT16;
-
-            if (strcmp("__int32", text) == 0)
-                return TK_KEYWORD_MSVC__INT32;
-
-            if (strcmp("__int64", text) == 0)
-                return TK_KEYWORD_MSVC__INT64;
+    case 12:
+        if (memcmp("static_debug", text, 12) == 0)
+            return TK_KEYWORD_CAKE_STATIC_DEBUG;
+        if (memcmp("static_state", text, 12) == 0)
+            return TK_KEYWORD_STATIC_STATE;
+        if (memcmp("thread_local", text, 12) == 0)
+            return TK_KEYWORD__THREAD_LOCAL; /* C23 alternate spelling for _Thread_local */
+        if (memcmp("_is_function", text, 12) == 0)
+            return TK_KEYWORD_IS_FUNCTION;
+        if (memcmp("_is_integral", text, 12) == 0)
+            return TK_KEYWORD_IS_INTEGRAL;
+        break;
 
-            if (strcmp("__forceinline", text) == 0)
+    case 13:
+        if (memcmp("static_assert", text, 13) == 0)
+            return TK_KEYWORD__STATIC_ASSERT; /* C23 alternate spelling for _Static_assert */
+        if (memcmp("typeof_unqual", text, 13) == 0)
+            return TK_KEYWORD_TYPEOF_UNQUAL; /* C23 */
+        if (memcmp("__attribute__", text, 13) == 0)
+            return TK_KEYWORD_GCC__ATTRIBUTE;
+        if (memcmp("_Thread_local", text, 13) == 0)
+            return TK_KEYWORD__THREAD_LOCAL;
+        if (msvc)
+        {
+            if (memcmp("__forceinline", text, 13) == 0)
                 return TK_KEYWORD_INLINE;
+        }
+        break;
 
-            if (strcmp("__stdcall", text) == 0 || strcmp("_stdcall", text) == 0)
-                return TK_KEYWORD_MSVC__STDCALL;
+    case 14:
+        if (memcmp("_is_arithmetic", text, 14) == 0)
+            return TK_KEYWORD_IS_ARITHMETIC;
+        if (memcmp("_Static_assert", text, 14) == 0)
+            return TK_KEYWORD__STATIC_ASSERT;
+        break;
 
-            if (strcmp("__cdecl", text) == 0)
-                return TK_KEYWORD_MSVC__CDECL;
+    case 15:
+        if (memcmp("static_debug_ex", text, 15) == 0)
+            return TK_KEYWORD_CAKE_STATIC_DEBUG_EX;
+        break;
 
-            if (strcmp("__fastcall", text) == 0)
-                return TK_KEYWORD_MSVC__FASTCALL;
+    case 16:
+        if (memcmp("__builtin_va_end", text, 16) == 0)
+            return TK_KEYWORD_GCC__BUILTIN_VA_END;
+        if (memcmp("__builtin_va_arg", text, 16) == 0)
+            return TK_KEYWORD_GCC__BUILTIN_VA_ARG;
+        break;
 
-            if (strcmp("__alignof", text) == 0)
-                return TK_KEYWORD__ALIGNOF;
+    case 17:
+        if (memcmp("__builtin_va_list", text, 17) == 0)
+            return TK_KEYWORD_GCC__BUILTIN_VA_LIST;
+        if (memcmp("__builtin_va_copy", text, 17) == 0)
+            return TK_KEYWORD_GCC__BUILTIN_VA_COPY;
+        break;
 
-            if (strcmp("__declspec", text) == 0)
-                return TK_KEYWORD_MSVC__DECLSPEC;
-        }
+    case 18:
+        if (memcmp("_is_floating_point", text, 18) == 0)
+            return TK_KEYWORD_IS_FLOATING_POINT;
+        if (memcmp("__builtin_offsetof", text, 18) == 0)
+            return TK_KEYWORD_GCC__BUILTIN_OFFSETOF;
+        if (memcmp("__builtin_va_start", text, 18) == 0)
+            return TK_KEYWORD_GCC__BUILTIN_C23_VA_START;
+        break;
+
+    case 22:
+        if (memcmp("__builtin_c23_va_start", text, 22) == 0)
+            return TK_KEYWORD_GCC__BUILTIN_C23_VA_START;
         break;
     default:
         break;
     }
 
+    if (text[0] == '_' && strstr(text, "__volatile__") != NULL) //GCC
+        return TK_KEYWORD_VOLATILE;
+
     return 0;
 }
 
@@ -1368,11 +1484,13 @@ static void token_promote(const struct parser_ctx* ctx, struct token* token)
         token->type = TK_IDENTIFIER; /*nao precisamos mais disso*/
     }
 
-    if (token->type == TK_IDENTIFIER)
+    if (token->type == TK_IDENTIFIER && !(token->flags & TK_FLAG_IDENTIFIER_IS_NOT_KEYWORD))
     {
         enum token_type t = is_keyword(token->lexeme, ctx->options.target);
         if (t != TK_NONE)
             token->type = t;
+        else
+            token->flags |= TK_FLAG_IDENTIFIER_IS_NOT_KEYWORD;
     }
     else if (token->type == TK_PPNUMBER)
     {
@@ -1386,15 +1504,43 @@ static void token_promote(const struct parser_ctx* ctx, struct token* token)
     }
 }
 
+/*
+  false after the parser walked input_list directly (pragma, asm)
+  or if the array of final tokens could not be allocated.
+*/
+static bool parser_final_index_is_current(const struct parser_ctx* ctx)
+{
+    return ctx->final_index < ctx->final_tokens_size &&
+           ctx->final_tokens[ctx->final_index] == ctx->current;
+}
+
+static void parser_drop_final_tokens(struct parser_ctx* ctx)
+{
+    free(ctx->final_tokens);
+    ctx->final_tokens = NULL;
+    ctx->final_tokens_size = 0;
+    ctx->final_index = 0;
+}
+
 struct token* _Opt parser_look_ahead(const struct parser_ctx* ctx)
 {
     if (ctx->current == NULL)
         return NULL;
 
-    struct token* _Opt p = ctx->current->next;
-    while (p && !(p->flags & TK_FLAG_FINAL))
+    struct token* _Opt p = NULL;
+
+    if (parser_final_index_is_current(ctx))
     {
-        p = p->next;
+        if (ctx->final_index + 1 < ctx->final_tokens_size)
+            p = ctx->final_tokens[ctx->final_index + 1];
+    }
+    else
+    {
+        p = ctx->current->next;
+        while (p && !(p->flags & TK_FLAG_FINAL))
+        {
+            p = p->next;
+        }
     }
 
     if (p)
@@ -1425,20 +1571,198 @@ static void parser_skip_blanks(struct parser_ctx* ctx)
             ctx->current = ctx->current->next;
     }
 
+    /*
+      The array has the same final tokens as input_list. The parser only
+      moves forward, so after walking the list (pragma, asm) current is
+      found again after the position it had before. If the list was
+      changed without updating the array the array is dropped and the
+      parser walks the list from now on.
+    */
+    if (ctx->final_tokens != NULL)
+    {
+        if (ctx->current == NULL)
+        {
+            ctx->final_index = ctx->final_tokens_size;
+        }
+        else
+        {
+            while (ctx->final_index < ctx->final_tokens_size &&
+                   ctx->final_tokens[ctx->final_index] != ctx->current)
+            {
+                ctx->final_index++;
+            }
+
+            assert(parser_final_index_is_current(ctx));
+            if (!parser_final_index_is_current(ctx))
+            {
+                parser_drop_final_tokens(ctx);
+            }
+        }
+    }
+
     if (ctx->current)
     {
         token_promote(ctx, ctx->current); // transform to parser token
     }
 }
 
+static void parser_next(struct parser_ctx* ctx)
+{
+    assert(ctx->current != NULL);
+
+    if (parser_final_index_is_current(ctx))
+    {
+        ctx->final_index++;
+        ctx->current = ctx->final_index < ctx->final_tokens_size ?
+            ctx->final_tokens[ctx->final_index] :
+            NULL;
+
+        if (ctx->current)
+        {
+            token_promote(ctx, ctx->current); // transform to parser token
+        }
+    }
+    else if (ctx->current)
+    {
+        ctx->current = ctx->current->next;
+        parser_skip_blanks(ctx);
+    }
+}
+
+static void parser_index_final_tokens(struct parser_ctx* ctx)
+{
+    parser_drop_final_tokens(ctx);
+
+    int count = 0;
+    for (struct token* _Opt p = ctx->input_list.head; p; p = p->next)
+    {
+        if (p->flags & TK_FLAG_FINAL)
+            count++;
+    }
+
+    if (count > 0)
+    {
+        /*on failure the parser just walks the list*/
+        ctx->final_tokens = calloc(count, sizeof(struct token*));
+        if (ctx->final_tokens)
+        {
+            for (struct token* _Opt p = ctx->input_list.head; p; p = p->next)
+            {
+                if (p->flags & TK_FLAG_FINAL)
+                    ctx->final_tokens[ctx->final_tokens_size++] = p;
+            }
+        }
+    }
+}
+
+/*
+  Replaces the current token in the array by the count final tokens
+  of input_list that start at p_first.
+*/
+static void parser_final_tokens_replace_current(struct parser_ctx* ctx, struct token* p_first, int count)
+{
+    if (ctx->final_tokens == NULL)
+        return;
+
+    assert(ctx->final_index < ctx->final_tokens_size);
+
+    const int new_size = ctx->final_tokens_size - 1 + count;
+    if (count > 1)
+    {
+        struct token** _Owner _Opt p = realloc(ctx->final_tokens, new_size * sizeof(struct token*));
+        if (p == NULL)
+        {
+            /*on failure the parser just walks the list*/
+            parser_drop_final_tokens(ctx);
+            return;
+        }
+        ctx->final_tokens = p;
+    }
+
+    memmove(ctx->final_tokens + ctx->final_index + count,
+            ctx->final_tokens + ctx->final_index + 1,
+            (ctx->final_tokens_size - ctx->final_index - 1) * sizeof(struct token*));
+
+    int i = ctx->final_index;
+    for (struct token* _Opt p = p_first; p && i < ctx->final_index + count; p = p->next)
+    {
+        if (p->flags & TK_FLAG_FINAL)
+            ctx->final_tokens[i++] = p;
+    }
+    ctx->final_tokens_size = new_size;
+}
+
+static void parser_set_input(struct parser_ctx* ctx, struct token_list* list)
+{
+    ctx->input_list = *list;
+    parser_index_final_tokens(ctx);
+    ctx->current = ctx->input_list.head;
+    parser_skip_blanks(ctx);
+}
+
+/*
+  #embed data is used directly only by initializer lists. Anywhere else
+  the TK_EMBED token is replaced by the pp-number and comma tokens it
+  stands for.
+*/
+int parser_expand_embed(struct parser_ctx* ctx)
+{
+    struct token* _Opt p_embed = ctx->current;
+    if (p_embed == NULL || p_embed->type != TK_EMBED)
+        return 0;
+
+    struct tokenizer_ctx tctx = { 0 };
+    struct token_list list = tokenizer(&tctx, p_embed->lexeme, NULL, p_embed->level, TK_FLAG_NONE);
+    if (list.head == NULL || tctx.n_errors > 0)
+    {
+        token_list_destroy(&list);
+        return 1;
+    }
+
+    /*only the tokens the parser sees are final, not the blanks and new lines*/
+    int final_count = 0;
+    for (struct token* _Opt p = list.head; p; p = p->next)
+    {
+        p->line = p_embed->line;
+        p->col = p_embed->col;
+        p->token_origin = p_embed->token_origin;
+        if (!token_is_blank(p) && p->type != TK_NEWLINE)
+        {
+            p->flags |= TK_FLAG_FINAL;
+            final_count++;
+        }
+    }
+
+    if (final_count == 0)
+    {
+        token_list_destroy(&list);
+        return 1;
+    }
+
+    const bool indexed = parser_final_index_is_current(ctx);
+    assert(indexed || ctx->final_tokens == NULL);
+
+    struct token* p_first = list.head;
+    token_list_insert_after(&ctx->input_list, p_embed, &list);
+    token_list_remove(&ctx->input_list, p_embed, p_embed);
+
+    ctx->current = p_first;
+    if (indexed)
+    {
+        parser_final_tokens_replace_current(ctx, p_first, final_count);
+    }
+    parser_skip_blanks(ctx);
+
+    return 0;
+}
+
 void parser_match(struct parser_ctx* ctx)
 {
     if (ctx->current == NULL)
         return;
 
     ctx->previous = ctx->current;
-    ctx->current = ctx->current->next;
-    parser_skip_blanks(ctx);
+    parser_next(ctx);
 }
 
 void unexpected_end_of_file(struct parser_ctx* ctx)
@@ -1467,8 +1791,7 @@ int parser_match_tk(struct parser_ctx* ctx, enum token_type type)
         }
 
         ctx->previous = ctx->current;
-        ctx->current = ctx->current->next;
-        parser_skip_blanks(ctx);
+        parser_next(ctx);
     }
     else
     {
@@ -1856,6 +2179,7 @@ struct declaration* _Owner _Opt declaration_core(struct parser_ctx* ctx,
         {
             throw;
         }
+        time_counter_add(TIME_COUNTER_AST_NODES);
 
         p_declaration->p_attribute_specifier_sequence = p_attribute_specifier_sequence;
         p_attribute_specifier_sequence = NULL; /*MOVED*/
@@ -2263,9 +2587,11 @@ struct declaration* _Owner _Opt declaration(struct parser_ctx* ctx,
 
             if (extern_declaration && ctx->p_report->error_count == 0)
             {
+                struct time_stamp start = time_report_start(ctx->p_report->p_time_report);
                 struct defer_visit_ctx ctx2 = { .ctx = ctx };
                 defer_start_visit_declaration(&ctx2, p_declaration);
                 defer_visit_ctx_destroy(&ctx2);
+                time_report_stop(ctx->p_report->p_time_report, TIME_PHASE_DEFER, start);
 
 
                 if (ctx->p_report->error_count == 0 && ctx->options.flow_analysis)
@@ -2278,10 +2604,12 @@ struct declaration* _Owner _Opt declaration(struct parser_ctx* ctx,
                     /* visiting the function again; restore the same diagnostic state */
                     ctx->options.diagnostic_stack.stack[ctx->options.diagnostic_stack.top_index] = before_function_diagnostics;
 
+                    start = time_report_start(ctx->p_report->p_time_report);
                     struct flow_visit_ctx ctx3 = { 0 };
                     ctx3.ctx = ctx;
                     flow_start_visit_declaration(&ctx3, p_declaration);
                     flow_visit_ctx_destroy(&ctx3);
+                    time_report_stop(ctx->p_report->p_time_report, TIME_PHASE_FLOW, start);
                 }
             }
 
@@ -2290,10 +2618,12 @@ struct declaration* _Owner _Opt declaration(struct parser_ctx* ctx,
         {
             if (ctx->options.flow_analysis && extern_declaration)
             {
+                const struct time_stamp start = time_report_start(ctx->p_report->p_time_report);
                 _Opt struct flow_visit_ctx ctx2 = { 0 };
                 ctx2.ctx = ctx;
                 flow_start_visit_declaration(&ctx2, p_declaration);
                 flow_visit_ctx_destroy(&ctx2);
+                time_report_stop(ctx->p_report->p_time_report, TIME_PHASE_FLOW, start);
             }
         }
 
@@ -2529,7 +2859,7 @@ struct init_declarator* _Owner _Opt init_declarator(struct parser_ctx* ctx,
             {
                 struct hash_item_set item = { 0 };
                 item.p_init_declarator = init_declarator_add_ref(p_init_declarator);
-                hashmap_set(&ctx->scopes.tail->variables, declarator_name, &item);
+                scope_list_set_variable(&ctx->scopes, declarator_name, &item);
                 hash_item_set_destroy(&item);
 
                 /* no warning at global scope */
@@ -2548,7 +2878,7 @@ struct init_declarator* _Owner _Opt init_declarator(struct parser_ctx* ctx,
             /* first time we see this declarator */
             struct hash_item_set item = { 0 };
             item.p_init_declarator = init_declarator_add_ref(p_init_declarator);
-            hashmap_set(&ctx->scopes.tail->variables, declarator_name, &item);
+            scope_list_set_variable(&ctx->scopes, declarator_name, &item);
             hash_item_set_destroy(&item);
         }
         /////////////////////////////////////////////////////////////////////////////
@@ -2673,7 +3003,8 @@ struct init_declarator* _Owner _Opt init_declarator(struct parser_ctx* ctx,
 
                     type_remove_names(&t);
                     assert(t.name_opt == NULL);
-                    t.name_opt = strdup(p_init_declarator->p_declarator->name_opt->lexeme);
+                    const char* lexeme = p_init_declarator->p_declarator->name_opt->lexeme;
+                    t.name_opt = atom_intern(lexeme, strlen(lexeme));
 
                     /*
                       consider:
@@ -3149,7 +3480,6 @@ struct typeof_specifier* _Owner _Opt  typeof_specifier(struct parser_ctx* ctx)
 
         type_visit_to_mark_anonymous(&p_typeof_specifier->type);
 
-        free((void* _Owner)p_typeof_specifier->type.name_opt);
         p_typeof_specifier->type.name_opt = NULL;
 
         if (ctx->current == NULL)
@@ -3913,6 +4243,9 @@ void struct_or_union_specifier_delete(struct struct_or_union_specifier* _Owner _
             return;
         }
 
+        for (int i = 0; i < NUMBER_OF_TARGETS; i++)
+            struct_layout_delete(p->layouts[i]);
+
         member_declaration_list_destroy(&p->member_declaration_list);
         attribute_specifier_sequence_delete(p->attribute_specifier_sequence_opt);
         free(p);
@@ -4017,7 +4350,7 @@ struct struct_or_union_specifier* _Owner _Opt struct_or_union_specifier(struct p
                 {
                     struct hash_item_set item = { 0 };
                     item.p_struct_or_union_specifier = struct_or_union_specifier_add_ref(p_struct_or_union_specifier);
-                    hashmap_set(&ctx->scopes.tail->tags,
+                    scope_list_set_tag(&ctx->scopes,
                         p_struct_or_union_specifier->tagtoken->lexeme,
                         &item);
                     hash_item_set_destroy(&item);
@@ -4038,7 +4371,7 @@ struct struct_or_union_specifier* _Owner _Opt struct_or_union_specifier(struct p
 
                         struct hash_item_set item = { 0 };
                         item.p_struct_or_union_specifier = struct_or_union_specifier_add_ref(p_struct_or_union_specifier);
-                        hashmap_set(&ctx->scopes.tail->tags,
+                        scope_list_set_tag(&ctx->scopes,
                             p_struct_or_union_specifier->tagtoken->lexeme,
                             &item);
                         hash_item_set_destroy(&item);
@@ -4066,7 +4399,7 @@ struct struct_or_union_specifier* _Owner _Opt struct_or_union_specifier(struct p
 
             struct hash_item_set item = { 0 };
             item.p_struct_or_union_specifier = struct_or_union_specifier_add_ref(p_struct_or_union_specifier);
-            hashmap_set(&ctx->scopes.tail->tags, p_struct_or_union_specifier->tag_name, &item);
+            scope_list_set_tag(&ctx->scopes, p_struct_or_union_specifier->tag_name, &item);
             hash_item_set_destroy(&item);
         }
 
@@ -4551,57 +4884,20 @@ struct member_declaration* _Owner _Opt member_declaration(struct parser_ctx* ctx
     return p_member_declaration;
 }
 
-struct member_declarator* _Opt find_member_declarator(struct member_declaration_list* list,
+struct member_declarator* _Opt find_member_declarator(struct struct_or_union_specifier* p_complete,
     const char* name,
-    int* p_member_index)
+    int* p_member_index,
+    enum target target)
 {
-    if (list->head == NULL)
+    struct struct_layout* _Opt p_layout = struct_layout_get(p_complete, target);
+    if (p_layout == NULL)
         return NULL;
 
-    struct member_declaration* _Opt p_member_declaration = list->head;
-    while (p_member_declaration)
-    {
-        struct member_declarator* _Opt p_member_declarator = NULL;
-
-        if (p_member_declaration->member_declarator_list_opt)
-        {
-            p_member_declarator = p_member_declaration->member_declarator_list_opt->head;
-
-            while (p_member_declarator)
-            {
-                if (p_member_declarator->declarator)
-                {
-                    if (p_member_declarator->declarator->name_opt && strcmp(p_member_declarator->declarator->name_opt->lexeme, name) == 0)
-                    {
-                        return p_member_declarator;
-                    }
-                }
-
-                (*p_member_index)++;
-                p_member_declarator = p_member_declarator->next;
-            }
-        }
-        else
-        {
-            if (p_member_declaration->specifier_qualifier_list &&
-                p_member_declaration->specifier_qualifier_list->struct_or_union_specifier)
-            {
-                struct struct_or_union_specifier* _Opt p_complete =
-                    get_complete_struct_or_union_specifier(p_member_declaration->specifier_qualifier_list->struct_or_union_specifier);
-
-                if (p_complete)
-                {
-                    p_member_declarator = find_member_declarator(&p_complete->member_declaration_list, name, p_member_index);
-                    if (p_member_declarator)
-                        return p_member_declarator;
-                }
-            }
-
-        }
+    const struct member_layout* _Opt p_member = struct_layout_find(p_layout, name, p_member_index);
+    if (p_member == NULL)
+        return NULL;
 
-        p_member_declaration = p_member_declaration->next;
-    }
-    return NULL;
+    return p_member->p_member_declarator;
 }
 
 static struct member_declarator* _Opt find_member_declarator_by_index_core(struct member_declaration_list* list, int member_index, int* p_count)
@@ -5150,7 +5446,7 @@ struct enum_specifier* _Owner _Opt enum_specifier(struct parser_ctx* ctx)
 
             struct hash_item_set item = { 0 };
             item.p_enum_specifier = enum_specifier_add_ref(p_enum_specifier);
-            hashmap_set(&ctx->scopes.tail->tags, p_enum_specifier->tag_name, &item);
+            scope_list_set_tag(&ctx->scopes, p_enum_specifier->tag_name, &item);
             p_enum_specifier->p_complete_enum_specifier = p_enum_specifier;
             hash_item_set_destroy(&item);
         }
@@ -5173,7 +5469,7 @@ struct enum_specifier* _Owner _Opt enum_specifier(struct parser_ctx* ctx)
                 /* tag not found anywhere; add it */
                 struct hash_item_set item = { 0 };
                 item.p_enum_specifier = enum_specifier_add_ref(p_enum_specifier);
-                hashmap_set(&ctx->scopes.tail->tags, p_enum_specifier->tag_name, &item);
+                scope_list_set_tag(&ctx->scopes, p_enum_specifier->tag_name, &item);
                 p_enum_specifier->p_complete_enum_specifier = p_enum_specifier;
                 hash_item_set_destroy(&item);
             }
@@ -5325,7 +5621,7 @@ struct enumerator* _Owner _Opt enumerator(struct parser_ctx* ctx,
 
         struct hash_item_set item = { 0 };
         item.p_enumerator = enumerator_add_ref(p_enumerator);
-        hashmap_set(&ctx->scopes.tail->variables, p_enumerator->token->lexeme, &item);
+        scope_list_set_variable(&ctx->scopes, p_enumerator->token->lexeme, &item);
         hash_item_set_destroy(&item);
 
         if (ctx->current == NULL)
@@ -6621,7 +6917,7 @@ struct parameter_declaration* _Owner _Opt parameter_declaration(struct parser_ct
             assert(p_parameter_declaration->declarator->name_opt != NULL); //add_ref will not change that
 
             /* void parameter has no name */
-            hashmap_set(&ctx->scopes.tail->variables,
+            scope_list_set_variable(&ctx->scopes,
                 p_parameter_declaration->declarator->name_opt->lexeme,
                 &item);
 
@@ -6969,10 +7265,23 @@ struct braced_initializer* _Owner _Opt braced_initializer(struct parser_ctx* ctx
     return p_bracket_initializer_list;
 }
 
+void embed_initializer_delete(struct embed_initializer* _Owner _Opt p)
+{
+    if (p)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            expression_delete(p->values[i]);
+        }
+        free(p);
+    }
+}
+
 void initializer_destroy(_Dtor struct initializer* p)
 {
     expression_delete(p->assignment_expression);
     braced_initializer_delete(p->braced_initializer);
+    embed_initializer_delete(p->embed);
 }
 
 void initializer_delete(struct initializer* _Owner _Opt p)
@@ -6981,10 +7290,44 @@ void initializer_delete(struct initializer* _Owner _Opt p)
     {
         expression_delete(p->assignment_expression);
         braced_initializer_delete(p->braced_initializer);
+        embed_initializer_delete(p->embed);
         free(p);
     }
 }
 
+static struct initializer* _Owner _Opt embed_initializer(struct parser_ctx* ctx)
+{
+    struct initializer* _Owner _Opt p_initializer = NULL;
+
+    try
+    {
+        if (ctx->current == NULL)
+        {
+            unexpected_end_of_file(ctx);
+            throw;
+        }
+
+        p_initializer = calloc(1, sizeof(struct initializer));
+        if (p_initializer == NULL)
+            throw;
+
+        p_initializer->first_token = ctx->current;
+
+        p_initializer->embed = calloc(1, sizeof(struct embed_initializer));
+        if (p_initializer->embed == NULL)
+            throw;
+
+        p_initializer->embed->token = ctx->current;
+        parser_match(ctx);
+    }
+    catch
+    {
+        initializer_delete(p_initializer);
+        p_initializer = NULL;
+    }
+    return p_initializer;
+}
+
 struct initializer* _Owner _Opt initializer(struct parser_ctx* ctx, enum expression_eval_mode eval_mode)
 {
     /*
@@ -7153,7 +7496,10 @@ struct initializer_list* _Owner _Opt initializer_list(struct parser_ctx* ctx, en
             p_initializer_list_item->designation = p_designation;
         }
 
-        struct initializer* _Owner _Opt p_initializer = initializer(ctx, eval_mode);
+        struct initializer* _Owner _Opt p_initializer =
+            ctx->current && ctx->current->type == TK_EMBED ?
+            embed_initializer(ctx) :
+            initializer(ctx, eval_mode);
 
         if (p_initializer == NULL)
         {
@@ -7194,7 +7540,10 @@ struct initializer_list* _Owner _Opt initializer_list(struct parser_ctx* ctx, en
             }
             p_initializer_list_item->designation = p_designation2;
 
-            struct initializer* _Owner _Opt p_initializer2 = initializer(ctx, eval_mode);
+            struct initializer* _Owner _Opt p_initializer2 =
+                ctx->current && ctx->current->type == TK_EMBED ?
+                embed_initializer(ctx) :
+                initializer(ctx, eval_mode);
             if (p_initializer2 == NULL)
             {
                 designation_delete(p_designation2);
@@ -8408,6 +8757,7 @@ struct statement* _Owner _Opt statement(struct parser_ctx* ctx, struct attribute
     {
         if (p_statement == NULL)
             throw;
+        time_counter_add(TIME_COUNTER_AST_NODES);
 
         if (first_of_labeled_statement(ctx))
         {
@@ -9313,47 +9663,43 @@ struct compound_statement* _Owner _Opt compound_statement(struct parser_ctx* ctx
             if (block_scope.variables.table == NULL)
                 continue;
             struct map_entry* _Opt entry = block_scope.variables.table[i];
-            while (entry)
+            if (entry == NULL)
+                continue;
+
+            if (entry->type != TAG_TYPE_DECLARATOR &&
+                entry->type != TAG_TYPE_INIT_DECLARATOR)
             {
+                continue;
+            }
 
-                if (entry->type != TAG_TYPE_DECLARATOR &&
-                    entry->type != TAG_TYPE_INIT_DECLARATOR)
-                {
-                    entry = entry->next;
-                    continue;
-                }
+            struct declarator* _Opt p_declarator = NULL;
+            struct init_declarator* _Opt p_init_declarator = NULL;
+            if (entry->type == TAG_TYPE_INIT_DECLARATOR)
+            {
+                assert(entry->data.p_init_declarator != NULL);
+                p_init_declarator = entry->data.p_init_declarator;
+                p_declarator = p_init_declarator->p_declarator;
+            }
+            else
+            {
+                p_declarator = entry->data.p_declarator;
+            }
 
-                struct declarator* _Opt p_declarator = NULL;
-                struct init_declarator* _Opt p_init_declarator = NULL;
-                if (entry->type == TAG_TYPE_INIT_DECLARATOR)
-                {
-                    assert(entry->data.p_init_declarator != NULL);
-                    p_init_declarator = entry->data.p_init_declarator;
-                    p_declarator = p_init_declarator->p_declarator;
-                }
-                else
-                {
-                    p_declarator = entry->data.p_declarator;
-                }
+            if (p_declarator)
+            {
 
-                if (p_declarator)
+                if (!type_is_maybe_unused(&p_declarator->type) &&
+                    p_declarator->num_uses == 0)
                 {
-
-                    if (!type_is_maybe_unused(&p_declarator->type) &&
-                        p_declarator->num_uses == 0)
+                    if (p_declarator->name_opt && p_declarator->name_opt->token_origin->level == 0)
                     {
-                        if (p_declarator->name_opt && p_declarator->name_opt->token_origin->level == 0)
-                        {
-                            compiler_diagnostic(W_UNUSED_VARIABLE,
-                                ctx,
-                                p_declarator->name_opt, NULL,
-                                "'%s': unreferenced declarator",
-                                p_declarator->name_opt->lexeme);
-                        }
+                        compiler_diagnostic(W_UNUSED_VARIABLE,
+                            ctx,
+                            p_declarator->name_opt, NULL,
+                            "'%s': unreferenced declarator",
+                            p_declarator->name_opt->lexeme);
                     }
                 }
-
-                entry = entry->next;
             }
         }
     }
@@ -11264,9 +11610,7 @@ struct declaration_list parse(struct parser_ctx* ctx, struct token_list* list, b
 
         builtin_tokens = tokenizer(&tctx, builtin, "builtins", 0, TK_FLAG_NONE);
         built = preprocessor(&prectx, &builtin_tokens, 0);
-        ctx->input_list = built;
-        ctx->current = ctx->input_list.head;
-        parser_skip_blanks(ctx);
+        parser_set_input(ctx, &built);
 
         bool local_error = false;
         l = translation_unit(ctx, &local_error); /*insert buitin declarations at scope*/
@@ -11276,9 +11620,7 @@ struct declaration_list parse(struct parser_ctx* ctx, struct token_list* list, b
             throw;
         }
 
-        ctx->input_list = *list;
-        ctx->current = ctx->input_list.head;
-        parser_skip_blanks(ctx);
+        parser_set_input(ctx, list);
 
         l = translation_unit(ctx, &local_error);
         if (local_error)
@@ -11301,6 +11643,9 @@ struct ast get_ast(struct options* options,
     struct report* report)
 {
     struct ast ast = { 0 };
+    struct arena* _Opt p_previous_arena =
+        options->no_arena ? arena_get_current() : arena_set_current(&ast.arena);
+
     struct tokenizer_ctx tctx = { 0 };
 
     struct token_list list = tokenizer(&tctx, source, filename, 0, TK_FLAG_NONE);
@@ -11339,6 +11684,7 @@ struct ast get_ast(struct options* options,
     parser_ctx_destroy(&ctx);
     token_list_destroy(&list);
     preprocessor_ctx_destroy(&prectx);
+    arena_set_current(p_previous_arena);
 
     return ast;
 }
@@ -11354,6 +11700,13 @@ struct ast get_ast_with_flags(int argc,
 
 
     struct ast ast = { 0 };
+
+    struct options options = { 0 };
+    fill_options(&options, argc, argv);
+
+    struct arena* _Opt p_previous_arena =
+        options.no_arena ? arena_get_current() : arena_set_current(&ast.arena);
+
     struct tokenizer_ctx tctx = { 0 };
 
     struct token_list list = tokenizer(&tctx, source, filename, 0, TK_FLAG_NONE);
@@ -11365,9 +11718,6 @@ struct ast get_ast_with_flags(int argc,
 
     try
     {
-        struct options options = { 0 };
-        fill_options(&options, argc, argv);
-
         prectx.options = options;
         prectx.macros.capacity = 5000;
         fill_preprocessor_options(argc, argv, &prectx);
@@ -11395,6 +11745,7 @@ struct ast get_ast_with_flags(int argc,
     parser_ctx_destroy(&ctx);
     token_list_destroy(&list);
     preprocessor_ctx_destroy(&prectx);
+    arena_set_current(p_previous_arena);
 
     return ast;
 }
@@ -11403,6 +11754,7 @@ void ast_destroy(_Dtor struct ast* ast)
 {
     token_list_destroy(&ast->token_list);
     declaration_list_destroy(&ast->declaration_list);
+    arena_destroy(&ast->arena);
 }
 
 static bool is_all_upper(const char* text)
@@ -11670,6 +12022,12 @@ static struct object* _Opt find_first_subobject_old(struct type* p_type_not_used
         return p_object; //tODO
     }
 
+    if (object_is_run(p_object->members.head))
+    {
+        if (object_run_take(p_object->members.head, p_object->members.head->run_index) == NULL)
+            return NULL;
+    }
+
     *sub_object_of_union = type_is_union(&p_object->type);
     struct type t = type_dup(&p_object->members.head->type);
     type_swap(&t, p_type_out);
@@ -11700,7 +12058,15 @@ static struct object* _Opt find_last_suboject_of_suboject_old(struct type* p_typ
     while (it)
     {
         if (it->next == NULL)
+        {
+            if (object_is_run(it))
+            {
+                it = object_run_take(it, it->run_index + it->run_count - 1);
+                if (it == NULL)
+                    return NULL;
+            }
             return find_last_suboject_of_suboject_old(p_type_not_used, it, p_type_out);
+        }
 
         it = it->next;
     }
@@ -11736,6 +12102,12 @@ static struct object* _Opt find_next_subobject_old(struct type* p_top_object_not
         *sub_object_of_union = type_is_union(&it->type);
 
         it = it->members.head;
+        if (object_is_run(it))
+        {
+            it = object_run_take(it, it->run_index);
+            if (it == NULL)
+                return NULL;
+        }
 
         struct type t = type_dup(&it->type);
         type_swap(&t, p_type_out);
@@ -11756,6 +12128,8 @@ static struct object* _Opt find_next_subobject_old(struct type* p_top_object_not
             if (it->parent)
                 *sub_object_of_union = type_is_union(&it->parent->type);
             it = next;
+            if (object_is_run(it))
+                it = object_run_take(it, it->run_index);
             break;
         }
 
@@ -11816,78 +12190,30 @@ static struct object* _Opt find_designated_subobject(struct parser_ctx* ctx,
                 throw;
             }
 
-            struct member_declaration* _Opt p_member_declaration =
-                p_struct_or_union_specifier->member_declaration_list.head;
+            const char* name = p_designator->token->lexeme;
 
-            struct member_declarator* _Opt p_member_declarator = NULL;
+            int member_index = 0;
+            struct member_declarator* _Opt p_member_declarator =
+                find_member_declarator(p_struct_or_union_specifier, name, &member_index, target);
 
-            const char* name = p_designator->token->lexeme;
-            struct object* _Opt p_member_object = current_object->members.head;
-            while (p_member_declaration)
+            if (p_member_declarator && p_member_declarator->declarator)
             {
-                if (p_member_declaration->member_declarator_list_opt)
-                {
-                    p_member_declarator = p_member_declaration->member_declarator_list_opt->head;
+                struct object* _Opt p_member_object =
+                    find_object_declarator_by_index(current_object, &p_struct_or_union_specifier->member_declaration_list, member_index);
 
-                    while (p_member_declarator)
-                    {
-                        if (p_member_declarator->declarator)
-                        {
-                            if (p_member_declarator->declarator->name_opt &&
-                                strcmp(p_member_declarator->declarator->name_opt->lexeme, name) == 0)
-                            {
-                                if (p_designator->next != NULL)
-                                    return find_designated_subobject(ctx, &p_member_declarator->declarator->type, p_member_object, p_designator->next, is_constant, p_type_out2, false, ctx->options.target);
-                                else
-                                {
-                                    struct type t = type_dup(&p_member_declarator->declarator->type);
-                                    type_swap(&t, p_type_out2);
-                                    type_destroy(&t);
-
-                                    return p_member_object;
-                                }
-                            }
-                        }
-                        p_member_object = p_member_object->next;
-                        p_member_declarator = p_member_declarator->next;
-                    }
-                }
-                else if (p_member_declaration->specifier_qualifier_list)
+                if (p_designator->next != NULL)
                 {
-                    if (p_member_declaration->specifier_qualifier_list->struct_or_union_specifier)
-                    {
-                        struct struct_or_union_specifier* _Opt p_complete =
-                            get_complete_struct_or_union_specifier(p_member_declaration->specifier_qualifier_list->struct_or_union_specifier);
+                    if (p_member_object == NULL)
+                        throw;
 
-                        if (p_complete)
-                        {
-                            struct type t = { 0 };
-                            t.category = TYPE_CATEGORY_ITSELF;
-                            t.struct_or_union_specifier = p_complete;
-                            t.type_specifier_flags = TYPE_SPECIFIER_STRUCT_OR_UNION;
-
-                            struct object* _Opt p = find_designated_subobject(ctx,
-                                                                         &t,
-                                                                         p_member_object,
-                                                                         p_designator,
-                                                                         is_constant,
-                                                                         p_type_out2,
-                                                                         true, ctx->options.target);
-                            if (p)
-                            {
-                                type_destroy(&t);
-                                return p;
-                            }
-                            p_member_object = p_member_object->next;
-                            type_destroy(&t);
-                        }
-                    }
-                }
-                else
-                {
-                    //static_assert pragma...
+                    return find_designated_subobject(ctx, &p_member_declarator->declarator->type, p_member_object, p_designator->next, is_constant, p_type_out2, false, target);
                 }
-                p_member_declaration = p_member_declaration->next;
+
+                struct type t = type_dup(&p_member_declarator->declarator->type);
+                type_swap(&t, p_type_out2);
+                type_destroy(&t);
+
+                return p_member_object;
             }
 
             if (!not_error)
@@ -12013,6 +12339,241 @@ static struct initializer_list_item* _Opt find_innner_initializer_list_item(stru
     return p_initializer_list_item;
 }
 
+/*
+  Reads the next value of the TK_EMBED lexeme "n0,n1,...".
+  Returns false at the end.
+*/
+static bool embed_next_value(const char** pp, unsigned char* value)
+{
+    const char* p = *pp;
+    while (*p == ',')
+        p++;
+
+    if (!(*p >= '0' && *p <= '9'))
+    {
+        *pp = p;
+        return false;
+    }
+
+    int v = 0;
+    while (*p >= '0' && *p <= '9')
+    {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+
+    *value = (unsigned char)v;
+    *pp = p;
+    return true;
+}
+
+static struct expression* _Opt embed_initializer_value(struct parser_ctx* ctx, struct embed_initializer* p_embed, unsigned char value)
+{
+    if (p_embed->values[value] == NULL)
+    {
+        struct expression* _Owner _Opt p_expression = expression_new();
+        if (p_expression == NULL)
+            return NULL;
+
+        p_expression->expression_type = PRIMARY_EXPRESSION_NUMBER;
+        p_expression->first_token = p_embed->token;
+        p_expression->last_token = p_embed->token;
+        p_expression->type = type_make_int();
+        p_expression->object = object_make_signed_int(ctx->options.target, value);
+        p_embed->values[value] = p_expression;
+    }
+
+    return p_embed->values[value];
+}
+
+/*
+  true if the items of the list are values, #embed or [constant]
+  designators, so each item initializes one element of the array
+*/
+static bool initializer_list_is_flat(const struct initializer_list* p_initializer_list)
+{
+    struct initializer_list_item* _Opt p_initializer_list_item = p_initializer_list->head;
+    while (p_initializer_list_item)
+    {
+        if (p_initializer_list_item->initializer->braced_initializer)
+            return false;
+
+        if (p_initializer_list_item->designation)
+        {
+            struct designator* _Opt p_designator = p_initializer_list_item->designation->designator_list->head;
+            if (p_designator == NULL ||
+                p_designator->next != NULL ||
+                p_designator->constant_expression_opt == NULL)
+            {
+                return false;
+            }
+        }
+        p_initializer_list_item = p_initializer_list_item->next;
+    }
+    return true;
+}
+
+/*
+  Initializes an array of integers. Values of constant expressions and
+  of #embed are stored packed in the array object (object_set_element_value),
+  the other elements are created.
+*/
+_Attr(nodiscard)
+static int braced_initializer_integer_array(struct parser_ctx* ctx,
+                                            struct type* p_current_object_type,
+                                            struct object* current_object,
+                                            struct braced_initializer* braced_initializer,
+                                            const struct type* p_array_item_type,
+                                            bool is_constant,
+                                            bool requires_constant_initialization)
+{
+    try
+    {
+        assert(braced_initializer->initializer_list != NULL);
+
+        const enum target target = ctx->options.target;
+        const bool compute_array_size = p_current_object_type->p_array_num_elements_expression == NULL;
+        const long long num_of_elements = (long long)p_current_object_type->array_num_elements;
+        long long index = 0;
+        long long max_index = -1;
+
+        struct initializer_list_item* _Opt p_initializer_list_item = braced_initializer->initializer_list->head;
+        while (p_initializer_list_item)
+        {
+            if (p_initializer_list_item->designation)
+            {
+                struct designator* _Opt p_designator = p_initializer_list_item->designation->designator_list->head;
+                assert(p_designator && p_designator->constant_expression_opt);
+
+                index = object_to_signed_long_long(&p_designator->constant_expression_opt->object);
+                if (index < 0 || (!compute_array_size && index >= num_of_elements))
+                {
+                    if (index < 0)
+                    {
+                        compiler_diagnostic(C_ERROR_STRUCT_MEMBER_NOT_FOUND,
+                                            ctx,
+                                            p_designator->constant_expression_opt->first_token,
+                                            NULL,
+                                            "array designator value '%d' is negative", (int)index);
+                    }
+                    else if (index > num_of_elements)
+                    {
+                        compiler_diagnostic(C_ERROR_STRUCT_MEMBER_NOT_FOUND,
+                                            ctx,
+                                            p_designator->constant_expression_opt->first_token,
+                                            NULL,
+                                            "array index '%d' in initializer exceeds array bounds", (int)index);
+                    }
+                    p_initializer_list_item = p_initializer_list_item->next;
+                    break;
+                }
+            }
+
+            if (p_initializer_list_item->initializer->embed)
+            {
+                /*each value of #embed initializes the next element*/
+                struct embed_initializer* p_embed = p_initializer_list_item->initializer->embed;
+                const char* p_text = p_embed->token->lexeme;
+                unsigned char value = 0;
+                bool excess_elements = false;
+
+                while (embed_next_value(&p_text, &value))
+                {
+                    if (!compute_array_size && index >= num_of_elements)
+                    {
+                        excess_elements = true;
+                        break;
+                    }
+
+                    if (compute_array_size &&
+                        object_extend_array(p_array_item_type, current_object, (size_t)index, is_constant, target) != 0)
+                    {
+                        throw;
+                    }
+
+                    const struct object object = object_make_signed_int(target, value);
+                    if (object_set_element_value(current_object, (size_t)index, &object, is_constant) != 0)
+                    {
+                        struct expression* _Opt p_value = embed_initializer_value(ctx, p_embed, value);
+                        struct object* _Opt p_element = object_get_member(current_object, (size_t)index);
+                        if (p_value == NULL ||
+                            p_element == NULL ||
+                            object_set(ctx, p_element, p_value, &p_value->object, is_constant, requires_constant_initialization) != 0)
+                        {
+                            throw;
+                        }
+                    }
+
+                    if (index > max_index)
+                        max_index = index;
+                    index++;
+                }
+
+                if (excess_elements)
+                {
+                    compiler_diagnostic(W_TO_MANY_INITIALIZERS,
+                                        ctx,
+                                        p_embed->token,
+                                        NULL,
+                                        "warning: excess elements in initializer");
+                    p_initializer_list_item = NULL;
+                    break;
+                }
+            }
+            else if (p_initializer_list_item->initializer->assignment_expression)
+            {
+                if (!compute_array_size && index >= num_of_elements)
+                    break;
+
+                if (compute_array_size &&
+                    object_extend_array(p_array_item_type, current_object, (size_t)index, is_constant, target) != 0)
+                {
+                    throw;
+                }
+
+                struct expression* p_expression = p_initializer_list_item->initializer->assignment_expression;
+                if (p_expression->expression_type == PRIMARY_EXPRESSION_STRING_LITERAL ||
+                    object_set_element_value(current_object, (size_t)index, &p_expression->object, is_constant) != 0)
+                {
+                    struct object* _Opt p_element = object_get_member(current_object, (size_t)index);
+                    if (p_element == NULL ||
+                        object_set(ctx, p_element, p_expression, &p_expression->object, is_constant, requires_constant_initialization) != 0)
+                    {
+                        throw;
+                    }
+                }
+
+                if (index > max_index)
+                    max_index = index;
+                index++;
+            }
+
+            p_initializer_list_item = p_initializer_list_item->next;
+        }
+
+        if (p_initializer_list_item != NULL)
+        {
+            compiler_diagnostic(W_TO_MANY_INITIALIZERS,
+                                ctx,
+                                p_initializer_list_item->initializer->first_token,
+                                NULL,
+                                "warning: excess elements in initializer");
+        }
+
+        if (compute_array_size)
+        {
+            current_object->type.array_num_elements = (size_t)(max_index + 1);
+            p_current_object_type->array_num_elements = (size_t)(max_index + 1);
+        }
+    }
+    catch
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
 _Attr(nodiscard)
 static int braced_initializer_new(struct parser_ctx* ctx,
                                   struct type* p_current_object_type,
@@ -12056,6 +12617,32 @@ static int braced_initializer_new(struct parser_ctx* ctx,
                 }
             }
 
+            else if (p_initializer_list_item->initializer->embed)
+            {
+                /*int i = { #embed "one_byte.bin" };*/
+                struct embed_initializer* p_embed = p_initializer_list_item->initializer->embed;
+                const char* p_text = p_embed->token->lexeme;
+                unsigned char value = 0;
+                if (embed_next_value(&p_text, &value))
+                {
+                    struct expression* _Opt p_value = embed_initializer_value(ctx, p_embed, value);
+                    if (p_value == NULL)
+                        throw;
+
+                    if (object_set(ctx, current_object, p_value, &p_value->object, is_constant, requires_constant_initialization) != 0)
+                        throw;
+                }
+
+                if (embed_next_value(&p_text, &value))
+                {
+                    compiler_diagnostic(W_TO_MANY_INITIALIZERS,
+                                                ctx,
+                                                p_embed->token,
+                                                NULL,
+                                                "warning: excess elements in initializer");
+                }
+            }
+
             p_initializer_list_item = p_initializer_list_item->next;
 
             if (p_initializer_list_item != NULL)
@@ -12129,13 +12716,29 @@ static int braced_initializer_new(struct parser_ctx* ctx,
                             }
                         }
 
-                        //printf("\n");
+                        //console_printf("\n");
                         //object_print_to_debug(current_object);
                         type_destroy(&array_item_type);
                         return 0;
                     }
                 }
             }
+
+            if (type_is_integer(&array_item_type) &&
+                initializer_list_is_flat(braced_initializer->initializer_list))
+            {
+                const int result = braced_initializer_integer_array(ctx,
+                    p_current_object_type,
+                    current_object,
+                    braced_initializer,
+                    &array_item_type,
+                    is_constant,
+                    requires_constant_initialization);
+
+                current_object->parent = parent_copy;
+                type_destroy(&array_item_type);
+                return result;
+            }
         }
 
         struct object* _Opt p_subobject = NULL;
@@ -12206,7 +12809,79 @@ static int braced_initializer_new(struct parser_ctx* ctx,
 
 
 
-            if (p_initializer_list_item->initializer->braced_initializer)
+            if (p_initializer_list_item->initializer->embed)
+            {
+                /*
+                  each value of #embed initializes the next subobject,
+                  like a list of initializers without designation
+                */
+                struct embed_initializer* p_embed = p_initializer_list_item->initializer->embed;
+                const char* p_text = p_embed->token->lexeme;
+                unsigned char value = 0;
+                bool first_value = true;
+                bool excess_elements = false;
+
+                while (embed_next_value(&p_text, &value))
+                {
+                    if (!first_value)
+                    {
+                        if (compute_array_size)
+                        {
+                            struct object* _Opt po = find_next_subobject(p_current_object_type, current_object, p_subobject, &subobject_type, &is_subobject_of_union);
+                            if (po == NULL)
+                            {
+                                array_to_expand_index++;
+                                if (array_to_expand_index > array_to_expand_max_index)
+                                    array_to_expand_max_index = array_to_expand_index;
+
+                                object_extend_array_to_index(&array_item_type, current_object, array_to_expand_max_index, is_constant, ctx->options.target);
+                            }
+                        }
+
+                        p_subobject = find_next_subobject(p_current_object_type, current_object, p_subobject, &subobject_type, &is_subobject_of_union);
+                    }
+                    first_value = false;
+
+                    while (p_subobject &&
+                           (type_is_array(&subobject_type) || type_is_struct_or_union(&subobject_type)))
+                    {
+                        p_subobject = find_next_subobject(p_current_object_type, current_object, p_subobject, &subobject_type, &is_subobject_of_union);
+                    }
+
+                    if (p_subobject == NULL)
+                    {
+                        excess_elements = true;
+                        break;
+                    }
+
+                    struct expression* _Opt p_value = embed_initializer_value(ctx, p_embed, value);
+                    if (p_value == NULL ||
+                        object_set(ctx,
+                                   p_subobject,
+                                   p_value,
+                                   &p_value->object,
+                                   is_constant,
+                                   requires_constant_initialization) != 0)
+                    {
+                        type_destroy(&array_item_type);
+                        type_destroy(&subobject_type);
+                        throw;
+                    }
+                }
+
+                if (excess_elements)
+                {
+                    compiler_diagnostic(W_TO_MANY_INITIALIZERS,
+                                        ctx,
+                                        p_embed->token,
+                                        NULL,
+                                        "warning: excess elements in initializer");
+                    p_initializer_list_item = NULL;
+                    type_destroy(&subobject_type);
+                    break;
+                }
+            }
+            else if (p_initializer_list_item->initializer->braced_initializer)
             {
                 if (braced_initializer_new(ctx,
                     &subobject_type,
@@ -15,6 +15,7 @@
 #include "osstream.h"
 #include "type.h"
 #include "options.h"
+#include "arena.h"
 
 
 struct scope
@@ -23,20 +24,64 @@ struct scope
     struct hash_map tags;
     struct hash_map variables;
 
+    /*size of the binding stack when this scope was pushed*/
+    int bindings_start;
+
     struct scope* _Opt next;
     struct scope* _Opt previous;
 };
 
 void scope_destroy(_Dtor struct scope* p);
 
+/*
+  A name declared in some scope. Bindings of the same name form a stack,
+  the top is the visible declaration and shadowed is the one it hides.
+*/
+struct binding
+{
+    /*entry in the variables or tags of p_scope*/
+    struct map_entry* p_entry;
+    struct scope* p_scope;
+
+    /*entry of the name in scope_list variables or tags*/
+    struct map_entry* p_top;
+
+    /*index of the binding hidden by this one or -1*/
+    int shadowed;
+};
+
+/*
+  Besides the scopes, the scope list has one binding stack for all names.
+  Bindings are pushed when names are inserted in the tail scope (or when a
+  scope that already has names is pushed) and popped with their scope, so
+  lookups do not walk the scopes.
+*/
 struct scope_list
 {
     struct scope* _Opt head;
     struct scope* _Opt tail;
+
+    struct binding* _Owner _Opt bindings;
+    int bindings_size;
+    int bindings_capacity;
+
+    /*name -> index + 1 of the top binding, 0 if not visible*/
+    struct hash_map variables;
+    struct hash_map tags;
 };
+void scope_list_destroy(_Dtor struct scope_list* list);
 void scope_list_push(struct scope_list* list, struct scope* s);
 void scope_list_pop(struct scope_list* list);
 
+/*
+  Inserts key into the variables or tags of the tail scope and makes it
+  visible. Returns the same as hashmap_set.
+*/
+int scope_list_set_variable(struct scope_list* list, const char* key, struct hash_item_set* item);
+int scope_list_set_tag(struct scope_list* list, const char* key, struct hash_item_set* item);
+
+struct time_report;
+
 struct report
 {
     int no_files;
@@ -53,6 +98,9 @@ struct report
       direct commands like -autoconfig doesnt use report
     */
     bool ignore_this_report;
+
+    /*-ftime-report times of the file being compiled*/
+    struct time_report* _Opt p_time_report;
 };
 
 struct label_list_item
@@ -121,6 +169,15 @@ struct parser_ctx
     struct token* _Opt current;
     struct token* _Opt previous;
 
+    /*
+      Final tokens (TK_FLAG_FINAL) of input_list in order. The parser moves
+      through this array instead of walking blanks, comments and directives.
+      final_index is the position of current in the array.
+    */
+    struct token** _Owner _Opt final_tokens;
+    int final_tokens_size;
+    int final_index;
+
     bool inside_generic_association;
 
     int label_id; /*generates unique ids for labels*/
@@ -147,6 +204,7 @@ void parser_ctx_destroy(_Opt _Dtor struct parser_ctx* ctx);
 struct token* _Opt parser_look_ahead(const struct parser_ctx* ctx);
 void unexpected_end_of_file(struct parser_ctx* ctx);
 void parser_match(struct parser_ctx* ctx);
+int parser_expand_embed(struct parser_ctx* ctx);
 _Attr(nodiscard)
 int parser_match_tk(struct parser_ctx* ctx, enum token_type type);
 
@@ -622,7 +680,7 @@ struct member_declaration_list member_declaration_list(struct parser_ctx* ctx, s
 void member_declaration_list_destroy(_Opt _Dtor struct member_declaration_list* p);
 void member_declaration_list_add(struct member_declaration_list* list, struct member_declaration* _Owner p_item);
 
-struct member_declarator* _Opt find_member_declarator(struct member_declaration_list* list, const char* name, int* p_member_index);
+struct member_declarator* _Opt find_member_declarator(struct struct_or_union_specifier* p_complete, const char* name, int* p_member_index, enum target target);
 
 struct struct_or_union_specifier
 {
@@ -663,6 +721,9 @@ struct struct_or_union_specifier
     * struct_or_union_specifier.
     */
     struct struct_or_union_specifier* _Opt complete_struct_or_union_specifier_indirection;
+
+    /*layout of the complete struct for each target, see struct_layout_get*/
+    struct struct_layout* _Owner _Opt layouts[NUMBER_OF_TARGETS];
 };
 
 struct struct_or_union_specifier* _Owner _Opt struct_or_union_specifier(struct parser_ctx* ctx);
@@ -700,6 +761,18 @@ struct init_declarator* _Owner _Opt init_declarator(struct parser_ctx* ctx,
     struct declaration_specifiers* p_declaration_specifiers
 );
 
+struct embed_initializer
+{
+    /*
+      #embed data (TK_EMBED) used directly as a list of initializers.
+      values[v] is the constant shared by all elements initialized with v.
+    */
+    struct token* token;
+    struct expression* _Owner _Opt values[256];
+};
+
+void embed_initializer_delete(struct embed_initializer* _Owner _Opt p);
+
 struct initializer
 {
     /*
@@ -710,6 +783,9 @@ struct initializer
     struct token* first_token;
     struct braced_initializer* _Owner _Opt braced_initializer;
     struct expression* _Owner _Opt assignment_expression;
+
+    /*only inside initializer-list*/
+    struct embed_initializer* _Owner _Opt embed;
 };
 
 struct initializer* _Owner _Opt initializer(struct parser_ctx* ctx, enum expression_eval_mode eval_mode);
@@ -1707,6 +1783,12 @@ struct ast
 {
     struct token_list token_list;
     struct declaration_list declaration_list;
+
+    /*
+      tokens and expressions of this ast (unless -no-arena).
+      It must be the current arena while the ast is changed.
+    */
+    struct arena arena;
 };
 
 
@@ -564,7 +564,15 @@ static void pre_multiplicative_expression(struct preprocessor_ctx* ctx, struct p
             }
             else if (op == '%')
             {
-                ectx->value = (left_value % ectx->value);
+                if (ectx->value == 0)
+                {
+                    preprocessor_diagnostic(C_PRE_DIVISION_BY_ZERO, ctx, op_token, "division by zero");
+                    throw;
+                }
+                else
+                {
+                    ectx->value = (left_value % ectx->value);
+                }
             }
         }
     }
@@ -643,7 +651,7 @@ static void pre_shift_expression(struct preprocessor_ctx* ctx, struct pre_expres
             enum token_type op = ctx->current->type;
             pre_match(ctx);
             long long left_value = ectx->value;
-            pre_multiplicative_expression(ctx, ectx);
+            pre_additive_expression(ctx, ectx);
             if (ctx->n_errors > 0)
                 throw;
 
@@ -745,7 +753,7 @@ static void pre_equality_expression(struct preprocessor_ctx* ctx, struct pre_exp
             enum token_type op = ctx->current->type;
             pre_match(ctx);
             long long left_value = ectx->value;
-            pre_multiplicative_expression(ctx, ectx);
+            pre_relational_expression(ctx, ectx);
             if (ctx->n_errors > 0)
                 throw;
 
@@ -0,0 +1,194 @@
+/*
+ *  This file is part of cake compiler
+ *  https://github.com/thradams/cake
+*/
+
+#pragma safety enable
+
+#include "ownership.h"
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "thread.h"
+
+#if defined(CAKE_NO_THREADS)
+
+#elif defined(_WIN32)
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+enum
+{
+    /*the calling thread is also a worker*/
+    MAX_WORKER_THREADS = 64
+};
+
+#if defined(CAKE_NO_THREADS)
+
+void shared_lock_acquire(enum shared_lock lock) {}
+void shared_lock_release(enum shared_lock lock) {}
+
+#else
+
+/*
+  true while run_parallel has worker threads. It is only changed by the
+  calling thread when no worker is running, so the locks are skipped
+  when compiling without -j.
+*/
+static bool s_threads_running = false;
+
+#if defined(_WIN32)
+
+static SRWLOCK s_locks[SHARED_LOCK_COUNT] = { SRWLOCK_INIT, SRWLOCK_INIT, SRWLOCK_INIT, SRWLOCK_INIT };
+
+void shared_lock_acquire(enum shared_lock lock)
+{
+    if (s_threads_running)
+        AcquireSRWLockExclusive(&s_locks[lock]);
+}
+
+void shared_lock_release(enum shared_lock lock)
+{
+    if (s_threads_running)
+        ReleaseSRWLockExclusive(&s_locks[lock]);
+}
+
+#else
+
+static pthread_mutex_t s_locks[SHARED_LOCK_COUNT] = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER };
+
+void shared_lock_acquire(enum shared_lock lock)
+{
+    if (s_threads_running)
+        pthread_mutex_lock(&s_locks[lock]);
+}
+
+void shared_lock_release(enum shared_lock lock)
+{
+    if (s_threads_running)
+        pthread_mutex_unlock(&s_locks[lock]);
+}
+
+#endif
+
+#endif
+
+int hardware_concurrency(void)
+{
+#if defined(CAKE_NO_THREADS)
+    return 1;
+#elif defined(_WIN32)
+    SYSTEM_INFO info = { 0 };
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+static_assert(SHARED_LOCK_COUNT == 4, "initialize all locks");
+
+struct work_queue
+{
+    int count;
+    int next;
+    void (*work)(void* data, int index);
+    void* data;
+};
+
+static int work_queue_pop(struct work_queue* queue)
+{
+    shared_lock_acquire(SHARED_LOCK_WORK_QUEUE);
+    const int index = queue->next < queue->count ? queue->next++ : -1;
+    shared_lock_release(SHARED_LOCK_WORK_QUEUE);
+    return index;
+}
+
+static void work_queue_run(struct work_queue* queue)
+{
+    for (;;)
+    {
+        const int index = work_queue_pop(queue);
+        if (index < 0)
+            break;
+        queue->work(queue->data, index);
+    }
+}
+
+#if defined(CAKE_NO_THREADS)
+
+#elif defined(_WIN32)
+
+static DWORD WINAPI worker_thread(LPVOID p)
+{
+    work_queue_run((struct work_queue*)p);
+    return 0;
+}
+
+#else
+
+static void* _Opt worker_thread(void* p)
+{
+    work_queue_run((struct work_queue*)p);
+    return NULL;
+}
+
+#endif
+
+void run_parallel(int count, int max_threads, void (*work)(void* data, int index), void* data)
+{
+    struct work_queue queue = { .count = count, .work = work, .data = data };
+
+    if (max_threads > count)
+        max_threads = count;
+    if (max_threads > MAX_WORKER_THREADS)
+        max_threads = MAX_WORKER_THREADS;
+
+#if !defined(CAKE_NO_THREADS)
+
+    int n_threads = 0;
+
+    /*set before the threads are created*/
+    s_threads_running = max_threads > 1;
+
+#if defined(_WIN32)
+    HANDLE threads[MAX_WORKER_THREADS] = { 0 };
+    for (int i = 0; i < max_threads - 1; i++)
+    {
+        HANDLE h = CreateThread(NULL, 0, worker_thread, &queue, 0, NULL);
+        if (h == NULL)
+            break; /*the remaining threads do the work*/
+        threads[n_threads++] = h;
+    }
+#else
+    pthread_t threads[MAX_WORKER_THREADS] = { 0 };
+    for (int i = 0; i < max_threads - 1; i++)
+    {
+        if (pthread_create(&threads[n_threads], NULL, worker_thread, &queue) != 0)
+            break; /*the remaining threads do the work*/
+        n_threads++;
+    }
+#endif
+
+#endif
+
+    work_queue_run(&queue);
+
+#if !defined(CAKE_NO_THREADS)
+    for (int i = 0; i < n_threads; i++)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+
+    s_threads_running = false;
+#endif
+}
@@ -0,0 +1,50 @@
+/*
+ *  This file is part of cake compiler
+ *  https://github.com/thradams/cake
+*/
+
+#pragma once
+
+/*
+  Minimal portable threads used by -j.
+  On platforms without threads (emscripten, tcc) everything runs
+  on the calling thread.
+*/
+
+#if defined(__EMSCRIPTEN__) || defined(__TINYC__)
+#define CAKE_NO_THREADS
+#endif
+
+#if defined(CAKE_NO_THREADS)
+#define THREAD_LOCAL
+#elif defined(_MSC_VER) && !defined(__CAKE__)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+/*
+  Locks protecting the data shared by all files being compiled.
+*/
+enum shared_lock
+{
+    SHARED_LOCK_ATOMS,
+    SHARED_LOCK_INCLUDE_FILES,
+    SHARED_LOCK_WORK_QUEUE,
+    SHARED_LOCK_CACHE,
+    SHARED_LOCK_COUNT
+};
+
+void shared_lock_acquire(enum shared_lock lock);
+void shared_lock_release(enum shared_lock lock);
+
+/*
+  Number of processors available. 1 when threads are not supported.
+*/
+int hardware_concurrency(void);
+
+/*
+  Calls work(data, index) for index in [0, count) using up to
+  max_threads threads. The calling thread waits all of them.
+*/
+void run_parallel(int count, int max_threads, void (*work)(void* data, int index), void* data);
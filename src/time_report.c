@@ -0,0 +1,366 @@
+/*
+ *  This file is part of cake compiler
+ *  https://github.com/thradams/cake
+*/
+
+#pragma safety enable
+
+#include "ownership.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "time_report.h"
+#include "console.h"
+#include "thread.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <psapi.h>
+#elif !defined(__EMSCRIPTEN__)
+#include <sys/resource.h>
+#endif
+
+static const char* const s_phase_names[TIME_PHASE_COUNT] = {
+    "read",
+    "tokenizer",
+    "preprocessor",
+    "parse",
+    "defer",
+    "flow",
+    "visit",
+    "write"
+};
+
+static const char* const s_counter_names[TIME_COUNTER_COUNT] = {
+    "tokens",
+    "macro_expansions",
+    "include_files",
+    "ast_nodes"
+};
+
+enum
+{
+    /*shorter macro expansions are not written to the trace*/
+    TIME_TRACE_MIN_MACRO_US = 20
+};
+
+static THREAD_LOCAL long long s_counters[TIME_COUNTER_COUNT] = { 0 };
+
+void time_counter_add(enum time_counter counter)
+{
+    s_counters[counter]++;
+}
+
+void time_counters_get(long long counters[TIME_COUNTER_COUNT])
+{
+    for (int i = 0; i < TIME_COUNTER_COUNT; i++)
+        counters[i] = s_counters[i];
+}
+
+static void print_json_string(struct osstream* ss, const char* s)
+{
+    ss_putc('"', ss);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            ss_putc('\\', ss);
+        ss_putc(*s, ss);
+    }
+    ss_putc('"', ss);
+}
+
+static void time_profile_destroy(_Dtor struct time_profile* p)
+{
+    free(p->data);
+    hashmap_destroy(&p->map);
+}
+
+static void time_profile_add(struct time_profile* p, const char* name, int count, long long tokens, double wall)
+{
+    struct map_entry* _Opt p_entry = hashmap_find(&p->map, name);
+    if (p_entry == NULL)
+    {
+        if (p->size == p->capacity)
+        {
+            const int new_capacity = p->capacity == 0 ? 64 : p->capacity * 2;
+            void* _Owner _Opt pnew = realloc(p->data, new_capacity * sizeof(struct time_profile_entry));
+            if (pnew == NULL)
+                return;
+            static_set(p->data, "moved");
+            p->data = pnew;
+            p->capacity = new_capacity;
+        }
+
+        struct hash_item_set item = { 0 };
+        item.number = (size_t)p->size + 1;
+        hashmap_set(&p->map, name, &item);
+        hash_item_set_destroy(&item);
+
+        p_entry = hashmap_find(&p->map, name);
+        if (p_entry == NULL || p->data == NULL)
+            return;
+
+        struct time_profile_entry* p_new = &p->data[p->size];
+        memset(p_new, 0, sizeof * p_new);
+        p_new->name = p_entry->key;
+        p->size++;
+    }
+
+    assert(p->data != NULL);
+    struct time_profile_entry* p_item = &p->data[p_entry->data.number - 1];
+    p_item->count += count;
+    p_item->tokens += tokens;
+    p_item->wall += wall;
+}
+
+void time_report_destroy(_Dtor struct time_report* p)
+{
+    time_profile_destroy(&p->includes);
+    time_profile_destroy(&p->macros);
+    ss_close(&p->trace_events);
+}
+
+double time_report_wall_now(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter = { 0 };
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#elif defined(__EMSCRIPTEN__)
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+static struct time_stamp time_stamp_now(void)
+{
+    struct time_stamp r = { 0 };
+    r.wall = time_report_wall_now();
+
+#if defined(_WIN32)
+
+    /*the cpu time of this thread, files can be compiled in parallel (-j)*/
+    FILETIME creation = { 0 }, exit = { 0 }, kernel = { 0 }, user = { 0 };
+    if (GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+    {
+        const unsigned long long k = ((unsigned long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+        const unsigned long long u = ((unsigned long long)user.dwHighDateTime << 32) | user.dwLowDateTime;
+        r.cpu = (double)(k + u) / 1e7;
+    }
+#elif defined(__EMSCRIPTEN__)
+    r.cpu = (double)clock() / CLOCKS_PER_SEC;
+#else
+    /*the cpu time of this thread, files can be compiled in parallel (-j)*/
+    struct timespec ts = { 0 };
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    r.cpu = (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+
+    return r;
+}
+
+struct time_stamp time_report_start(const struct time_report* _Opt p)
+{
+    if (p == NULL)
+    {
+        const struct time_stamp zero = { 0 };
+        return zero;
+    }
+    return time_stamp_now();
+}
+
+void time_report_stop(struct time_report* _Opt p, enum time_phase phase, struct time_stamp start)
+{
+    if (p == NULL)
+        return;
+
+    const struct time_stamp now = time_stamp_now();
+    p->wall[phase] += now.wall - start.wall;
+    p->cpu[phase] += now.cpu - start.cpu;
+
+    if (phase == TIME_PHASE_DEFER || phase == TIME_PHASE_FLOW)
+    {
+        /*they run inside parse*/
+        p->wall[TIME_PHASE_PARSE] -= now.wall - start.wall;
+        p->cpu[TIME_PHASE_PARSE] -= now.cpu - start.cpu;
+    }
+}
+
+void time_report_span(struct time_report* p, enum time_span span, const char* name, double begin, long long tokens)
+{
+    const double end = time_report_wall_now();
+
+    if (p->profile)
+    {
+        if (span == TIME_SPAN_INCLUDE)
+            time_profile_add(&p->includes, name, 1, tokens, end - begin);
+        else if (span == TIME_SPAN_MACRO)
+            time_profile_add(&p->macros, name, 1, tokens, end - begin);
+    }
+
+    if (p->trace &&
+        (span != TIME_SPAN_MACRO || (end - begin) * 1e6 >= TIME_TRACE_MIN_MACRO_US))
+    {
+        const char* const category =
+            span == TIME_SPAN_FILE ? "file" :
+            span == TIME_SPAN_INCLUDE ? "include" :
+            "macro";
+
+        if (p->trace_events.size > 0)
+            ss_fprintf(&p->trace_events, ",\n");
+
+        ss_fprintf(&p->trace_events, "    { \"name\": ");
+        print_json_string(&p->trace_events, name);
+        ss_fprintf(&p->trace_events,
+            ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.1f, \"dur\": %.1f, \"pid\": 1, \"tid\": %d, \"args\": { \"tokens\": %lld } }",
+            category,
+            begin * 1e6,
+            (end - begin) * 1e6,
+            p->trace_thread_id,
+            tokens);
+    }
+}
+
+void time_report_sum(struct time_report* total, const struct time_report* p)
+{
+    for (int i = 0; i < TIME_PHASE_COUNT; i++)
+    {
+        total->wall[i] += p->wall[i];
+        total->cpu[i] += p->cpu[i];
+    }
+
+    for (int i = 0; i < TIME_COUNTER_COUNT; i++)
+        total->counters[i] += p->counters[i];
+
+    total->arena_bytes += p->arena_bytes;
+
+    for (int i = 0; i < p->includes.size; i++)
+    {
+        assert(p->includes.data != NULL);
+        const struct time_profile_entry* e = &p->includes.data[i];
+        time_profile_add(&total->includes, e->name, e->count, e->tokens, e->wall);
+    }
+
+    for (int i = 0; i < p->macros.size; i++)
+    {
+        assert(p->macros.data != NULL);
+        const struct time_profile_entry* e = &p->macros.data[i];
+        time_profile_add(&total->macros, e->name, e->count, e->tokens, e->wall);
+    }
+}
+
+long long peak_memory_bytes(void)
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters = { 0 };
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters))
+        return (long long)counters.PeakWorkingSetSize;
+    return 0;
+#elif defined(__EMSCRIPTEN__)
+    return 0;
+#else
+    struct rusage usage = { 0 };
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return (long long)usage.ru_maxrss;
+#else
+    /*kilobytes*/
+    return (long long)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+void time_report_print(const struct time_report* p)
+{
+    double total_wall = 0;
+    double total_cpu = 0;
+
+    console_printf("%s\n", p->file_name ? p->file_name : "");
+    console_printf("  %-14s %12s %12s\n", "phase", "wall (ms)", "cpu (ms)");
+    for (int i = 0; i < TIME_PHASE_COUNT; i++)
+    {
+        console_printf("  %-14s %12.3f %12.3f\n", s_phase_names[i], p->wall[i] * 1000, p->cpu[i] * 1000);
+        total_wall += p->wall[i];
+        total_cpu += p->cpu[i];
+    }
+    console_printf("  %-14s %12.3f %12.3f\n", "total", total_wall * 1000, total_cpu * 1000);
+
+    for (int i = 0; i < TIME_COUNTER_COUNT; i++)
+        console_printf("  %-27s %12lld\n", s_counter_names[i], p->counters[i]);
+
+    console_printf("  %-27s %12lld\n", "arena_bytes", p->arena_bytes);
+}
+
+void time_report_print_json(struct osstream* ss, const struct time_report* p)
+{
+    ss_fprintf(ss, "    {\n");
+    ss_fprintf(ss, "      \"file\": ");
+    print_json_string(ss, p->file_name ? p->file_name : "");
+    ss_fprintf(ss, ",\n");
+
+    for (int k = 0; k < 2; k++)
+    {
+        const double* times = k == 0 ? p->wall : p->cpu;
+        ss_fprintf(ss, "      \"%s\": {", k == 0 ? "wall_ms" : "cpu_ms");
+        double total = 0;
+        for (int i = 0; i < TIME_PHASE_COUNT; i++)
+        {
+            ss_fprintf(ss, " \"%s\": %.3f,", s_phase_names[i], times[i] * 1000);
+            total += times[i];
+        }
+        ss_fprintf(ss, " \"total\": %.3f },\n", total * 1000);
+    }
+
+    for (int i = 0; i < TIME_COUNTER_COUNT; i++)
+        ss_fprintf(ss, "      \"%s\": %lld,\n", s_counter_names[i], p->counters[i]);
+
+    ss_fprintf(ss, "      \"arena_bytes\": %lld\n", p->arena_bytes);
+    ss_fprintf(ss, "    }");
+}
+
+static int time_profile_entry_compare(const void* a, const void* b)
+{
+    const struct time_profile_entry* pa = a;
+    const struct time_profile_entry* pb = b;
+    return pa->wall < pb->wall ? 1 : pa->wall > pb->wall ? -1 : 0;
+}
+
+static void time_profile_print_top(const struct time_profile* p, const char* title, int n)
+{
+    if (p->size == 0 || p->data == NULL)
+        return;
+
+    struct time_profile_entry* _Owner _Opt sorted = malloc(p->size * sizeof(struct time_profile_entry));
+    if (sorted == NULL)
+        return;
+
+    memcpy(sorted, p->data, p->size * sizeof(struct time_profile_entry));
+    qsort(sorted, p->size, sizeof(struct time_profile_entry), time_profile_entry_compare);
+
+    console_printf("top %d %s (inclusive)\n", n < p->size ? n : p->size, title);
+    console_printf("  %12s %8s %12s  %s\n", "wall (ms)", "count", "tokens", "name");
+    for (int i = 0; i < n && i < p->size; i++)
+    {
+        console_printf("  %12.3f %8d %12lld  %s\n",
+            sorted[i].wall * 1000,
+            sorted[i].count,
+            sorted[i].tokens,
+            sorted[i].name);
+    }
+
+    free(sorted);
+}
+
+void time_report_print_top(const struct time_report* p, int n)
+{
+    time_profile_print_top(&p->includes, "include files", n);
+    time_profile_print_top(&p->macros, "macros", n);
+}
@@ -0,0 +1,136 @@
+/*
+ *  This file is part of cake compiler
+ *  https://github.com/thradams/cake
+*/
+
+#pragma once
+#include <stdbool.h>
+#include "ownership.h"
+#include "osstream.h"
+#include "hashmap.h"
+
+/*
+  -ftime-report
+  Wall and cpu time of each phase and some counters, for each file.
+*/
+
+enum time_phase
+{
+    TIME_PHASE_READ,
+    TIME_PHASE_TOKENIZER,
+    TIME_PHASE_PREPROCESSOR,
+    TIME_PHASE_PARSE,
+    TIME_PHASE_DEFER,
+    TIME_PHASE_FLOW,
+    TIME_PHASE_VISIT,
+    TIME_PHASE_WRITE,
+    TIME_PHASE_COUNT
+};
+
+/*
+  Counters are per thread; each file reads them before and after
+  it is compiled.
+*/
+enum time_counter
+{
+    TIME_COUNTER_TOKENS,
+    TIME_COUNTER_MACRO_EXPANSIONS,
+    TIME_COUNTER_INCLUDE_FILES,
+
+    /*expressions, statements and declarations*/
+    TIME_COUNTER_AST_NODES,
+
+    TIME_COUNTER_COUNT
+};
+
+struct time_stamp
+{
+    double wall;
+    double cpu;
+};
+
+/*
+  -ftime-report-top N
+  Time (inclusive) and tokens produced by each include file or macro,
+  summed for all the times it was included or expanded.
+*/
+struct time_profile_entry
+{
+    const char* name; /*atom*/
+    int count;
+    long long tokens;
+    double wall;
+};
+
+struct time_profile
+{
+    struct time_profile_entry* _Owner _Opt data;
+    int size;
+    int capacity;
+
+    /*name -> index + 1*/
+    struct hash_map map;
+};
+
+enum time_span
+{
+    TIME_SPAN_FILE,
+    TIME_SPAN_INCLUDE,
+    TIME_SPAN_MACRO
+};
+
+struct time_report
+{
+    const char* _Opt file_name;
+
+    /*seconds*/
+    double wall[TIME_PHASE_COUNT];
+    double cpu[TIME_PHASE_COUNT];
+
+    long long counters[TIME_COUNTER_COUNT];
+
+    /*memory used by the tokens and expressions of the file*/
+    long long arena_bytes;
+
+    /*-ftime-report-top*/
+    bool profile;
+    struct time_profile includes;
+    struct time_profile macros;
+
+    /*-ftime-trace, chrome trace events of this file*/
+    bool trace;
+    int trace_thread_id;
+    struct osstream trace_events;
+};
+
+void time_report_destroy(_Dtor struct time_report* p);
+
+void time_counter_add(enum time_counter counter);
+void time_counters_get(long long counters[TIME_COUNTER_COUNT]);
+
+/*
+  time_report_start returns the current time, time_report_stop adds the
+  time since start to the phase. Both do nothing when p is NULL.
+  Defer and flow run inside parse, so their time is removed from parse.
+*/
+struct time_stamp time_report_start(const struct time_report* _Opt p);
+void time_report_stop(struct time_report* _Opt p, enum time_phase phase, struct time_stamp start);
+
+/*wall time in seconds, used by time_report_span*/
+double time_report_wall_now(void);
+
+/*
+  Adds the include file or macro from begin until now to the profile and
+  to the trace. tokens is the number of tokens produced.
+*/
+void time_report_span(struct time_report* p, enum time_span span, const char* name, double begin, long long tokens);
+
+/*adds the times and counters of p to total*/
+void time_report_sum(struct time_report* total, const struct time_report* p);
+
+/*peak memory of the process in bytes, 0 if unknown*/
+long long peak_memory_bytes(void);
+
+void time_report_print(const struct time_report* p);
+void time_report_print_json(struct osstream* ss, const struct time_report* p);
+void time_report_print_top(const struct time_report* p, int n);
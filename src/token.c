@@ -15,6 +15,8 @@
 #include "console.h"
 #include "osstream.h"
 #include "tokenizer.h"
+#include "arena.h"
+#include "time_report.h"
 
 
 #ifdef _WIN32
@@ -189,8 +191,57 @@ void token_list_swap(struct token_list* a, struct token_list* b)
     *b = temp;
 }
 
+/*
+  Allocates a zeroed token from the current arena if there is one.
+*/
+struct token* _Owner _Opt token_new(void)
+{
+    time_counter_add(TIME_COUNTER_TOKENS);
+
+    struct arena* _Opt p_arena = arena_get_current();
+    if (p_arena)
+    {
+        struct token* _Opt p = arena_calloc(p_arena, sizeof(struct token));
+        if (p == NULL)
+            return NULL;
+        p->in_arena = true;
+        return (struct token* _Owner)p;
+    }
+    return calloc(1, sizeof(struct token));
+}
+
+/*
+  Copies a lexeme to be used by token p. It lives in the same storage of the token.
+*/
+char* _Owner _Opt token_lexeme_dup(struct token* p, const char* s, size_t length)
+{
+    struct arena* _Opt p_arena = arena_get_current();
+
+    /*arena tokens are changed only while their arena is the current one*/
+    assert(!p->in_arena || p_arena != NULL);
+
+    if (p->in_arena && p_arena)
+    {
+        return (char* _Owner _Opt)arena_strndup(p_arena, s, length);
+    }
+
+    char* _Owner _Opt temp = malloc(length + 1);
+    if (temp == NULL)
+        return NULL;
+    memcpy(temp, s, length);
+    temp[length] = '\0';
+    return temp;
+}
+
 void token_delete(struct token* _Owner _Opt p)
 {
+    if (p && p->in_arena)
+    {
+        /*released with the arena*/
+        static_set(p, "moved");
+        return;
+    }
+
     if (p)
     {
         /*
@@ -198,11 +249,39 @@ void token_delete(struct token* _Owner _Opt p)
          * we need a way to remove only this specific warning
         */
         assert(p->next == NULL);
-        free(p->lexeme);
+        if (p->lexeme_is_atom)
+            static_set(p->lexeme, "moved");
+        else
+            free(p->lexeme);
         free(p);
     }
 }
 
+void token_set_lexeme(struct token* p, char* _Owner lexeme)
+{
+    if (p->lexeme_is_atom || p->in_arena)
+        static_set(p->lexeme, "moved");
+    else
+        free(p->lexeme);
+
+    p->lexeme_is_atom = false;
+
+    if (p->in_arena)
+    {
+        /*arena tokens don't own heap memory*/
+        char* _Owner _Opt temp = token_lexeme_dup(p, lexeme, strlen(lexeme));
+        if (temp)
+        {
+            free(lexeme);
+            p->lexeme = temp;
+            return;
+        }
+        /*out of memory, the heap lexeme is used (and leaks)*/
+    }
+
+    p->lexeme = lexeme;
+}
+
 void token_list_set_file(struct token_list* list, struct token* filetoken, int line, int col)
 {
     struct token* _Opt p = list->head;
@@ -566,6 +645,7 @@ void token_list_append_list_at_beginning(struct token_list* dest, struct token_l
         assert(source->tail != NULL);
         assert(source->tail->next == NULL);
         source->tail->next = dest->head;
+        dest->head->prev = source->tail;
         dest->head = source->head;
     }
 
@@ -601,18 +681,32 @@ void token_list_append_list(struct token_list* dest, struct token_list* source)
 
 struct token* _Owner _Opt clone_token(struct token* p)
 {
-    _Opt struct token* _Owner _Opt token = calloc(1, sizeof * token);
+    _Opt struct token* _Owner _Opt token = token_new();
     if (token == NULL)
         return NULL;
 
-    char* _Owner _Opt lexeme = strdup(p->lexeme);
+    const bool in_arena = token->in_arena;
+
+    if (p->lexeme_is_atom)
+    {
+        /*atoms are shared*/
+        *token = *p;
+        token->in_arena = in_arena;
+        token->next = NULL;
+        token->prev = NULL;
+        return token;
+    }
+
+    token->in_arena = in_arena;
+    char* _Owner _Opt lexeme = token_lexeme_dup(token, p->lexeme, strlen(p->lexeme));
     if (lexeme == NULL)
     {
-        free(token);
+        token_delete(token);
         return NULL;
     }
 
     *token = *p;
+    token->in_arena = in_arena;
     token->lexeme = lexeme;
     token->next = NULL;
     token->prev = NULL;
@@ -677,6 +771,14 @@ bool token_list_is_empty(struct token_list* p)
     return p->head == NULL;
 }
 
+int token_list_size(const struct token_list* p)
+{
+    int size = 0;
+    for (const struct token* _Opt current = p->head; current; current = current->next)
+        size++;
+    return size;
+}
+
 void print_list(bool color_enabled, struct token_list* list)
 {
     struct token* _Opt current = list->head;
@@ -684,21 +786,21 @@ void print_list(bool color_enabled, struct token_list* list)
     {
         if (current != list->head)
         {
-            printf("\xcb\xb0");
-            //printf("`");
+            console_printf("\xcb\xb0");
+            //console_printf("`");
         }
         print_literal2(current->lexeme);
 
         if (color_enabled)
-            printf(COLOR_RESET);
+            console_printf(COLOR_RESET);
 
         if (current == list->tail)
         {
-            //printf("`");
+            //console_printf("`");
         }
         current = current->next;
     }
-    printf("\n");
+    console_printf("\n");
 }
 
 void print_literal2(const char* s)
@@ -708,14 +810,14 @@ void print_literal2(const char* s)
         switch (*s)
         {
         case '\n':
-            printf("\\n");
+            console_printf("\\n");
             break;
         default:
-            printf("%c", *s);
+            console_printf("%c", *s);
         }
         s++;
     }
-    //printf("`");
+    //console_printf("`");
 }
 
 
@@ -723,26 +825,26 @@ void print_token(bool color_enabled, const struct token* p_token)
 {
     for (int i = 0; i < p_token->level; i++)
     {
-        printf("  ");
+        console_printf("  ");
     }
     if (p_token->flags & TK_FLAG_FINAL)
     {
         if (color_enabled)
-            printf(LIGHTGREEN);
+            console_printf(LIGHTGREEN);
     }
     else
     {
         if (color_enabled)
-            printf(LIGHTGRAY);
+            console_printf(LIGHTGRAY);
     }
     char buffer0[50] = { 0 };
     snprintf(buffer0, sizeof buffer0, "%d:%d", p_token->line, p_token->col);
-    printf("%-6s ", buffer0);
-    printf("%-20s ", get_token_name(p_token->type));
+    console_printf("%-6s ", buffer0);
+    console_printf("%-20s ", get_token_name(p_token->type));
     if (p_token->flags & TK_FLAG_MACRO_EXPANDED)
     {
         if (color_enabled)
-            printf(LIGHTCYAN);
+            console_printf(LIGHTCYAN);
     }
     char buffer[50] = { 0 };
     strcat(buffer, "[");
@@ -767,19 +869,19 @@ void print_token(bool color_enabled, const struct token* p_token)
         strcat(buffer, "newline ");
     }
     strcat(buffer, "]");
-    printf("%-20s ", buffer);
+    console_printf("%-20s ", buffer);
     print_literal2(p_token->lexeme);
-    printf("\n");
+    console_printf("\n");
     if (color_enabled)
-        printf(COLOR_RESET);
+        console_printf(COLOR_RESET);
 }
 
 void print_tokens(bool color_enabled, const struct token* _Opt p_token)
 {
-    printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+    console_printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
 
     if (color_enabled)
-        printf(COLOR_RESET);
+        console_printf(COLOR_RESET);
 
     const struct token* _Opt current = p_token;
     while (current)
@@ -787,54 +889,54 @@ void print_tokens(bool color_enabled, const struct token* _Opt p_token)
         print_token(color_enabled, current);
         current = current->next;
     }
-    printf("\n");
-    printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+    console_printf("\n");
+    console_printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
 
     if (color_enabled)
-        printf(COLOR_RESET);
+        console_printf(COLOR_RESET);
 }
 
 
 void print_token_html(struct token* p_token)
 {
-    printf("<span class=\"");
+    console_printf("<span class=\"");
 
 
     if (!(p_token->flags & TK_FLAG_FINAL))
     {
-        printf("notfinal ");
+        console_printf("notfinal ");
     }
 
     if (p_token->flags & TK_FLAG_FINAL)
     {
-        printf("final ");
+        console_printf("final ");
     }
     if (p_token->flags & TK_C_BACKEND_FLAG_HIDE)
     {
-        printf("hide ");
+        console_printf("hide ");
     }
     if (p_token->flags & TK_FLAG_MACRO_EXPANDED)
     {
-        printf("expanded ");
+        console_printf("expanded ");
     }
     if (p_token->flags & TK_FLAG_HAS_SPACE_BEFORE)
     {
-        printf("space ");
+        console_printf("space ");
     }
     if (p_token->flags & TK_FLAG_HAS_NEWLINE_BEFORE)
     {
-        printf("newline ");
+        console_printf("newline ");
     }
 
-    printf("\">");
+    console_printf("\">");
 
     print_literal2(p_token->lexeme);
 
-    printf("</span>");
+    console_printf("</span>");
 
     if (p_token->type == TK_NEWLINE || p_token->type == TK_BEGIN_OF_FILE)
     {
-        printf("<br>\n");
+        console_printf("<br>\n");
     }
 }
 
@@ -872,14 +974,14 @@ void print_token_html(struct token* p_token)
 */
 void print_tokens_html(struct token* p_token)
 {
-    printf("<pre>\n");
+    console_printf("<pre>\n");
     struct token* _Opt current = p_token;
     while (current)
     {
         print_token_html(current);
         current = current->next;
     }
-    printf("\n</pre>");
+    console_printf("\n</pre>");
 }
 
 void print_position(const char* path, int line, int col, bool visual_studio_ouput_format, bool  color_enabled)
@@ -891,21 +993,21 @@ void print_position(const char* path, int line, int col, bool visual_studio_oupu
     {
         //MSVC format
         print_path(path, true /*full path*/);
-        printf("(%d,%d): ", line, col);
+        console_printf("(%d,%d): ", line, col);
     }
     else
     {
         if (color_enabled)
         {
-            printf(WHITE);
+            console_printf(WHITE);
         }
         print_path(path, false /*full path*/);
 
         //GCC format
         if (color_enabled)
-            printf(WHITE ":%d:%d: ", line, col);
+            console_printf(WHITE ":%d:%d: ", line, col);
         else
-            printf(":%d:%d: ", line, col);
+            console_printf(":%d:%d: ", line, col);
     }
 }
 
@@ -922,11 +1024,11 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
         const int line = p_marker->line;
 
         if (color_enabled)
-            printf(COLOR_RESET);
+            console_printf(COLOR_RESET);
 
         char nbuffer[20] = { 0 };
         int n = snprintf(nbuffer, sizeof nbuffer, "%d", line);
-        printf(" %s |", nbuffer);
+        console_printf(" %s |", nbuffer);
 
 
         //lets find the begin of line
@@ -948,7 +1050,7 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
         const bool expand_macro = p_token_begin->flags & TK_FLAG_MACRO_EXPANDED;
 
         if (color_enabled)
-            printf(LIGHTBLUE);
+            console_printf(LIGHTBLUE);
 
         const struct token* _Opt p_item = p_line_begin;
         while (p_item)
@@ -957,17 +1059,17 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
             {
                 if (p_item->flags & TK_FLAG_MACRO_EXPANDED)
                 {
-                    printf(DARKGRAY);
+                    console_printf(DARKGRAY);
                 }
                 else if (p_item->type >= TK_KEYWORD_AUTO &&
                          p_item->type <= TK_KEYWORD_IS_INTEGRAL)
                 {
-                    printf(BLUE);
+                    console_printf(BLUE);
                 }
                 else if (p_item->type == TK_COMMENT ||
                          p_item->type == TK_LINE_COMMENT)
                 {
-                    printf(YELLOW);
+                    console_printf(YELLOW);
                 }
             }
 
@@ -979,7 +1081,7 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
                 {
                     while (*p && *p != '\n' && *p != '\r')
                     {
-                        putc(*p, stdout);
+                        console_putc(*p);
                         p++;
                     }
                 }
@@ -987,7 +1089,7 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
                 {
                     while (*p)
                     {
-                        putc(*p, stdout);
+                        console_putc(*p);
                         p++;
                     }
                 }
@@ -995,7 +1097,7 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
 
             if (color_enabled)
             {
-                printf(COLOR_RESET);
+                console_printf(COLOR_RESET);
             }
 
             if (p_item->type == TK_NEWLINE)
@@ -1008,11 +1110,11 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
         }
 
         if (color_enabled)
-            printf(COLOR_RESET);
+            console_printf(COLOR_RESET);
 
-        if (p_item == NULL) printf("\n");
+        if (p_item == NULL) console_printf("\n");
 
-        printf(" %*s |", n, " ");
+        console_printf(" %*s |", n, " ");
         bool complete = false;
         int start_col = 1;
         int end_col = 1;
@@ -1023,7 +1125,7 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
             if (p_item == p_token_begin)
             {
                 if (color_enabled)
-                    printf(LIGHTGREEN);
+                    console_printf(LIGHTGREEN);
                 onoff = true;
                 end_col = start_col;
             }
@@ -1036,18 +1138,18 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
 
                     if (onoff)
                     {
-                        putc('~', stdout);
+                        console_putc('~');
                         end_col++;
                     }
                     else
                     {
                         if (*p == '\t')
                         {
-                            putc(*p, stdout);
+                            console_putc(*p);
                         }
                         else
                         {
-                            putc(' ', stdout);
+                            console_putc(' ');
                         }
 
                         if (!complete) start_col++;
@@ -1064,16 +1166,16 @@ void print_line_and_token(struct marker* p_marker, bool color_enabled)
                 complete = true;
                 onoff = false;
                 if (color_enabled)
-                    printf(COLOR_RESET);
+                    console_printf(COLOR_RESET);
             }
 
             p_item = p_item->next;
         }
 
         if (color_enabled)
-            printf(COLOR_RESET);
+            console_printf(COLOR_RESET);
 
-        printf("\n");
+        console_printf("\n");
         p_marker->start_col = start_col;
         p_marker->end_col = end_col;
     }
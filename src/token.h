@@ -5,6 +5,7 @@
 
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
 #include "ownership.h"
 
 enum token_type
@@ -53,6 +54,7 @@ enum token_type
     TK_LINE_COMMENT,
     TK_COMMENT,
     TK_PPNUMBER,
+    TK_EMBED, /*#embed data, the lexeme is the list of values "n0,n1,..."*/
 
     ANY_OTHER_PP_TOKEN, //@ por ex
 
@@ -247,13 +249,22 @@ enum token_flags
     TK_FLAG_LINE_CONTINUATION = 1 << 10 ,            /*token has one or more line-slicing*/
 
     TK_C_BACKEND_FLAG_SHOW_AGAIN = 1 << 11,          /*was hidden but maybe reappears*/
+
+    TK_FLAG_IDENTIFIER_IS_NOT_KEYWORD = 1 << 12,     /*saves time on keyword search*/
 };
 
 struct token
 {
     enum token_type type;
     char* _Owner lexeme; //TODO make const
-    char* original;
+
+    /*
+      Tokens of cached include files (see include_file_link_groups).
+      In the cache, the new-line that ends a conditional directive points
+      to the last token of its group. In the copy of an include, it points
+      to that cached new-line, meaning the group was not copied yet.
+    */
+    struct token* _Opt group;
 
     int line;
     int col;
@@ -266,11 +277,26 @@ struct token
     /*points to the token with file name or macro*/
     struct token* token_origin;
 
+    /*
+      identifiers have interned lexemes (see atom_intern) that are not owned
+      by the token. Use token_set_lexeme to replace the lexeme.
+    */
+    bool lexeme_is_atom;
+
+    /*
+      token (and its lexeme when it is not an atom) was allocated from
+      an arena (see arena_get_current) and it is not released by token_delete.
+    */
+    bool in_arena;
+
     struct token* _Owner _Opt next;
     struct token* _Opt prev;
 };
 
+struct token* _Owner _Opt token_new(void);
+char* _Owner _Opt token_lexeme_dup(struct token* p, const char* s, size_t length);
 void token_delete( struct token* _Owner _Opt p);
+void token_set_lexeme(struct token* p, char* _Owner lexeme);
 
 struct token_list
 {
@@ -280,6 +306,7 @@ struct token_list
 
 void token_list_set_file(struct token_list* list, struct token* filetoken, int line, int col);
 bool token_list_is_empty(struct token_list* p);
+int token_list_size(const struct token_list* p);
 void token_list_swap(struct token_list* a, struct token_list* b);
 
 struct token* _Owner _Opt clone_token(struct token* p);
@@ -322,6 +349,10 @@ void print_position(const char* path, int line, int col, bool msvc_format, bool
 struct stream
 {
     const char* const source;
+
+    /*the '\0' at the end of source, NULL if not known*/
+    const char* _Opt end;
+
     const char* current;
     int line;
     int col;
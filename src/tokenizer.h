@@ -4,11 +4,13 @@
 */
 
 #pragma once
+#include <stdio.h>
 #include "hashmap.h"
 #include "token.h"
 #include "error.h"
 #include "options.h"
 #include "ownership.h"
+#include "osstream.h"
 
 #define CAKE_CONFIG_FILE_NAME "/cakeconfig.h"
 
@@ -30,6 +32,11 @@ enum preprocessor_ctx_flags
     PREPROCESSOR_CTX_FLAGS_ONLY_FINAL = 1 << 0
 };
 
+struct time_report;
+
+struct precompiled_header;
+void precompiled_header_delete(struct precompiled_header* _Owner _Opt p);
+
 struct preprocessor_ctx
 {
     struct options options;
@@ -46,6 +53,22 @@ struct preprocessor_ctx
     bool conditional_inclusion;
     int n_warnings;
     int n_errors;    
+
+    /*-include-pch*/
+    struct precompiled_header* _Owner _Opt p_precompiled_header;
+
+    /*control lines seen at level 0, a precompiled header must be the first*/
+    int directives_count;
+
+    /*
+      -MD files opened by #include, #embed and cakeconfig.h, already
+      escaped as make prerequisites. The map avoids repeated names.
+    */
+    struct hash_map dependencies_map;
+    struct osstream dependencies;
+
+    /*-ftime-report-top and -ftime-trace, time of include files and macros*/
+    struct time_report* _Opt p_time_report;
 };
 
 void preprocessor_ctx_destroy( _Dtor struct preprocessor_ctx* p);
@@ -66,8 +89,41 @@ void add_standard_macros(struct preprocessor_ctx* ctx, enum target target);
 struct include_dir* _Opt include_dir_add(struct include_dir_list* list, const char* path);
 
 struct token_list preprocessor(struct preprocessor_ctx* ctx, struct token_list* input_list, int level);
+
+/*
+  State of the preprocessor before the header. -include-pch uses the header
+  only when the state at its #include is the same.
+*/
+struct precompiled_header_state
+{
+    /*macros defined, except __DATE__ and __TIME__*/
+    unsigned long long macros_hash;
+    int directives_count;
+    unsigned int counter;
+};
+
+void precompiled_header_state_get(const struct preprocessor_ctx* ctx, struct precompiled_header_state* p_state);
+
+/*
+  -emit-pch saves the preprocessed tokens of a header and the preprocessor state.
+  -include-pch loads it; it is used when the header is included.
+  options are the -D, -U and -I of the command line, they must be the same.
+*/
+int precompiled_header_save(struct preprocessor_ctx* ctx,
+    const struct precompiled_header_state* p_state_before,
+    const char* options,
+    const char* header_path,
+    const struct token_list* tokens,
+    const char* pch_path);
+int precompiled_header_load(struct preprocessor_ctx* ctx, const char* options, const char* pch_path);
 struct token_list copy_replacement_list(struct preprocessor_ctx* ctx, const struct token_list* list);
 
+/*
+  Included files and the results of the include search are kept between
+  the files of one compile() call. This releases them.
+*/
+void include_cache_clear(void);
+
 void token_list_append_list(struct token_list* dest, _Dtor struct token_list* source);
 void print_list(bool color_enabled, struct token_list* list);
 void token_list_destroy(_Opt _Dtor struct token_list* list);
@@ -97,6 +153,39 @@ void print_tokens(bool color_enabled, const struct token* _Opt p_token);
 void print_preprocessed(const struct token* p_token);
 const char* _Owner _Opt print_preprocessed_to_string(const struct token* p_token);
 const char* _Owner _Opt print_preprocessed_to_string2(const struct token* _Opt p_token);
+
+/*
+  -E output. The text of each group of the main file is written as soon as
+  it is preprocessed (see preprocessor_stream).
+*/
+struct preprocessed_output
+{
+    /*output file, can be NULL*/
+    FILE* _Opt file;
+
+    /*also writes using console_printf*/
+    bool console;
+
+    /*-line-markers inserts #line when the file or the line changes*/
+    bool line_markers;
+
+    /*
+      text not written yet. With console all the text is kept and printed
+      at the end, only if there are no errors; file_written is the part
+      already written to the file.
+    */
+    struct osstream text;
+    int file_written;
+
+    /*file and line of the current output line, used by line markers*/
+    const struct token* _Opt origin;
+    int line;
+    bool at_line_start;
+};
+
+void preprocessed_output_destroy(_Dtor struct preprocessed_output* p);
+void preprocessed_output_print_console(const struct preprocessed_output* p);
+struct token_list preprocessor_stream(struct preprocessor_ctx* ctx, struct token_list* input_list, struct preprocessed_output* output);
 void check_unused_macros(const struct hash_map* map);
 
 const char* get_token_name(enum token_type tk);
@@ -105,5 +194,6 @@ void print_all_macros(const struct preprocessor_ctx* prectx);
 
 
 int include_config_header(struct preprocessor_ctx* ctx, const char* file_name);
+void preprocessor_add_dependency(struct preprocessor_ctx* ctx, const char* path);
 int stringify(const char* input, int n, char output[]);
 void print_path(const char* path, bool fullpath);
\ No newline at end of file
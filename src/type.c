@@ -15,6 +15,7 @@
 #include "error.h"
 
 #include "parser.h"
+#include "console.h"
 #include "type.h"
 
 
@@ -406,7 +407,7 @@ struct type type_convert_to(const struct type* p_type, enum standard_version tar
         assert(t.name_opt == NULL);
         if (p_type->name_opt)
         {
-            t.name_opt = strdup(p_type->name_opt);
+            t.name_opt = p_type->name_opt;
         }
         return t;
     }
@@ -604,14 +605,14 @@ void type_print(const struct type* a, enum target target)
 {
     struct osstream ss = { 0 };
     print_type(&ss, a, target);
-    printf("%s", ss.c_str);
+    console_printf("%s", ss.c_str);
     ss_close(&ss);
 }
 
 void type_println(const struct type* a, enum target target)
 {
     type_print(a, target);
-    puts("\n");
+    console_printf("\n\n");
 }
 
 enum type_category type_get_category(const struct type* p_type)
@@ -648,26 +649,37 @@ void param_list_destroy(_Dtor struct param_list* p)
 
 void type_destroy_one(_Opt _Dtor struct type* p_type)
 {
-    free((void* _Owner)p_type->name_opt);
     param_list_destroy(&p_type->params);
     assert(p_type->next == NULL);
 }
 
-void type_destroy(_Opt _Dtor struct type* p_type)
+/*
+  Deletes the nodes from item until the first one that is shared
+*/
+static void type_nodes_release(struct type* _Owner _Opt item)
 {
-    free((void* _Owner)p_type->name_opt);
-    param_list_destroy(&p_type->params);
-
-    struct type* _Owner _Opt item = p_type->next;
     while (item)
     {
+        if (item->share_count > 0)
+        {
+            /*the other types keep the rest of the chain*/
+            item->share_count--;
+            static_set(item, "moved");
+            break;
+        }
+
         struct type* _Owner _Opt next = item->next;
         item->next = NULL;
         type_destroy_one(item);
         free(item);
         item = next;
     }
+}
 
+void type_destroy(_Opt _Dtor struct type* p_type)
+{
+    param_list_destroy(&p_type->params);
+    type_nodes_release(p_type->next);
 }
 
 void type_delete(struct type* _Owner _Opt p_type)
@@ -1465,6 +1477,28 @@ struct type type_add_pointer(const struct type* p_type, bool null_checks_enabled
     return r;
 }
 
+/*
+  Moves the node p out of its chain, returning it as the first node of a type
+*/
+static struct type type_node_take(struct type* _Owner p)
+{
+    if (p->share_count > 0)
+    {
+        /*other types are using it*/
+        struct type r = type_dup(p);
+        p->share_count--;
+        static_set(p, "moved");
+        return r;
+    }
+
+    struct type r = *p;
+    /*
+      we have moved the contents of p, but we also need to delete it's memory
+    */
+    free(p);
+    return r;
+}
+
 struct type type_remove_pointer(const struct type* p_type)
 {
     struct type r = type_dup(p_type);
@@ -1475,11 +1509,7 @@ struct type type_remove_pointer(const struct type* p_type)
 
     if (r.next)
     {
-        struct type next = *r.next;
-        /*
-          we have moved the contents of r.next, but we also need to delete it's memory
-        */
-        free(r.next);
+        struct type next = type_node_take(r.next);
         r.next = NULL;
         type_destroy_one(&r);
         r = next;
@@ -1503,11 +1533,9 @@ struct type get_array_item_type(const struct type* p_type)
 
     if (r.next)
     {
-        struct type r2 = *r.next;
-
-        free(r.next);
-        free((void* _Owner) r.name_opt);
-        param_list_destroy(&r.params);
+        struct type r2 = type_node_take(r.next);
+        r.next = NULL;
+        type_destroy_one(&r);
         return r2;
     }
 
@@ -1832,427 +1860,378 @@ void type_set(struct type* a, const struct type* b)
 
 struct type type_dup(const struct type* p_type)
 {
-    try
-    {
-        struct type_list l = { 0 };
-        const struct type* _Opt p = p_type;
-        while (p)
-        {
-            struct type* _Owner _Opt p_new = calloc(1, sizeof(struct type));
-            if (p_new == NULL)
-            {
-                type_list_destroy(&l);
-                throw;
-            }
+    /*
+      Only the first node is copied, the others are shared.
+      The parameters belong to the first node, so they are copied too.
+    */
+    struct type r = *p_type;
+    r.share_count = 0;
 
-            *p_new = *p;
+    if (r.next)
+        r.next->share_count++;
 
-            //actually I was not the _Owner of p_new->next
-            static_set(p_new->next, "uninitialized");
-            p_new->next = NULL;
+    //actually I was not the _Owner of r.params
+    static_set(r.params.head, "uninitialized");
+    r.params.head = NULL;
+    static_set(r.params.tail, "uninitialized");
+    r.params.tail = NULL;
 
-            if (p->name_opt)
+    if (p_type->category == TYPE_CATEGORY_FUNCTION)
+    {
+        struct param* _Opt p_param = p_type->params.head;
+        while (p_param)
+        {
+            struct param* _Owner _Opt p_new_param = calloc(1, sizeof * p_new_param);
+            if (p_new_param == NULL)
             {
-                //actually p_new->name_opt was not mine..
-                static_set(p_new->name_opt, "uninitialized");
-                p_new->name_opt = strdup(p->name_opt);
+                type_destroy(&r);
+                struct type empty = { 0 };
+                return empty;
             }
 
-            if (p->category == TYPE_CATEGORY_FUNCTION)
-            {
-                //actually p_new->params.head  p_new->params.tail and was not mine..
-                static_set(p_new->params.head, "uninitialized");
-                p_new->params.head = NULL;
-                static_set(p_new->params.tail, "uninitialized");
-                p_new->params.tail = NULL;
+            p_new_param->type = type_dup(&p_param->type);
 
-                struct param* _Opt p_param = p->params.head;
-                while (p_param)
-                {
-                    struct param* _Owner _Opt p_new_param = calloc(1, sizeof * p_new_param);
-                    if (p_new_param == NULL)
-                    {
-                        type_list_destroy(&l);
-                        type_delete(p_new);
-                        throw;
-                    }
+            param_list_add(&r.params, p_new_param);
+            p_param = p_param->next;
+        }
+    }
 
-                    p_new_param->type = type_dup(&p_param->type);
+    return r;
+}
 
-                    param_list_add(&p_new->params, p_new_param);
-                    p_param = p_param->next;
-                }
-            }
+/*
+  Makes p_type->next a node that is not shared, copying it if necessary,
+  so it can be changed. p_type must not be shared.
+*/
+struct type* _Opt type_next_mutable(struct type* p_type)
+{
+    assert(p_type->share_count == 0);
 
-            type_list_push_back(&l, p_new);
-            p = p->next;
-        }
+    if (p_type->next == NULL || p_type->next->share_count == 0)
+        return p_type->next;
 
-        if (l.head == NULL)
-            throw;
+    struct type* _Owner _Opt p_new = calloc(1, sizeof(struct type));
+    if (p_new == NULL)
+        return NULL;
 
-        struct type r = *l.head;
-        /*
-           we have moved the content of l.head
-           but we also need to delete the memory
-        */
-        free(l.head);
+    *p_new = type_dup(p_type->next);
 
-        return r;
+    p_type->next->share_count--;
+    static_set(p_type->next, "moved");
+    p_type->next = p_new;
+    return p_new;
+}
+
+void struct_layout_delete(struct struct_layout* _Owner _Opt p)
+{
+    if (p)
+    {
+        free(p->members);
+        hashmap_destroy(&p->names);
+        free(p);
     }
-    catch
+}
+
+static int struct_layout_add(struct struct_layout* p, struct member_declarator* p_member_declarator, size_t offset)
+{
+    if (p->members_size == p->members_capacity)
     {
+        const int new_capacity = p->members_capacity == 0 ? 8 : p->members_capacity * 2;
+        void* _Owner _Opt pnew = realloc(p->members, new_capacity * sizeof(struct member_layout));
+        if (pnew == NULL)
+            return ENOMEM;
+        static_set(p->members, "moved");
+        p->members = pnew;
+        p->members_capacity = new_capacity;
     }
 
-    struct type empty = { 0 };
-    return empty;
+    assert(p->members != NULL);
+    p->members[p->members_size].p_member_declarator = p_member_declarator;
+    p->members[p->members_size].offset = offset;
+    p->members_size++;
+    return 0;
 }
 
-static enum sizeof_result get_offsetof_struct(struct struct_or_union_specifier* complete_struct_or_union_specifier,
-    const char* member, size_t* sz, enum target target)
+static int struct_layout_build(struct struct_layout* p_layout, struct struct_or_union_specifier* p_complete, enum target target)
 {
-    enum sizeof_result sizeof_result = SIZEOF_RESULT_OK;
-
-    const bool is_union =
-        (complete_struct_or_union_specifier->first_token->type == TK_KEYWORD_UNION);
+    const bool is_union = struct_or_union_specifier_is_union(p_complete);
 
+    enum sizeof_result sizeof_result = SIZEOF_RESULT_OK;
     size_t size = 0;
-    try
-    {
-        size_t maxalign = 0;
+    size_t align = 0;
 
-        struct member_declaration* _Opt d = complete_struct_or_union_specifier->member_declaration_list.head;
-        while (d)
+    struct member_declaration* _Opt d = p_complete->member_declaration_list.head;
+    while (d)
+    {
+        if (d->member_declarator_list_opt)
         {
-            if (d->member_declarator_list_opt)
+            struct member_declarator* _Opt md = d->member_declarator_list_opt->head;
+            while (md)
             {
-                struct member_declarator* _Opt md = d->member_declarator_list_opt->head;
-                while (md)
+                if (struct_layout_add(p_layout, md, 0) != 0)
+                    return ENOMEM;
+
+                if (md->declarator)
                 {
-                    size_t align = 1;
+                    const size_t member_align = type_get_alignof(&md->declarator->type, target);
+                    if (member_align > align)
+                        align = member_align;
 
-                    if (md->declarator)
+                    if (sizeof_result == SIZEOF_RESULT_OK)
                     {
-                        assert(md->declarator->name_opt != NULL);
-
-                        align = type_get_alignof(&md->declarator->type, target);
-
-                        if (align > maxalign)
-                        {
-                            maxalign = align;
-                        }
-                        if (size % align != 0)
-                        {
-                            size += align - (size % align);
-                        }
+                        if (size % member_align != 0)
+                            size += member_align - (size % member_align);
 
-                        if (strcmp(md->declarator->name_opt->lexeme, member) == 0)
-                        {
-                            *sz = size;
-                            return SIZEOF_RESULT_OK;
-                        }
+                        p_layout->members[p_layout->members_size - 1].offset = is_union ? 0 : size;
+                        p_layout->offsets_count = p_layout->members_size;
 
                         size_t item_size = 0;
                         sizeof_result = type_get_sizeof(&md->declarator->type, &item_size, target);
-                        if (sizeof_result != 0)
-                            throw;
-
-                        if (is_union)
-                        {
-                            if (item_size > size)
-                                size = item_size;
-                        }
-                        else
-                        {
-                            size += item_size;
-                        }
-                    }
-                    else
-                    {
-                        sizeof_result = SIZEOF_RESULT_INCOMPLETE;
-                        throw;
-                    }
-
-                    md = md->next;
-                }
-            }
-            else if (d->specifier_qualifier_list)
-            {
-                if (d->specifier_qualifier_list->struct_or_union_specifier)
-                {
-                    struct type t = { 0 };
-                    t.category = TYPE_CATEGORY_ITSELF;
-                    t.struct_or_union_specifier = d->specifier_qualifier_list->struct_or_union_specifier;
-                    t.type_specifier_flags = TYPE_SPECIFIER_STRUCT_OR_UNION;
-
-                    size_t align = type_get_alignof(&t, target);
-
-                    if (align > maxalign)
-                    {
-                        maxalign = align;
-                    }
-                    if (size % align != 0)
-                    {
-                        size += align - (size % align);
-                    }
-                    size_t item_size = 0;
-
-                    sizeof_result = type_get_sizeof(&t, &item_size, target);
-                    if (sizeof_result != 0)
-                        throw;
-
-                    if (is_union)
-                    {
-                        if (item_size > size)
-                            size = item_size;
-                    }
-                    else
-                    {
-                        if (item_size > SIZE_MAX - size)
+                        if (sizeof_result == SIZEOF_RESULT_OK)
                         {
-                            sizeof_result = SIZEOF_RESULT_OVERLOW;
-                            throw;
+                            if (is_union)
+                            {
+                                if (item_size > size)
+                                    size = item_size;
+                            }
+                            else
+                            {
+                                size += item_size;
+                            }
                         }
-                        size += item_size;
                     }
-                    type_destroy(&t);
                 }
-                else
+                else if (sizeof_result == SIZEOF_RESULT_OK)
                 {
                     sizeof_result = SIZEOF_RESULT_INCOMPLETE;
-                    throw;
                 }
-            }
-
-            d = d->next;
-        }
-        if (maxalign != 0)
-        {
-            if (size % maxalign != 0)
-            {
-                size += maxalign - (size % maxalign);
+                md = md->next;
             }
         }
-        else
+        else if (d->specifier_qualifier_list)
         {
-            sizeof_result = SIZEOF_RESULT_INCOMPLETE;
-            throw;
-        }
-    }
-    catch
-    {
-        return sizeof_result;
-    }
-
-    *sz = size;
-    return sizeof_result;
-}
+            /*
+              We don't have the declarator like in
 
-enum sizeof_result get_sizeof_struct(struct struct_or_union_specifier* complete_struct_or_union_specifier, size_t* sz, enum target target)
-{
-    enum sizeof_result sizeof_result = SIZEOF_RESULT_OK;
+              struct X {
+                union {
+                    struct {
+                        int Zone;
+                    };
+                    int Value;
+                };
+              };
 
-    const bool is_union =
-        (complete_struct_or_union_specifier->first_token->type == TK_KEYWORD_UNION);
+              so we create a type using only specifiers
+            */
+            struct type t = { 0 };
+            t.category = TYPE_CATEGORY_ITSELF;
+            t.type_specifier_flags = d->specifier_qualifier_list->type_specifier_flags;
+            t.enum_specifier = d->specifier_qualifier_list->enum_specifier;
+            t.struct_or_union_specifier = d->specifier_qualifier_list->struct_or_union_specifier;
 
-    size_t size = 0;
-    try
-    {
-        size_t maxalign = 0;
+            const size_t member_align = type_get_alignof(&t, target);
+            if (member_align > align)
+                align = member_align;
 
-        struct member_declaration* _Opt d = complete_struct_or_union_specifier->member_declaration_list.head;
-        while (d)
-        {
-            if (d->member_declarator_list_opt)
+            if (d->specifier_qualifier_list->struct_or_union_specifier)
             {
-                struct member_declarator* _Opt md = d->member_declarator_list_opt->head;
-                while (md)
+                size_t offset = 0;
+                if (sizeof_result == SIZEOF_RESULT_OK)
                 {
-                    size_t align = 1;
+                    if (size % member_align != 0)
+                        size += member_align - (size % member_align);
+                    offset = is_union ? 0 : size;
+                }
 
-                    if (md->declarator)
+                struct struct_or_union_specifier* _Opt p_anonymous =
+                    get_complete_struct_or_union_specifier(d->specifier_qualifier_list->struct_or_union_specifier);
+
+                if (p_anonymous)
+                {
+                    struct struct_layout* _Opt p_anonymous_layout = struct_layout_get(p_anonymous, target);
+                    if (p_anonymous_layout == NULL)
                     {
-                        align = type_get_alignof(&md->declarator->type, target);
+                        type_destroy(&t);
+                        return ENOMEM;
+                    }
 
-                        if (align > maxalign)
-                        {
-                            maxalign = align;
-                        }
-                        if (size % align != 0)
-                        {
-                            size += align - (size % align);
-                        }
-                        size_t item_size = 0;
-                        sizeof_result = type_get_sizeof(&md->declarator->type, &item_size, target);
-                        switch (sizeof_result)
+                    const int first = p_layout->members_size;
+                    for (int i = 0; i < p_anonymous_layout->members_size; i++)
+                    {
+                        assert(p_anonymous_layout->members != NULL);
+                        const struct member_layout* p_member = &p_anonymous_layout->members[i];
+                        if (struct_layout_add(p_layout, p_member->p_member_declarator, offset + p_member->offset) != 0)
                         {
-                        case SIZEOF_RESULT_OK:
-                            break;
-                        case SIZEOF_RESULT_OVERLOW:
-                        case SIZEOF_RESULT_RUNTIME:
-                        case SIZEOF_RESULT_INCOMPLETE:
-                        case SIZEOF_RESULT_FUNCTION:
-                            throw;
-                            break;
+                            type_destroy(&t);
+                            return ENOMEM;
                         }
+                    }
+
+                    if (sizeof_result == SIZEOF_RESULT_OK)
+                        p_layout->offsets_count = first + p_anonymous_layout->offsets_count;
+                }
 
+                if (sizeof_result == SIZEOF_RESULT_OK)
+                {
+                    size_t item_size = 0;
+                    sizeof_result = type_get_sizeof(&t, &item_size, target);
+                    if (sizeof_result == SIZEOF_RESULT_OK)
+                    {
                         if (is_union)
                         {
                             if (item_size > size)
                                 size = item_size;
                         }
-                        else
+                        else if (item_size > SIZE_MAX - size)
                         {
-                            size += item_size;
+                            sizeof_result = SIZEOF_RESULT_OVERLOW;
                         }
-                    }
-                    else
-                    {
-                        sizeof_result = SIZEOF_RESULT_INCOMPLETE;
-                        throw;
-                    }
-                    md = md->next;
-                }
-            }
-            else if (d->specifier_qualifier_list)
-            {
-                if (d->specifier_qualifier_list->struct_or_union_specifier)
-                {
-                    struct type t = { 0 };
-                    t.category = TYPE_CATEGORY_ITSELF;
-                    t.struct_or_union_specifier = d->specifier_qualifier_list->struct_or_union_specifier;
-                    t.type_specifier_flags = TYPE_SPECIFIER_STRUCT_OR_UNION;
-
-                    size_t align = type_get_alignof(&t, target);
-
-                    if (align > maxalign)
-                    {
-                        maxalign = align;
-                    }
-                    if (size % align != 0)
-                    {
-                        size += align - (size % align);
-                    }
-                    size_t item_size = 0;
-
-                    sizeof_result = type_get_sizeof(&t, &item_size, target);
-                    if (sizeof_result != 0)
-                        throw;
-
-                    if (is_union)
-                    {
-                        if (item_size > size)
-                            size = item_size;
-                    }
-                    else
-                    {
-                        if (item_size > SIZE_MAX - size)
+                        else
                         {
-                            sizeof_result = SIZEOF_RESULT_OVERLOW;
-                            throw;
+                            size += item_size;
                         }
-                        size += item_size;
                     }
-                    type_destroy(&t);
-                }
-                else
-                {
-                    sizeof_result = SIZEOF_RESULT_INCOMPLETE;
-                    throw;
                 }
             }
-            d = d->next;
-        }
-        if (maxalign != 0)
-        {
-            if (size % maxalign != 0)
+            else if (sizeof_result == SIZEOF_RESULT_OK)
             {
-                size += maxalign - (size % maxalign);
+                sizeof_result = SIZEOF_RESULT_INCOMPLETE;
             }
+            type_destroy(&t);
         }
         else
         {
-            sizeof_result = SIZEOF_RESULT_INCOMPLETE;
-            throw;
+            /*static_assert*/
         }
+        d = d->next;
     }
-    catch
+
+    if (sizeof_result == SIZEOF_RESULT_OK)
     {
-        return sizeof_result;
+        if (align == 0)
+            sizeof_result = SIZEOF_RESULT_INCOMPLETE;
+        else if (size % align != 0)
+            size += align - (size % align);
     }
 
-    *sz = size;
-    return sizeof_result;
-}
-
-size_t type_get_alignof(const struct type* p_type, enum target target);
-size_t get_alignof_struct(struct struct_or_union_specifier* complete_struct_or_union_specifier, enum target target)
-{
-    size_t align = 0;
-    struct member_declaration* _Opt d = complete_struct_or_union_specifier->member_declaration_list.head;
-    while (d)
+    for (int i = 0; i < p_layout->members_size; i++)
     {
-        if (d->member_declarator_list_opt)
+        assert(p_layout->members != NULL);
+        const struct member_declarator* p_member_declarator = p_layout->members[i].p_member_declarator;
+        if (p_member_declarator->declarator == NULL ||
+            p_member_declarator->declarator->name_opt == NULL)
         {
-            struct member_declarator* _Opt md = d->member_declarator_list_opt->head;
-            while (md)
-            {
-                if (md->declarator)
-                {
-                    size_t temp_align = type_get_alignof(&md->declarator->type, target);
-                    if (temp_align > align)
-                    {
-                        align = temp_align;
-                    }
-                }
-                else
-                {
-                    assert(false);
-                }
-                md = md->next;
-            }
+            continue;
         }
-        else if (d->specifier_qualifier_list)
+
+        /*the first member with the name is the one found*/
+        const char* name = p_member_declarator->declarator->name_opt->lexeme;
+        if (hashmap_find(&p_layout->names, name) == NULL)
         {
-            /*We don't have the declarator like in */
-            /*
-              struct X {
-                union {
-                    struct {
-                        int Zone;
-                    };
-                    int Value;
-                };
-            };
-            static_assert(alignof(struct X) == 1);
-            */
+            if (p_layout->names.table == NULL)
+                p_layout->names.capacity = p_layout->members_size * 2;
 
-            /*so we create a type using only specifiers*/
+            struct hash_item_set item = { 0 };
+            item.number = (size_t)i + 1;
+            const int r = hashmap_set(&p_layout->names, name, &item);
+            hash_item_set_destroy(&item);
+            if (r != 0)
+                return ENOMEM;
+        }
+    }
 
-            struct type type = { 0 };
+    p_layout->sizeof_result = sizeof_result;
+    p_layout->size = sizeof_result == SIZEOF_RESULT_OK ? size : 0;
+    p_layout->align = align;
+    return 0;
+}
 
-            type.type_specifier_flags = d->specifier_qualifier_list->type_specifier_flags;
+struct struct_layout* _Opt struct_layout_get(struct struct_or_union_specifier* p_complete, enum target target)
+{
+    assert(p_complete->member_declaration_list.head != NULL);
 
-            type.enum_specifier = d->specifier_qualifier_list->enum_specifier;
-            type.struct_or_union_specifier = d->specifier_qualifier_list->struct_or_union_specifier;
+    if (p_complete->layouts[target])
+        return p_complete->layouts[target];
 
+    struct struct_layout* _Owner _Opt p_new = calloc(1, sizeof * p_new);
+    if (p_new == NULL)
+        return NULL;
 
-            size_t temp_align = type_get_alignof(&type, target);
-            if (temp_align > align)
-            {
-                align = temp_align;
-            }
+    /*
+      The layout is set before it is built, so a struct that has itself
+      as member is incomplete instead of recursing forever.
+    */
+    p_new->sizeof_result = SIZEOF_RESULT_INCOMPLETE;
+    p_complete->layouts[target] = p_new;
 
-            type_destroy(&type);
-        }
-        else
-        {
-            /*static_assert*/
-        }
-        d = d->next;
+    struct struct_layout* p_layout = p_complete->layouts[target];
+    if (struct_layout_build(p_layout, p_complete, target) != 0)
+    {
+        p_layout->sizeof_result = SIZEOF_RESULT_INCOMPLETE;
+        p_layout->size = 0;
+        p_layout->offsets_count = 0;
     }
-    assert(align != 0);
-    return align;
+    return p_layout;
+}
+
+const struct member_layout* _Opt struct_layout_find(struct struct_layout* p_layout, const char* name, int* p_member_index)
+{
+    struct map_entry* _Opt p_entry = hashmap_find(&p_layout->names, name);
+    if (p_entry == NULL)
+        return NULL;
+
+    assert(p_layout->members != NULL);
+    const int index = (int)p_entry->data.number - 1;
+    *p_member_index = index;
+    return &p_layout->members[index];
+}
+
+static enum sizeof_result get_offsetof_struct(struct struct_or_union_specifier* complete_struct_or_union_specifier,
+    const char* member, size_t* sz, enum target target)
+{
+    struct struct_layout* _Opt p_layout = struct_layout_get(complete_struct_or_union_specifier, target);
+    if (p_layout == NULL)
+        return SIZEOF_RESULT_INCOMPLETE;
+
+    int member_index = 0;
+    const struct member_layout* _Opt p_member = struct_layout_find(p_layout, member, &member_index);
+    if (p_member == NULL)
+    {
+        /*not a member, the result is the one of sizeof*/
+        if (p_layout->sizeof_result == SIZEOF_RESULT_OK)
+            *sz = p_layout->size;
+        return p_layout->sizeof_result;
+    }
+
+    if (member_index >= p_layout->offsets_count)
+        return p_layout->sizeof_result;
+
+    *sz = p_member->offset;
+    return SIZEOF_RESULT_OK;
+}
+
+enum sizeof_result get_sizeof_struct(struct struct_or_union_specifier* complete_struct_or_union_specifier, size_t* sz, enum target target)
+{
+    struct struct_layout* _Opt p_layout = struct_layout_get(complete_struct_or_union_specifier, target);
+    if (p_layout == NULL)
+        return SIZEOF_RESULT_INCOMPLETE;
+
+    if (p_layout->sizeof_result == SIZEOF_RESULT_OK)
+        *sz = p_layout->size;
+
+    return p_layout->sizeof_result;
+}
+
+size_t get_alignof_struct(struct struct_or_union_specifier* complete_struct_or_union_specifier, enum target target)
+{
+    struct struct_layout* _Opt p_layout = struct_layout_get(complete_struct_or_union_specifier, target);
+
+    /*0 while the layout is built, when the struct has itself as member*/
+    if (p_layout == NULL || p_layout->align == 0)
+        return 1;
+
+    return p_layout->align;
 }
 
 size_t type_get_alignof(const struct type* p_type, enum target target)
@@ -2954,6 +2933,12 @@ static bool type_is_same_core(const struct type* a,
 
     while (pa && pb)
     {
+        if (pa == pb)
+        {
+            /*same node, the rest of the chain is shared (see type_dup)*/
+            return true;
+        }
+
         if (pa->array_num_elements != pb->array_num_elements)
             return false;
 
@@ -3267,15 +3252,8 @@ void type_list_push_front(struct type_list* books, struct type* _Owner new_book)
 
 void type_list_destroy(_Dtor struct type_list* p_type_list)
 {
-    struct type* _Owner _Opt item = p_type_list->head;
-    while (item)
-    {
-        struct type* _Owner _Opt next = item->next;
-        item->next = NULL;
-        type_destroy_one(item);
-        free(item);
-        item = next;
-    }
+    /*a typedef type at the end can have shared nodes*/
+    type_nodes_release(p_type_list->head);
 }
 
 void type_list_push_back(struct type_list* type_list, struct type* _Owner new_book)
@@ -3672,11 +3650,11 @@ struct type make_type_using_declarator(struct parser_ctx* ctx, struct declarator
             struct type nt =
                 type_dup(&p_typedef_declarator->type);
 
-            free((void*)nt.name_opt);
             nt.name_opt = NULL;
             if (pdeclarator->name_opt)
             {
-                nt.name_opt = strdup(pdeclarator->name_opt->lexeme);
+                const char* lexeme = pdeclarator->name_opt->lexeme;
+                nt.name_opt = atom_intern(lexeme, strlen(lexeme));
             }
 
             struct type* _Owner _Opt p_nt = calloc(1, sizeof(struct type));
@@ -3741,15 +3719,15 @@ struct type make_type_using_declarator(struct parser_ctx* ctx, struct declarator
 
         if (pdeclarator->name_opt)
         {
-            char* _Owner _Opt temp = strdup(pdeclarator->name_opt->lexeme);
-            if (temp == NULL)
+            const char* lexeme = pdeclarator->name_opt->lexeme;
+            const char* _Opt name = atom_intern(lexeme, strlen(lexeme));
+            if (name == NULL)
             {
                 type_list_destroy(&list);
                 throw;
             }
 
-            free((void* _Owner) list.head->name_opt);
-            list.head->name_opt = temp;
+            list.head->name_opt = name;
         }
 
         struct type r = *list.head;
@@ -3788,12 +3766,16 @@ void type_remove_names(struct type* p_type)
 
     while (p)
     {
-        if (p->name_opt)
-        {
-            free((void* _Owner _Opt)p->name_opt);
-            p->name_opt = NULL;
-        }
-        p = p->next;
+        p->name_opt = NULL;
+
+        /*shared nodes are copied only if they have names*/
+        const struct type* _Opt p_rest = p->next;
+        while (p_rest && p_rest->name_opt == NULL)
+            p_rest = p_rest->next;
+        if (p_rest == NULL)
+            break;
+
+        p = type_next_mutable(p);
     }
 }
 
@@ -9,6 +9,7 @@
 
 #include "osstream.h"
 #include "options.h"
+#include "hashmap.h"
 
 struct parser_ctx;
 
@@ -241,7 +242,7 @@ struct type
     enum type_qualifier_flags type_qualifier_flags;
     enum storage_class_specifier_flags storage_class_specifier_flags;
 
-    const char* _Owner _Opt name_opt;
+    const char* _Opt name_opt; /*atom*/
 
     struct struct_or_union_specifier* _Opt struct_or_union_specifier;
     const struct enum_specifier* _Opt enum_specifier;
@@ -264,6 +265,13 @@ struct type
     bool address_of;
 
     struct param_list params;
+
+    /*
+      type_dup copies only the first node, the next nodes are shared and
+      share_count is the number of other types using this node.
+      Shared nodes are not changed, see type_next_mutable.
+    */
+    int share_count;
     struct type* _Owner _Opt next;
 };
 
@@ -280,6 +288,7 @@ void print_type_no_names(struct osstream* ss, const struct type* p_type, enum ta
 
 void print_item(struct osstream* ss, bool* first, const char* item);
 struct type type_dup(const struct type* p_type);
+struct type* _Opt type_next_mutable(struct type* p_type);
 void type_set(struct type* a, const struct type* b);
 void type_destroy(_Opt _Dtor struct type* p_type);
 
@@ -403,6 +412,44 @@ enum sizeof_result
 enum sizeof_result type_get_sizeof(const struct type* p_type, size_t* size, enum target target);
 enum sizeof_result type_get_offsetof(const struct type* p_type, const char* member, size_t* size, enum target target);
 
+struct struct_or_union_specifier;
+struct member_declarator;
+
+struct member_layout
+{
+    struct member_declarator* p_member_declarator;
+    size_t offset;
+};
+
+/*
+  Size, alignment and member offsets of a complete struct or union.
+  It is computed once for each target and kept by the struct_or_union_specifier.
+*/
+struct struct_layout
+{
+    enum sizeof_result sizeof_result;
+    size_t size;
+    size_t align;
+
+    /*
+      All member declarators in member_index order. Members of anonymous
+      structs and unions are in place of them, with offsets from this struct.
+    */
+    struct member_layout* _Owner _Opt members;
+    int members_size;
+    int members_capacity;
+
+    /*members before offsets_count have an offset, the others come after a member without size*/
+    int offsets_count;
+
+    /*member name -> member_index + 1*/
+    struct hash_map names;
+};
+
+struct struct_layout* _Opt struct_layout_get(struct struct_or_union_specifier* p_complete, enum target target);
+const struct member_layout* _Opt struct_layout_find(struct struct_layout* p_layout, const char* name, int* p_member_index);
+void struct_layout_delete(struct struct_layout* _Owner _Opt p);
+
 size_t type_get_alignof(const struct type* p_type, enum target target);
 
 struct type type_add_pointer(const struct type* p_type, bool null_checks_enabled);
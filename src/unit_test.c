@@ -15,6 +15,9 @@ int g_unit_test_success_count = 0;
 void token_list_remove_get_test(void);
 void token_list_remove_get_test2(void);
 
+/* tests from hashmap.c*/
+void hashmap_grow_and_remove_test(void);
+
 /* tests from tokenizer.c*/
 void test_lexeme_cmp(void);
 void token_list_pop_front_test(void);
@@ -30,6 +33,7 @@ void test_va_opt_5(void);
 void test_va_opt_6(void);
 void test_va_opt_7(void);
 void concatenation_problem(void);
+void test_macro_template_reused(void);
 void test_va_opt_G2(void);
 void test_va_opt(void);
 void test_empty_va_args(void);
@@ -77,6 +81,14 @@ int stringify_test(void);
 void recursive_macro_expr(void);
 void quasi_recursive_macro(void);
 void newline_macro_func(void);
+void tokenizer_end_of_buffer_test(void);
+void include_guard_detection_test(void);
+
+/* tests from compile.c*/
+void dependency_file_test(void);
+void precompiled_header_test(void);
+void preprocessed_output_test(void);
+void cache_test(void);
 
 /* tests from target.c*/
 void target_self_test(void);
@@ -89,6 +101,7 @@ g_unit_test_error_count = 0;
 g_unit_test_success_count = 0;
     token_list_remove_get_test();
     token_list_remove_get_test2();
+    hashmap_grow_and_remove_test();
     test_lexeme_cmp();
     token_list_pop_front_test();
     token_list_pop_back_test();
@@ -103,6 +116,7 @@ g_unit_test_success_count = 0;
     test_va_opt_6();
     test_va_opt_7();
     concatenation_problem();
+    test_macro_template_reused();
     test_va_opt_G2();
     test_va_opt();
     test_empty_va_args();
@@ -150,6 +164,12 @@ g_unit_test_success_count = 0;
     recursive_macro_expr();
     quasi_recursive_macro();
     newline_macro_func();
+    tokenizer_end_of_buffer_test();
+    include_guard_detection_test();
+    dependency_file_test();
+    precompiled_header_test();
+    preprocessed_output_test();
+    cache_test();
     target_self_test();
 return g_unit_test_error_count;
 
@@ -326,39 +326,12 @@ static int asm_get_member_offset(const struct asm_visit_ctx* ctx,
     if (p_complete == NULL)
         return 0;
 
-    /* Walk members to accumulate offset */
-    int offset = 0;
-    int idx = 0;
-    struct member_declaration* _Opt md = p_complete->member_declaration_list.head;
-    while (md)
-    {
-        if (md->member_declarator_list_opt)
-        {
-            struct member_declarator* _Opt decl = md->member_declarator_list_opt->head;
-            while (decl)
-            {
-                if (decl->declarator)
-                {
-                    if (idx == member_index)
-                    {
-                        /* Use type_get_offsetof if available, else compute manually */
-                        return offset;
-                    }
-                    size_t member_size = 0;
-                    type_get_sizeof(&decl->declarator->type, &member_size, ctx->options.target);
-                    int alignment = (int)member_size;
-                    if (alignment > 8) alignment = 8;
-                    if (alignment < 1) alignment = 1;
-                    offset = align_up(offset, alignment);
-                    offset += (int)member_size;
-                    idx++;
-                }
-                decl = decl->next;
-            }
-        }
-        md = md->next;
-    }
-    return 0;
+    struct struct_layout* _Opt p_layout = struct_layout_get(p_complete, ctx->options.target);
+    if (p_layout == NULL || member_index < 0 || member_index >= p_layout->offsets_count)
+        return 0;
+
+    assert(p_layout->members != NULL);
+    return (int)p_layout->members[member_index].offset;
 }
 
 static int asm_find_member_name(const struct type* p_type, int index, char name[100])
@@ -2213,6 +2186,84 @@ static void asm_visit_function_body(struct asm_visit_ctx* ctx, struct osstream*
     ctx->is_in_function = (previous_func != NULL);
 }
 
+/*
+ * Arrays of 1-byte integers with constant initializers (for instance
+ * filled by #embed) are emitted as runs of .byte.
+ */
+static bool asm_object_is_constant_byte_array(const struct asm_visit_ctx* ctx, const struct object* p_object)
+{
+    if (!type_is_array(&p_object->type))
+        return false;
+
+    struct type item_type = get_array_item_type(&p_object->type);
+    const bool byte_items = type_is_integer(&item_type) && asm_type_size(ctx, &item_type) == 1;
+    type_destroy(&item_type);
+
+    if (!byte_items)
+        return false;
+
+    for (const struct object* _Opt p = p_object->members.head; p; p = p->next)
+    {
+        if (p->members.head != NULL)
+            return false;
+        if (p->p_init_expression && !object_has_constant_value(&p->p_init_expression->object))
+            return false;
+    }
+
+    return true;
+}
+
+static void asm_emit_byte(struct osstream* ss, unsigned char value, int* column)
+{
+    ss_fprintf(ss, *column == 0 ? "    .byte %d" : ",%d", value);
+    (*column)++;
+    if (*column == 16)
+    {
+        ss_fprintf(ss, "\n");
+        *column = 0;
+    }
+}
+
+static void asm_emit_byte_runs(struct osstream* ss, const struct object* p_object, int size)
+{
+    int count = 0;
+    int column = 0;
+    for (const struct object* _Opt p = p_object->members.head; p; p = p->next)
+    {
+        if (object_is_run(p) && p->run_values)
+        {
+            /* packed values */
+            for (size_t i = 0; i < p->run_count; i++)
+            {
+                const struct object value = object_run_value(p, p->run_index + i);
+                asm_emit_byte(ss, (unsigned char)object_to_unsigned_long_long(&value), &column);
+            }
+            count += (int)p->run_count;
+            continue;
+        }
+
+        if (object_is_run(p))
+        {
+            /* elements without initializer are zero */
+            if (column != 0)
+                ss_fprintf(ss, "\n");
+            column = 0;
+            ss_fprintf(ss, "    .zero %zu\n", p->run_count);
+            count += (int)p->run_count;
+            continue;
+        }
+
+        asm_emit_byte(ss, (unsigned char)object_to_unsigned_long_long(p), &column);
+        count++;
+    }
+
+    if (column != 0)
+        ss_fprintf(ss, "\n");
+
+    if (count < size)
+        ss_fprintf(ss, "    .zero %d\n", size - count);
+}
+
 /* =========================================================================
  *  Declaration visitors
  * ========================================================================= */
@@ -2323,6 +2374,17 @@ static void asm_visit_init_declarator(struct asm_visit_ctx* ctx, struct osstream
         int size = asm_type_size(ctx, &p_init_declarator->p_declarator->type);
 
         if (p_init_declarator->initializer &&
+            asm_object_is_constant_byte_array(ctx, &p_init_declarator->p_declarator->object))
+        {
+            /* Initialized global array of bytes -> .data section */
+            if (!is_static)
+                ss_fprintf(&ctx->data_section, "    .globl %s\n", name);
+            ss_fprintf(&ctx->data_section, "    .type %s, @object\n", name);
+            ss_fprintf(&ctx->data_section, "    .size %s, %d\n", name, size);
+            ss_fprintf(&ctx->data_section, "%s:\n", name);
+            asm_emit_byte_runs(&ctx->data_section, &p_init_declarator->p_declarator->object, size);
+        }
+        else if (p_init_declarator->initializer &&
             p_init_declarator->initializer->assignment_expression &&
             object_has_constant_value(&p_init_declarator->initializer->assignment_expression->object))
         {
@@ -2781,6 +2781,12 @@ static void register_struct_types_and_functions(struct d_visit_ctx* ctx,
 
                             p_struct_entry->p_struct_or_union_specifier = p_complete;
 
+                            if (ctx->p_last_struct_entry)
+                                ctx->p_last_struct_entry->next = p_struct_entry;
+                            else
+                                ctx->p_first_struct_entry = p_struct_entry;
+                            ctx->p_last_struct_entry = p_struct_entry;
+
                             {
                                 struct hash_item_set i = { 0 };
                                 i.p_struct_entry = p_struct_entry;
@@ -3295,6 +3301,16 @@ static bool is_all_zero(const struct object* object)
         object = object_get_referenced(object);
     }
 
+    if (object->run_values)
+    {
+        for (size_t i = 0; i < object->run_count; i++)
+        {
+            const struct object value = object_run_value(object, object->run_index + i);
+            if (object_is_true(&value))
+                return false;
+        }
+    }
+
     if (object->members.head != NULL)
     {
         struct object* _Opt member = object->members.head;
@@ -3323,26 +3339,133 @@ static bool is_all_zero(const struct object* object)
 }
 
 
-static void object_print_constant_initialization(struct d_visit_ctx* ctx, struct osstream* ss, const struct object* object, bool* first)
+/* number of values object_print_constant_initialization prints for the object */
+static size_t object_count_constant_initializers(const struct object* object)
 {
-    if (object_is_reference(object))
+    if (object_is_run(object))
     {
-        object = object_get_referenced(object);
+        struct object* _Owner _Opt p_element = object_run_make_element(object, object->run_index);
+        if (p_element == NULL)
+            return 0;
+        const size_t count = object->run_count * object_count_constant_initializers(p_element);
+        object_delete(p_element);
+        return count;
     }
 
+    if (object->members.head == NULL)
+        return 1;
 
-    if (object->p_init_expression &&
-        object->p_init_expression->expression_type == PRIMARY_EXPRESSION_STRING_LITERAL)
+    if (type_is_union(&object->type))
+        return object_count_constant_initializers(object->members.head);
+
+    size_t count = 0;
+    struct object* _Opt member = object->members.head;
+    while (member)
+    {
+        count += object_count_constant_initializers(member);
+        member = member->next;
+    }
+    return count;
+}
+
+/*
+  More zeros than this before a value are replaced by the designator of
+  the value (C99), so { [1000000] = 1 } does not print a million zeros.
+*/
+#define SPARSE_ZEROS_MIN 64
+
+static bool is_valid_designator(const char* _Opt designator)
+{
+    if (designator == NULL || (designator[0] != '.' && designator[0] != '['))
+        return false;
+
+    /*object.c names have at most 199 chars, longer ones were truncated*/
+    if (strlen(designator) >= 199)
+        return false;
+
+    /*members of anonymous structs and unions have no name*/
+    for (const char* p = designator; *p; p++)
+    {
+        if (*p == '.' && (p[1] == '.' || p[1] == '[' || p[1] == '\0'))
+            return false;
+    }
+    return true;
+}
+
+/*
+  Prints the zeros counted before the value with the designator and the ','
+*/
+static void print_value_separator(struct osstream* ss, bool* first, size_t* zeros, const char* _Opt designator)
+{
+    if (*zeros >= SPARSE_ZEROS_MIN && is_valid_designator(designator))
     {
         if (!(*first))
             ss_fprintf(ss, ",");
 
         *first = false;
+        *zeros = 0;
+        ss_fprintf(ss, "%s = ", designator);
+        return;
+    }
+
+    for (; *zeros > 0; (*zeros)--)
+    {
+        if (!(*first))
+            ss_fprintf(ss, ",");
+
+        *first = false;
+        ss_fprintf(ss, "0");
+    }
+
+    if (!(*first))
+        ss_fprintf(ss, ",");
+
+    *first = false;
+}
+
+/*
+  Zeros are counted and printed before the next value, so the zeros
+  at end are not printed.
+*/
+static void object_print_constant_initialization_core(struct d_visit_ctx* ctx, struct osstream* ss, const struct object* object, bool* first, size_t* zeros)
+{
+    if (object_is_reference(object))
+    {
+        object = object_get_referenced(object);
+    }
 
+
+    if (object->p_init_expression &&
+        object->p_init_expression->expression_type == PRIMARY_EXPRESSION_STRING_LITERAL)
+    {
+        print_value_separator(ss, first, zeros, object->member_designator);
         il_print_string(object->p_init_expression->first_token, object->p_init_expression->last_token, ss);
         return;
     }
 
+    if (object_is_run(object) && object->run_values)
+    {
+        /*packed values*/
+        for (size_t i = 0; i < object->run_count; i++)
+        {
+            const size_t index = object->run_index + i;
+            char designator[200] = { 0 };
+            if (*zeros >= SPARSE_ZEROS_MIN)
+                snprintf(designator, sizeof designator, "%s[%zu]", object->member_designator ? object->member_designator : "", index);
+
+            print_value_separator(ss, first, zeros, designator);
+            const struct object value = object_run_value(object, index);
+            object_print_value(ss, &value, ctx->options.target);
+        }
+        return;
+    }
+
+    if (object_is_run(object))
+    {
+        *zeros += object_count_constant_initializers(object);
+        return;
+    }
+
     if (object->members.head != NULL)
     {
         if (type_is_union(&object->type))
@@ -3351,27 +3474,24 @@ static void object_print_constant_initialization(struct d_visit_ctx* ctx, struct
             //we could make the first member be array of unsigned int
             //then initialize it
             struct object* _Opt member = object->members.head;
-            object_print_constant_initialization(ctx, ss, member, first);
+            object_print_constant_initialization_core(ctx, ss, member, first, zeros);
         }
         else
         {
             struct object* _Opt member = object->members.head;
             while (member)
             {
-                object_print_constant_initialization(ctx, ss, member, first);
+                object_print_constant_initialization_core(ctx, ss, member, first, zeros);
                 member = member->next;
             }
         }
     }
     else
     {
-        if (!(*first))
-            ss_fprintf(ss, ",");
-
-        *first = false;
-
         if (object->p_init_expression)
         {
+            print_value_separator(ss, first, zeros, object->member_designator);
+
             if (object_has_constant_value(&object->p_init_expression->object))
             {
                 object_print_value(ss, &object->p_init_expression->object, ctx->options.target);
@@ -3391,11 +3511,24 @@ static void object_print_constant_initialization(struct d_visit_ctx* ctx, struct
         }
         else
         {
-            ss_fprintf(ss, "0");
+            (*zeros)++;
         }
     }
 }
 
+static void object_print_constant_initialization(struct d_visit_ctx* ctx, struct osstream* ss, const struct object* object, bool* first)
+{
+    size_t zeros = 0;
+    object_print_constant_initialization_core(ctx, ss, object, first, &zeros);
+
+    if (*first)
+    {
+        /* {} is not valid in C89 */
+        ss_fprintf(ss, "0");
+        *first = false;
+    }
+}
+
 static void object_print_non_constant_initialization(struct d_visit_ctx* ctx,
     struct osstream* ss,
     const struct object* object,
@@ -3409,6 +3542,45 @@ static void object_print_non_constant_initialization(struct d_visit_ctx* ctx,
         object = object_get_referenced(object);
     }
 
+    if (object_is_run(object) && object->run_values)
+    {
+        /* values of constant expressions, packed */
+        if (all)
+        {
+            for (size_t i = 0; i < object->run_count; i++)
+            {
+                const size_t index = object->run_index + i;
+                const struct object value = object_run_value(object, index);
+                print_identation_core(ss, ctx->indentation);
+                ss_fprintf(ss, "%s%s[%zu] = ", declarator_name, object->member_designator, index);
+                object_print_value(ss, &value, ctx->options.target);
+                ss_fprintf(ss, ";\n");
+            }
+        }
+        return;
+    }
+
+    if (object_is_run(object))
+    {
+        /* elements without initializer */
+        if (all && initialize_objects_that_does_not_have_initializer)
+        {
+            print_identation_core(ss, ctx->indentation);
+            if (object->run_count == 1 && type_is_scalar(&object->type))
+            {
+                ss_fprintf(ss, "%s%s[%zu] = 0;\n", declarator_name, object->member_designator, object->run_index);
+            }
+            else
+            {
+                size_t sz = 0;
+                type_get_sizeof(&object->type, &sz, ctx->options.target);
+                ss_fprintf(ss, "_cake_zmem(&%s%s[%zu], %zu);\n", declarator_name, object->member_designator, object->run_index, object->run_count * sz);
+                ctx->zero_mem_used = true;
+            }
+        }
+        return;
+    }
+
     if (object->members.head != NULL)
     {
         if (type_is_union(&object->type))
@@ -3895,8 +4067,9 @@ static void d_visit_init_declarator(struct d_visit_ctx* ctx,
                     p_init_declarator->p_declarator->name_opt->lexeme
                 );
 
-                free(p_init_declarator->p_declarator->name_opt->lexeme);
-                p_init_declarator->p_declarator->name_opt->lexeme = strdup(name);
+                char* _Owner _Opt temp = strdup(name);
+                if (temp)
+                    token_set_lexeme(p_init_declarator->p_declarator->name_opt, temp);
             }
         }
         return;
@@ -4147,15 +4320,11 @@ void d_visit(struct d_visit_ctx* ctx, struct osstream* oss)
     }
 
 
-    for (int i = 0; i < ctx->structs_map.capacity; i++)
+    struct struct_entry* _Opt p_struct_entry = ctx->p_first_struct_entry;
+    while (p_struct_entry)
     {
-        struct map_entry* _Opt entry = ctx->structs_map.table[i];
-        while (entry)
-        {
-            assert(entry->data.p_struct_entry != NULL);
-            d_print_structs(ctx, oss, entry->data.p_struct_entry);
-            entry = entry->next;
-        }
+        d_print_structs(ctx, oss, p_struct_entry);
+        p_struct_entry = p_struct_entry->next;
     }
     ss_fprintf(oss, "\n");
 
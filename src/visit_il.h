@@ -29,6 +29,13 @@ struct d_visit_ctx
     
     struct hash_map tag_names;
     struct hash_map structs_map;
+
+    /*
+       entries of structs_map in the order they were found, so the
+       output does not depend on the hash order
+    */
+    struct struct_entry* _Opt p_first_struct_entry;
+    struct struct_entry* _Opt p_last_struct_entry;
     struct hash_map file_scope_declarator_map;
     struct hash_map instantiated_function_literals;
     
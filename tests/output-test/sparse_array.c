@@ -0,0 +1,10 @@
+int big[1 << 20] = { [1000000] = 1 };
+struct S { int a[100]; int b; } s = { .b = 2 };
+int small[4] = { [2] = 3 };
+
+int main(void)
+{
+    int local[1000] = { [500] = 7 };
+    static int st[300] = { [299] = 5 };
+    return local[500] + st[299] + big[1000000] + s.b + small[2];
+}
@@ -0,0 +1,17 @@
+/*
+  structs are emitted in the order they are used, after the structs
+  they depend on
+*/
+struct Z { int z; };
+struct M { int m; };
+struct A { struct Z z; struct M* p; };
+union U { int i; float f; };
+struct Q { union U u; };
+
+int main(void)
+{
+    struct Q q = { 0 };
+    struct A a = { 0 };
+    struct M m = { 0 };
+    return q.u.i + a.z.z + m.m;
+}
@@ -0,0 +1,24 @@
+
+int sum3(int a, int b, int c) { return a + b + c; }
+
+static_assert((
+#embed "embed_1.bin"
+) == 'a');
+
+int main()
+{
+    int r = sum3(
+#embed "embed_3.bin"
+    );
+
+    int r2 = sum3(
+#embed "embed_1.bin"
+    , 1, 2);
+
+    int a[] = {
+#embed "embed_3.bin"
+    };
+    static_assert(sizeof a / sizeof a[0] == 3);
+
+    return r + r2 + a[0];
+}
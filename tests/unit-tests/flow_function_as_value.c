@@ -0,0 +1,27 @@
+#pragma safety enable
+
+/*
+  functions used as values (callbacks, function pointers initialized
+  with a function) do not have a flow object until they are used
+*/
+
+static void G(void) {}
+
+void (*F(int a, int b))(void) { return G; }
+
+void (*(*PF)(int a, int b))(void) = F;
+
+static void callback(int i) {}
+
+void call(void (*f)(int))
+{
+    f(1);
+}
+
+int main()
+{
+    PF(1, 2);
+    call(callback);
+    void (*p)(int) = callback;
+    p(2);
+}
@@ -0,0 +1,39 @@
+
+constexpr signed char c[] = {-1, 127, -128, 300};
+static_assert(sizeof c == 4);
+static_assert(c[0] == -1);
+static_assert(c[2] == -128);
+static_assert(c[3] == 44);
+
+constexpr unsigned short s[10] = {1, 2, [8] = 65535, 7};
+static_assert(s[1] == 2);
+static_assert(s[2] == 0);
+static_assert(s[8] == 65535);
+static_assert(s[9] == 7);
+
+constexpr int i[] = {1, [5] = 6, 7, [1] = 2};
+static_assert(sizeof i / sizeof i[0] == 7);
+static_assert(i[1] == 2);
+static_assert(i[4] == 0);
+static_assert(i[6] == 7);
+
+constexpr unsigned char e[] = {
+#embed "embed_3.bin"
+    , 1, 2
+};
+static_assert(sizeof e == 5);
+static_assert(e[0] == 'a');
+static_assert(e[4] == 2);
+
+constexpr long long ll[3] = {-1, 9223372036854775807};
+static_assert(ll[0] == -1);
+static_assert(ll[1] == 9223372036854775807);
+static_assert(ll[2] == 0);
+
+int main()
+{
+    int x = 3;
+    int a[4] = {1, x, 3};
+    int* p = &a[2];
+    return *p + a[0];
+}
@@ -0,0 +1,29 @@
+void f(void)
+{
+    {
+        int inner = 1;
+        inner++;
+    }
+
+    //identifier 'inner' not declared
+    [[cake::e680]]
+    inner = 2;
+}
+
+void g(void)
+{
+    {
+        struct local { int i; } s = { 0 };
+        s.i++;
+    }
+
+    //'struct local' of the block is not visible, this is a new incomplete type
+    [[cake::e740]]
+    struct local l;
+}
+
+void h(void)
+{
+    struct local { double d; } s = { 0 };
+    static_assert(sizeof(s) == sizeof(double));
+}
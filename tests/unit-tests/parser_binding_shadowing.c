@@ -0,0 +1,43 @@
+int x;
+
+void f(char x)
+{
+    static_assert(_Generic(x, char: 1, default: 0));
+    {
+        //declaration of 'x' hides previous declaration
+        [[cake::w7]]
+        double x = 0;
+        static_assert(_Generic(x, double: 1, default: 0));
+        {
+            [[cake::w7]]
+            short x = 0;
+            static_assert(_Generic(x, short: 1, default: 0));
+        }
+        static_assert(_Generic(x, double: 1, default: 0));
+    }
+    static_assert(_Generic(x, char: 1, default: 0));
+}
+
+void g(void)
+{
+    static_assert(_Generic(x, int: 1, default: 0));
+
+    typedef double x;
+    static_assert(sizeof(x) == sizeof(double));
+    {
+        enum { x = 3 };
+        static_assert(x == 3);
+    }
+    static_assert(sizeof(x) == sizeof(double));
+}
+
+void h(void)
+{
+    static_assert(_Generic(x, int: 1, default: 0));
+
+    for (long x = 0; x < 1; x++)
+    {
+        static_assert(_Generic(x, long: 1, default: 0));
+    }
+    static_assert(_Generic(x, int: 1, default: 0));
+}
@@ -0,0 +1,31 @@
+struct s { int a; };
+int s;
+
+static_assert(sizeof(struct s) == sizeof(int));
+static_assert(_Generic(s, int: 1, default: 0));
+
+void f(void)
+{
+    /*ordinary identifier, the tag is not shadowed*/
+    double s = 0;
+    static_assert(_Generic(s, double: 1, default: 0));
+    static_assert(sizeof(struct s) == sizeof(int));
+    {
+        /*tag, the ordinary identifier is not shadowed*/
+        struct s { char c[3]; };
+        static_assert(sizeof(struct s) == 3);
+        static_assert(_Generic(s, double: 1, default: 0));
+    }
+    static_assert(sizeof(struct s) == sizeof(int));
+}
+
+void g(void)
+{
+    static_assert(_Generic(s, int: 1, default: 0));
+    static_assert(sizeof(struct s) == sizeof(int));
+
+    /*enum tag and enumerator with the same name*/
+    enum s2 { s2 = 5 };
+    static_assert(s2 == 5);
+    static_assert(sizeof(enum s2) == sizeof(int));
+}
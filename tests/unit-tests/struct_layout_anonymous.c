@@ -0,0 +1,30 @@
+struct S
+{
+    char c;
+    struct
+    {
+        short s;
+        double d;
+    };
+    union
+    {
+        int i;
+        char a[5];
+    };
+    char last;
+};
+
+static_assert(__builtin_offsetof(struct S, c) == 0);
+static_assert(__builtin_offsetof(struct S, s) == 8);
+static_assert(__builtin_offsetof(struct S, d) == 16);
+static_assert(__builtin_offsetof(struct S, i) == 24);
+static_assert(__builtin_offsetof(struct S, a) == 24);
+static_assert(__builtin_offsetof(struct S, last) == 32);
+static_assert(sizeof(struct S) == 40);
+
+void f(void)
+{
+    struct S x = { .d = 1, .a = { 1 } };
+    static_assert(_Generic(x.d, double: 1, default: 0));
+    static_assert(sizeof(x.a) == 5);
+}
@@ -0,0 +1,19 @@
+struct node
+{
+    int value;
+    struct node* next;
+    struct node* children[2];
+};
+
+static_assert(__builtin_offsetof(struct node, next) == sizeof(void*));
+static_assert(__builtin_offsetof(struct node, children) == 2 * sizeof(void*));
+static_assert(sizeof(struct node) == 4 * sizeof(void*));
+
+struct list
+{
+    struct node head;
+    struct list* next;
+};
+
+static_assert(__builtin_offsetof(struct list, next) == sizeof(struct node));
+static_assert(sizeof(struct list) == sizeof(struct node) + sizeof(void*));
@@ -0,0 +1,23 @@
+union U
+{
+    char c;
+    double d;
+    int a[3];
+};
+
+static_assert(sizeof(union U) == 16);
+static_assert(alignof(union U) == 8);
+static_assert(__builtin_offsetof(union U, c) == 0);
+static_assert(__builtin_offsetof(union U, d) == 0);
+static_assert(__builtin_offsetof(union U, a) == 0);
+
+struct S
+{
+    char c;
+    union U u;
+    char c2;
+};
+
+static_assert(__builtin_offsetof(struct S, u) == 8);
+static_assert(__builtin_offsetof(struct S, c2) == 24);
+static_assert(sizeof(struct S) == 32);